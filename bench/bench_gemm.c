@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "gemm.h"
+#include "timing.h"
+
+typedef struct {
+    const char* name;
+    bool trans_a;
+    bool trans_b;
+    size_t m, n, k;
+} BenchShape;
+
+static void fill(double* x, size_t len, unsigned seed) {
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (double)(seed >> 16) / 65536.0 - 0.5;
+    }
+}
+
+// Best of reps runs, in GFLOP/s
+static double bench(GemmBackend backend, BenchShape* s, const double* a, const double* b, double* c, int reps) {
+    double best = 1e30;
+    for (int r = 0; r < reps; r++) {
+        double t0 = now_sec();
+        gemm_dgemm_with(backend, s->trans_a, s->trans_b, s->m, s->n, s->k, 1.0, a, b, 0.0, c);
+        double dt = now_sec() - t0;
+        if (dt < best) best = dt;
+    }
+    return 2.0 * s->m * s->n * s->k / best / 1e9;
+}
+
+// Usage: bench_gemm [N] [REPS], N is the batch size of the linear model shapes
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    int reps = argc > 2 ? atoi(argv[2]) : 5;
+
+    // The blocked rows use tuned parameters when an --autotune profile is present
+    int tuned = gemm_load_profile(gemm_profile_path());
+    if (tuned > 0) printf("Loaded %d tuned shapes from %s\n", tuned, gemm_profile_path());
+
+    BenchShape shapes[] = {
+        {"forward W*X^T", false, false, 10, n, 784},
+        {"backward dS*X", false, false, 10, 784, n},
+        {"autograd dS*X^T", false, true, 10, 784, n},
+        {"square 512", false, false, 512, 512, 512},
+    };
+
+    printf("%-18s %-10s %10s %12s\n", "shape", "backend", "GFLOP/s", "max |diff|");
+    for (size_t si = 0; si < sizeof(shapes) / sizeof(shapes[0]); si++) {
+        BenchShape* s = &shapes[si];
+        double* a = (double*)malloc(s->m * s->k * sizeof(double));
+        double* b = (double*)malloc(s->k * s->n * sizeof(double));
+        double* ref = (double*)malloc(s->m * s->n * sizeof(double));
+        double* c = (double*)malloc(s->m * s->n * sizeof(double));
+        if (!a || !b || !ref || !c) return 1;
+        fill(a, s->m * s->k, 1);
+        fill(b, s->k * s->n, 2);
+        gemm_dgemm_with(GEMM_BACKEND_REFERENCE, s->trans_a, s->trans_b, s->m, s->n, s->k, 1.0, a, b, 0.0, ref);
+
+        for (size_t be = 0; be < GEMM_BACKEND_COUNT; be++) {
+            if (!gemm_backend_available((GemmBackend)be)) continue;
+            double gflops = bench((GemmBackend)be, s, a, b, c, reps);
+            double diff = 0.0;
+            for (size_t i = 0; i < s->m * s->n; i++) diff = fmax(diff, fabs(c[i] - ref[i]));
+            printf("%-18s %-10s %10.2f %12.2e\n", s->name, gemm_backend_name((GemmBackend)be), gflops, diff);
+        }
+        free(a);
+        free(b);
+        free(ref);
+        free(c);
+    }
+    return 0;
+}
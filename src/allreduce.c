@@ -0,0 +1,184 @@
+#include "allreduce.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define ALLREDUCE_ALIGN 64
+
+AllreduceGroup* allreduce_group_new(size_t n_ranks, size_t count) {
+    if (n_ranks == 0) return NULL;
+
+    AllreduceGroup* g = (AllreduceGroup*)malloc(sizeof(AllreduceGroup));
+    if (!g) return NULL;
+
+    size_t header = (sizeof(pthread_barrier_t) + sizeof(int) + ALLREDUCE_ALIGN - 1) / ALLREDUCE_ALIGN * ALLREDUCE_ALIGN;
+    g->n_ranks = n_ranks;
+    g->count = count;
+    g->shm_size = header + n_ranks * count * sizeof(double);
+    g->shm = mmap(NULL, g->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (g->shm == MAP_FAILED) {
+        perror("mmap");
+        free(g);
+        return NULL;
+    }
+
+    g->barrier = (pthread_barrier_t*)g->shm;
+    g->aborted = (int*)(g->barrier + 1);
+    *g->aborted = 0;
+    g->slots = (double*)((char*)g->shm + header);
+
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(g->barrier, &attr, (unsigned)n_ranks);
+    pthread_barrierattr_destroy(&attr);
+
+    return g;
+}
+
+// Only the creating process should call this, after every other rank has exited
+void allreduce_group_free(AllreduceGroup* g) {
+    if (g) {
+        pthread_barrier_destroy(g->barrier);
+        munmap(g->shm, g->shm_size);
+        free(g);
+    }
+}
+
+// Collective: every rank reports whether it can go on, returns -1 on all of them if any
+// could not. The second barrier keeps a fast rank's next vote from being read in this one.
+int allreduce_check(AllreduceGroup* g, bool ok) {
+    if (!ok) __atomic_store_n(g->aborted, 1, __ATOMIC_RELAXED);
+    pthread_barrier_wait(g->barrier);
+    int aborted = __atomic_load_n(g->aborted, __ATOMIC_RELAXED);
+    pthread_barrier_wait(g->barrier);
+    return aborted ? -1 : 0;
+}
+
+static size_t chunk_start(size_t c, size_t len, size_t n) {
+    return c * len / n;
+}
+
+// Sums data[offset, offset + len) across all ranks in place. Every rank must call it with
+// the same range. Reduce-scatter then allgather around the ring: in each of the 2(n-1)
+// steps a rank only reads the chunk its left neighbour finished in the previous step.
+void allreduce_sum(AllreduceGroup* g, size_t rank, double* data, size_t offset, size_t len) {
+    size_t n = g->n_ranks;
+    double* mine = g->slots + rank * g->count + offset;
+    double* left = g->slots + ((rank + n - 1) % n) * g->count + offset;
+
+    memcpy(mine, data + offset, len * sizeof(double));
+    pthread_barrier_wait(g->barrier);
+
+    for (size_t s = 0; s + 1 < n; s++) {
+        size_t c = (rank + 2 * n - s - 1) % n;
+        size_t lo = chunk_start(c, len, n), hi = chunk_start(c + 1, len, n);
+        for (size_t i = lo; i < hi; i++) mine[i] += left[i];
+        pthread_barrier_wait(g->barrier);
+    }
+
+    // Rank r now owns the complete chunk (r + 1) % n
+    for (size_t s = 0; s + 1 < n; s++) {
+        size_t c = (rank + n - s) % n;
+        size_t lo = chunk_start(c, len, n), hi = chunk_start(c + 1, len, n);
+        memcpy(mine + lo, left + lo, (hi - lo) * sizeof(double));
+        pthread_barrier_wait(g->barrier);
+    }
+
+    memcpy(data + offset, mine, len * sizeof(double));
+    // Nobody may reuse the slots until everyone has copied out
+    pthread_barrier_wait(g->barrier);
+}
+
+static void* stream_main(void* arg) {
+    AllreduceStream* s = (AllreduceStream*)arg;
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->stop && s->n_done == s->n_posted) pthread_cond_wait(&s->cond, &s->lock);
+        if (s->n_done == s->n_posted) break;
+
+        size_t offset = s->offsets[s->n_done];
+        size_t len = s->lens[s->n_done];
+        pthread_mutex_unlock(&s->lock);
+
+        allreduce_sum(s->group, s->rank, s->data, offset, len);
+
+        pthread_mutex_lock(&s->lock);
+        s->n_done++;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+AllreduceStream* allreduce_stream_start(AllreduceGroup* g, size_t rank, double* data, size_t max_buckets) {
+    AllreduceStream* s = (AllreduceStream*)calloc(1, sizeof(AllreduceStream));
+    if (!s) return NULL;
+
+    s->group = g;
+    s->rank = rank;
+    s->data = data;
+    s->capacity = max_buckets;
+    s->offsets = (size_t*)malloc(max_buckets * sizeof(size_t));
+    s->lens = (size_t*)malloc(max_buckets * sizeof(size_t));
+    if (!s->offsets || !s->lens) {
+        free(s->offsets);
+        free(s->lens);
+        free(s);
+        return NULL;
+    }
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->thread, NULL, stream_main, s) != 0) {
+        printf("allreduce_stream_start: could not start the communication thread\n");
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+        free(s->offsets);
+        free(s->lens);
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+// Hands data[offset, offset + len) to the communication thread, it must be final by now
+void allreduce_stream_post(AllreduceStream* s, size_t offset, size_t len) {
+    pthread_mutex_lock(&s->lock);
+    if (s->n_posted == s->capacity) {
+        pthread_mutex_unlock(&s->lock);
+        printf("allreduce_stream_post: more than %zu buckets before wait\n", s->capacity);
+        return;
+    }
+    s->offsets[s->n_posted] = offset;
+    s->lens[s->n_posted] = len;
+    s->n_posted++;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+// Blocks until every posted bucket is reduced, then starts a new round
+void allreduce_stream_wait(AllreduceStream* s) {
+    pthread_mutex_lock(&s->lock);
+    while (s->n_done < s->n_posted) pthread_cond_wait(&s->cond, &s->lock);
+    s->n_done = 0;
+    s->n_posted = 0;
+    pthread_mutex_unlock(&s->lock);
+}
+
+void allreduce_stream_stop(AllreduceStream* s) {
+    if (!s) return;
+    pthread_mutex_lock(&s->lock);
+    s->stop = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->thread, NULL);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->offsets);
+    free(s->lens);
+    free(s);
+}
@@ -0,0 +1,49 @@
+// allreduce.h
+#ifndef ALLREDUCE_H
+#define ALLREDUCE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Ring allreduce between processes forked from the same parent. Everything lives in one
+// MAP_SHARED mapping created before fork: a process-shared barrier, the abort flag and one
+// slot per rank.
+typedef struct {
+    size_t n_ranks;
+    size_t count;                 // Doubles per slot
+    pthread_barrier_t* barrier;
+    int* aborted;                 // Set by any rank that cannot go on, never cleared
+    double* slots;                // n_ranks * count
+    void* shm;
+    size_t shm_size;
+} AllreduceGroup;
+
+// Background reduction of gradient buckets while the caller computes the next ones
+typedef struct {
+    AllreduceGroup* group;
+    size_t rank;
+    double* data;                 // Caller's buffer, count doubles, summed in place
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t* offsets;              // Posted buckets, processed in order
+    size_t* lens;
+    size_t capacity;
+    size_t n_posted;
+    size_t n_done;
+    bool stop;
+} AllreduceStream;
+
+AllreduceGroup* allreduce_group_new(size_t n_ranks, size_t count);
+void allreduce_group_free(AllreduceGroup* g);
+void allreduce_sum(AllreduceGroup* g, size_t rank, double* data, size_t offset, size_t len);
+int allreduce_check(AllreduceGroup* g, bool ok);
+
+AllreduceStream* allreduce_stream_start(AllreduceGroup* g, size_t rank, double* data, size_t max_buckets);
+void allreduce_stream_post(AllreduceStream* s, size_t offset, size_t len);
+void allreduce_stream_wait(AllreduceStream* s);
+void allreduce_stream_stop(AllreduceStream* s);
+
+#endif // ALLREDUCE_H
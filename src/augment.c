@@ -0,0 +1,310 @@
+#include "augment.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AUGMENT_X86 1
+#endif
+
+#define PAD_SIDE (AUGMENT_SIDE + 2)    // One zero pixel around the source, no bounds checks
+#define ROW_LANES 32                   // Row length rounded up to whole 8-float vectors
+
+// Bilinear samples of one output row at source coordinates (sx, sy), in padded pixels
+typedef void (*AugmentRowFn)(const float* pad, const float* sx, const float* sy, float* out);
+
+static AugmentRowFn row_fn = NULL;
+static const char* row_name = "scalar";
+
+static void sample_row_scalar(const float* pad, const float* sx, const float* sy, float* out) {
+    for (size_t x = 0; x < ROW_LANES; x++) {
+        float u = fminf(fmaxf(sx[x], 0.0f), PAD_SIDE - 1.001f);
+        float v = fminf(fmaxf(sy[x], 0.0f), PAD_SIDE - 1.001f);
+        int u0 = (int)u, v0 = (int)v;
+        float fx = u - (float)u0, fy = v - (float)v0;
+        const float* p = pad + v0 * PAD_SIDE + u0;
+        float top = p[0] + fx * (p[1] - p[0]);
+        float bottom = p[PAD_SIDE] + fx * (p[PAD_SIDE + 1] - p[PAD_SIDE]);
+        out[x] = top + fy * (bottom - top);
+    }
+}
+
+#ifdef AUGMENT_X86
+// Eight output pixels per step: clamp, split into integer and fractional parts, gather the
+// four neighbours and blend
+__attribute__((target("avx2,fma")))
+static void sample_row_avx2(const float* pad, const float* sx, const float* sy, float* out) {
+    const __m256 lo = _mm256_setzero_ps();
+    const __m256 hi = _mm256_set1_ps(PAD_SIDE - 1.001f);
+    const __m256i stride = _mm256_set1_epi32(PAD_SIDE);
+    const __m256i one = _mm256_set1_epi32(1);
+    for (size_t x = 0; x < ROW_LANES; x += 8) {
+        __m256 u = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(sx + x), lo), hi);
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(sy + x), lo), hi);
+        __m256i u0 = _mm256_cvttps_epi32(u), v0 = _mm256_cvttps_epi32(v);
+        __m256 fx = _mm256_sub_ps(u, _mm256_cvtepi32_ps(u0));
+        __m256 fy = _mm256_sub_ps(v, _mm256_cvtepi32_ps(v0));
+
+        __m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(v0, stride), u0);
+        __m256i idx_b = _mm256_add_epi32(idx, stride);
+        __m256 p00 = _mm256_i32gather_ps(pad, idx, 4);
+        __m256 p01 = _mm256_i32gather_ps(pad, _mm256_add_epi32(idx, one), 4);
+        __m256 p10 = _mm256_i32gather_ps(pad, idx_b, 4);
+        __m256 p11 = _mm256_i32gather_ps(pad, _mm256_add_epi32(idx_b, one), 4);
+
+        __m256 top = _mm256_fmadd_ps(fx, _mm256_sub_ps(p01, p00), p00);
+        __m256 bottom = _mm256_fmadd_ps(fx, _mm256_sub_ps(p11, p10), p10);
+        _mm256_storeu_ps(out + x, _mm256_fmadd_ps(fy, _mm256_sub_ps(bottom, top), top));
+    }
+}
+#endif
+
+// Returns 0 if the requested kernel is usable and now selected
+int augment_select_kernel(bool simd) {
+    if (!simd) {
+        row_fn = sample_row_scalar;
+        row_name = "scalar";
+        return 0;
+    }
+#ifdef AUGMENT_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        row_fn = sample_row_avx2;
+        row_name = "avx2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char* augment_kernel_name(void) {
+    if (!row_fn && augment_select_kernel(true) != 0) augment_select_kernel(false);
+    return row_name;
+}
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Uniform in [-1, 1)
+static double uniform(uint64_t* rng) {
+    return (double)(xorshift64(rng) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+// One random warp of a 28x28 uint8 image into dst, which keeps the 0-255 scale.
+// Output pixel p samples the source at c + A^-1 (p - c - shift) + elastic(p).
+void augment_image(const uint8_t* src, double* dst, const AugmentConfig* config, uint64_t* rng) {
+    if (!row_fn) augment_kernel_name();
+
+    double dx = config->max_shift * uniform(rng);
+    double dy = config->max_shift * uniform(rng);
+    double angle = config->max_rotate * uniform(rng);
+    double scale = 1.0 + config->max_scale * uniform(rng);
+    double ca = cos(angle) / scale, sa = sin(angle) / scale;
+
+    float grid_x[AUGMENT_GRID + 1][AUGMENT_GRID + 1];
+    float grid_y[AUGMENT_GRID + 1][AUGMENT_GRID + 1];
+    for (size_t i = 0; i <= AUGMENT_GRID; i++) {
+        for (size_t j = 0; j <= AUGMENT_GRID; j++) {
+            grid_x[i][j] = (float)(config->elastic * uniform(rng));
+            grid_y[i][j] = (float)(config->elastic * uniform(rng));
+        }
+    }
+
+    float pad[PAD_SIDE * PAD_SIDE] = {0};
+    for (size_t y = 0; y < AUGMENT_SIDE; y++) {
+        for (size_t x = 0; x < AUGMENT_SIDE; x++) pad[(y + 1) * PAD_SIDE + x + 1] = (float)src[y * AUGMENT_SIDE + x];
+    }
+
+    const double c = (AUGMENT_SIDE - 1) / 2.0;
+    const double cell = (double)(AUGMENT_SIDE - 1) / AUGMENT_GRID;
+    float sx[ROW_LANES], sy[ROW_LANES], out[ROW_LANES];
+    for (size_t y = 0; y < AUGMENT_SIDE; y++) {
+        double gy = (double)y / cell;
+        size_t gi = gy >= AUGMENT_GRID ? AUGMENT_GRID - 1 : (size_t)gy;
+        float ty = (float)(gy - (double)gi);
+        for (size_t x = 0; x < ROW_LANES; x++) {
+            size_t xc = x < AUGMENT_SIDE ? x : AUGMENT_SIDE - 1;
+            double px = (double)xc - c - dx, py = (double)y - c - dy;
+            float ex = 0.0f, ey = 0.0f;
+            if (config->elastic != 0.0) {
+                double gx = (double)xc / cell;
+                size_t gj = gx >= AUGMENT_GRID ? AUGMENT_GRID - 1 : (size_t)gx;
+                float tx = (float)(gx - (double)gj);
+                ex = (1 - ty) * ((1 - tx) * grid_x[gi][gj] + tx * grid_x[gi][gj + 1]) +
+                     ty * ((1 - tx) * grid_x[gi + 1][gj] + tx * grid_x[gi + 1][gj + 1]);
+                ey = (1 - ty) * ((1 - tx) * grid_y[gi][gj] + tx * grid_y[gi][gj + 1]) +
+                     ty * ((1 - tx) * grid_y[gi + 1][gj] + tx * grid_y[gi + 1][gj + 1]);
+            }
+            // +1 for the padding ring
+            sx[x] = (float)(c + ca * px + sa * py + 1.0) + ex;
+            sy[x] = (float)(c - sa * px + ca * py + 1.0) + ey;
+        }
+        row_fn(pad, sx, sy, out);
+        for (size_t x = 0; x < AUGMENT_SIDE; x++) dst[y * AUGMENT_SIDE + x] = (double)out[x];
+    }
+}
+
+static size_t gcd(size_t a, size_t b) {
+    while (b) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Sample at stream position q: every epoch visits all n samples in its own affine order
+static size_t sample_index(AugmentPipeline* p, size_t q) {
+    size_t n = p->n, epoch = q / n, r = q % n;
+    uint64_t rng = p->config.seed * 0x9e3779b97f4a7c15ull + epoch + 1;
+    size_t a = 1, b = (size_t)(xorshift64(&rng) % n);
+    for (int tries = 0; tries < 64; tries++) {
+        size_t cand = (size_t)(xorshift64(&rng) % n);
+        if (cand > 0 && gcd(cand, n) == 1) {
+            a = cand;
+            break;
+        }
+    }
+    return (a * r + b) % n;
+}
+
+static void fill_slot(AugmentPipeline* p, AugmentSlot* slot) {
+    double* out = (double*)slot->images->data;
+    for (size_t i = 0; i < p->batch; i++) {
+        size_t q = slot->seq * p->batch + i;
+        size_t j = sample_index(p, q);
+        uint64_t rng = (p->config.seed ^ (q * 0xbf58476d1ce4e5b9ull)) | 1;
+        augment_image(p->source + j * AUGMENT_PIXELS, out + i * AUGMENT_PIXELS, &p->config, &rng);
+        slot->labels[i] = p->source_labels[j];
+    }
+}
+
+static void* worker_main(void* arg) {
+    AugmentPipeline* p = (AugmentPipeline*)arg;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        AugmentSlot* slot = NULL;
+        while (!p->stop) {
+            for (size_t s = 0; s < p->n_slots && !slot; s++) {
+                if (p->slots[s].state == AUGMENT_SLOT_FREE) slot = &p->slots[s];
+            }
+            if (slot) break;
+            pthread_cond_wait(&p->cond, &p->lock);
+        }
+        if (p->stop) break;
+
+        slot->state = AUGMENT_SLOT_FILLING;
+        slot->seq = p->next_fill++;
+        pthread_mutex_unlock(&p->lock);
+
+        fill_slot(p, slot);
+
+        pthread_mutex_lock(&p->lock);
+        slot->state = AUGMENT_SLOT_READY;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+// images and labels must outlive the pipeline, nothing is copied
+AugmentPipeline* augment_start(const uint8_t* images, const size_t* labels, size_t n, size_t batch,
+                               size_t n_workers, AugmentConfig* config) {
+    if (n == 0 || batch == 0) return NULL;
+    if (n_workers == 0) n_workers = 1;
+
+    AugmentPipeline* p = (AugmentPipeline*)calloc(1, sizeof(AugmentPipeline));
+    if (!p) return NULL;
+    p->source = images;
+    p->source_labels = labels;
+    p->n = n;
+    p->batch = batch;
+    p->config = *config;
+
+    // One slot per worker plus two, so the trainer can hold a batch while the next is ready
+    p->n_slots = n_workers + 2;
+    p->slots = (AugmentSlot*)calloc(p->n_slots, sizeof(AugmentSlot));
+    p->workers = (pthread_t*)calloc(n_workers, sizeof(pthread_t));
+    if (!p->slots || !p->workers) {
+        augment_stop(p);
+        return NULL;
+    }
+    size_t shape[] = {batch, AUGMENT_SIDE, AUGMENT_SIDE};
+    for (size_t s = 0; s < p->n_slots; s++) {
+        p->slots[s].images = mdarray_create(3, shape, sizeof(double));
+        p->slots[s].labels = (size_t*)malloc(batch * sizeof(size_t));
+        if (!p->slots[s].images || !p->slots[s].labels) {
+            augment_stop(p);
+            return NULL;
+        }
+    }
+
+    augment_kernel_name();
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    for (size_t w = 0; w < n_workers; w++) {
+        if (pthread_create(&p->workers[w], NULL, worker_main, p) != 0) break;
+        p->n_workers++;
+    }
+    if (p->n_workers == 0) {
+        // Nothing would ever fill a slot, augment_next would wait forever
+        printf("augment_start: could not start any worker thread\n");
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->cond);
+        augment_stop(p);
+        return NULL;
+    }
+    return p;
+}
+
+// Blocks until the next batch in sequence is ready. The slot belongs to the caller until
+// augment_release hands it back.
+AugmentSlot* augment_next(AugmentPipeline* p) {
+    pthread_mutex_lock(&p->lock);
+    AugmentSlot* slot = NULL;
+    while (!slot) {
+        for (size_t s = 0; s < p->n_slots; s++) {
+            if (p->slots[s].state == AUGMENT_SLOT_READY && p->slots[s].seq == p->next_take) slot = &p->slots[s];
+        }
+        if (!slot) pthread_cond_wait(&p->cond, &p->lock);
+    }
+    slot->state = AUGMENT_SLOT_IN_USE;
+    p->next_take++;
+    pthread_mutex_unlock(&p->lock);
+    return slot;
+}
+
+void augment_release(AugmentPipeline* p, AugmentSlot* slot) {
+    pthread_mutex_lock(&p->lock);
+    slot->state = AUGMENT_SLOT_FREE;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->lock);
+}
+
+void augment_stop(AugmentPipeline* p) {
+    if (!p) return;
+    if (p->n_workers > 0) {
+        pthread_mutex_lock(&p->lock);
+        p->stop = true;
+        pthread_cond_broadcast(&p->cond);
+        pthread_mutex_unlock(&p->lock);
+        for (size_t w = 0; w < p->n_workers; w++) pthread_join(p->workers[w], NULL);
+        pthread_mutex_destroy(&p->lock);
+        pthread_cond_destroy(&p->cond);
+    }
+    for (size_t s = 0; p->slots && s < p->n_slots; s++) {
+        mdarray_free(p->slots[s].images);
+        free(p->slots[s].labels);
+    }
+    free(p->slots);
+    free(p->workers);
+    free(p);
+}
@@ -0,0 +1,68 @@
+// augment.h
+#ifndef AUGMENT_H
+#define AUGMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "mdarray.h"
+
+#define AUGMENT_SIDE 28
+#define AUGMENT_PIXELS (AUGMENT_SIDE * AUGMENT_SIDE)
+#define AUGMENT_GRID 4            // Elastic displacements are drawn on a 4x4 grid and interpolated
+
+typedef struct {
+    double max_shift;             // Pixels, uniform in [-max_shift, max_shift] per axis
+    double max_rotate;            // Radians
+    double max_scale;             // Relative, 0.1 scales by [0.9, 1.1]
+    double elastic;               // Peak elastic displacement in pixels, 0 turns it off
+    uint64_t seed;
+} AugmentConfig;
+
+typedef enum {
+    AUGMENT_SLOT_FREE,
+    AUGMENT_SLOT_FILLING,
+    AUGMENT_SLOT_READY,
+    AUGMENT_SLOT_IN_USE
+} AugmentSlotState;
+
+// A reusable batch buffer, handed back and forth between workers and the trainer
+typedef struct {
+    MDArray* images;              // (batch, 28, 28) float64, same scale as the source pixels
+    size_t* labels;
+    size_t seq;                   // Which batch of the stream this slot holds
+    AugmentSlotState state;
+} AugmentSlot;
+
+// Workers produce batch 0, 1, 2, ... into a fixed ring of slots; the trainer consumes them
+// in order. Batch k draws its samples and warps from seed and k only, so the stream is the
+// same whatever the number of workers.
+typedef struct {
+    const uint8_t* source;        // (n, 28, 28)
+    const size_t* source_labels;
+    size_t n;
+    size_t batch;
+    AugmentConfig config;
+
+    AugmentSlot* slots;
+    size_t n_slots;
+    pthread_t* workers;
+    size_t n_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next_fill;             // Next batch number a worker will claim
+    size_t next_take;             // Next batch number the trainer will receive
+    bool stop;
+} AugmentPipeline;
+
+AugmentPipeline* augment_start(const uint8_t* images, const size_t* labels, size_t n, size_t batch,
+                               size_t n_workers, AugmentConfig* config);
+AugmentSlot* augment_next(AugmentPipeline* p);
+void augment_release(AugmentPipeline* p, AugmentSlot* slot);
+void augment_stop(AugmentPipeline* p);
+void augment_image(const uint8_t* src, double* dst, const AugmentConfig* config, uint64_t* rng);
+int augment_select_kernel(bool simd);
+const char* augment_kernel_name(void);
+
+#endif // AUGMENT_H
@@ -0,0 +1,437 @@
+#include "autograd.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AG_ALIGN 64
+
+// A workspace buffer waiting for an offset, either a node value or a node gradient
+typedef struct {
+    size_t size;
+    size_t start;
+    size_t end;
+    size_t* offset;
+} AGBuffer;
+
+AGTape* ag_tape_new(void) {
+    AGTape* t = (AGTape*)calloc(1, sizeof(AGTape));
+    return t;
+}
+
+void ag_tape_free(AGTape* t) {
+    if (t) {
+        for (size_t i = 0; i < t->n_nodes; i++) {
+            AGNode* node = &t->nodes[i];
+            if (node->op != AG_INPUT && node->op != AG_PARAM) mdarray_free(node->value);
+            mdarray_free(node->grad);
+        }
+        free(t->nodes);
+        free(t->grad_ready);
+        free(t->workspace);
+        free(t);
+    }
+}
+
+static int add_node(AGTape* t, AGOp op, int a, int b, size_t rows, size_t cols) {
+    if (t->planned) {
+        printf("Cannot record on a tape that is already planned\n");
+        return -1;
+    }
+    if (t->n_nodes == t->capacity) {
+        size_t cap = t->capacity ? t->capacity * 2 : 16;
+        AGNode* nodes = (AGNode*)realloc(t->nodes, cap * sizeof(AGNode));
+        if (!nodes) return -1;
+        t->nodes = nodes;
+        t->capacity = cap;
+    }
+
+    AGNode* node = &t->nodes[t->n_nodes];
+    memset(node, 0, sizeof(AGNode));
+    node->op = op;
+    node->a = a;
+    node->b = b;
+    node->shape[0] = rows;
+    node->shape[1] = cols;
+    node->requires_grad = op == AG_PARAM ||
+                          (a >= 0 && t->nodes[a].requires_grad) ||
+                          (b >= 0 && t->nodes[b].requires_grad);
+    return (int)t->n_nodes++;
+}
+
+static int valid(AGTape* t, int id) {
+    if (!t || id < 0 || (size_t)id >= t->n_nodes) {
+        printf("Invalid autograd node %d\n", id);
+        return 0;
+    }
+    return 1;
+}
+
+static int add_external(AGTape* t, AGOp op, MDArray* arr) {
+    if (!arr || arr->ndim != 2 || arr->itemsize != sizeof(double)) {
+        printf("Autograd inputs and parameters must be 2-D double arrays\n");
+        return -1;
+    }
+    int id = add_node(t, op, -1, -1, arr->shape[0], arr->shape[1]);
+    if (id >= 0) t->nodes[id].value = arr;
+    return id;
+}
+
+int ag_input(AGTape* t, MDArray* x) { return add_external(t, AG_INPUT, x); }
+int ag_param(AGTape* t, MDArray* w) { return add_external(t, AG_PARAM, w); }
+
+int ag_matmul(AGTape* t, int a, int b) {
+    if (!valid(t, a) || !valid(t, b)) return -1;
+    if (t->nodes[a].shape[1] != t->nodes[b].shape[0]) {
+        printf("ag_matmul: a.shape[1](%zu) different than b.shape[0](%zu)\n",
+               t->nodes[a].shape[1], t->nodes[b].shape[0]);
+        return -1;
+    }
+    return add_node(t, AG_MATMUL, a, b, t->nodes[a].shape[0], t->nodes[b].shape[1]);
+}
+
+int ag_add_bias(AGTape* t, int a, int bias) {
+    if (!valid(t, a) || !valid(t, bias)) return -1;
+    if (t->nodes[bias].shape[0] != t->nodes[a].shape[0] || t->nodes[bias].shape[1] != 1) {
+        printf("ag_add_bias: bias must be (%zu, 1)\n", t->nodes[a].shape[0]);
+        return -1;
+    }
+    return add_node(t, AG_ADD_BIAS, a, bias, t->nodes[a].shape[0], t->nodes[a].shape[1]);
+}
+
+int ag_relu(AGTape* t, int a) {
+    if (!valid(t, a)) return -1;
+    return add_node(t, AG_RELU, a, -1, t->nodes[a].shape[0], t->nodes[a].shape[1]);
+}
+
+int ag_svm_loss(AGTape* t, int scores, const size_t* labels) {
+    if (!valid(t, scores)) return -1;
+    int id = add_node(t, AG_SVM_LOSS, scores, -1, 1, 1);
+    if (id >= 0) t->nodes[id].labels = labels;
+    return id;
+}
+
+MDArray* ag_value(AGTape* t, int id) { return valid(t, id) ? t->nodes[id].value : NULL; }
+MDArray* ag_grad(AGTape* t, int id) { return valid(t, id) ? t->nodes[id].grad : NULL; }
+
+static int is_computed(AGNode* node) {
+    return node->op != AG_INPUT && node->op != AG_PARAM;
+}
+
+static size_t max_size(size_t a, size_t b) { return a > b ? a : b; }
+static size_t min_size(size_t a, size_t b) { return a < b ? a : b; }
+
+static int cmp_buffer_size(const void* x, const void* y) {
+    const AGBuffer* a = (const AGBuffer*)x;
+    const AGBuffer* b = (const AGBuffer*)y;
+    return (a->size < b->size) - (a->size > b->size);
+}
+
+static int cmp_buffer_offset(const void* x, const void* y) {
+    const AGBuffer* a = (const AGBuffer*)x;
+    const AGBuffer* b = (const AGBuffer*)y;
+    return (*a->offset > *b->offset) - (*a->offset < *b->offset);
+}
+
+// Greedy best-fit: biggest buffers first, each at the lowest offset that does not
+// collide with an already placed buffer whose lifetime overlaps
+static size_t assign_offsets(AGBuffer* bufs, size_t n) {
+    qsort(bufs, n, sizeof(AGBuffer), cmp_buffer_size);
+
+    AGBuffer* live = (AGBuffer*)malloc((n ? n : 1) * sizeof(AGBuffer));
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t n_live = 0;
+        for (size_t j = 0; j < i; j++) {
+            if (bufs[j].start <= bufs[i].end && bufs[i].start <= bufs[j].end) live[n_live++] = bufs[j];
+        }
+        qsort(live, n_live, sizeof(AGBuffer), cmp_buffer_offset);
+
+        size_t offset = 0;
+        for (size_t j = 0; j < n_live; j++) {
+            if (offset + bufs[i].size <= *live[j].offset) break;
+            offset = max_size(offset, *live[j].offset + live[j].size);
+        }
+        *bufs[i].offset = offset;
+        total = max_size(total, offset + bufs[i].size);
+    }
+    free(live);
+    return total;
+}
+
+// Drops everything a failed ag_plan allocated, so the tape is back to unplanned
+static void plan_reset(AGTape* t) {
+    for (size_t i = 0; i < t->n_nodes; i++) {
+        AGNode* node = &t->nodes[i];
+        if (is_computed(node)) {
+            mdarray_free(node->value);
+            node->value = NULL;
+        }
+        mdarray_free(node->grad);
+        node->grad = NULL;
+    }
+    free(t->grad_ready);
+    free(t->workspace);
+    t->grad_ready = NULL;
+    t->workspace = NULL;
+    t->workspace_size = 0;
+    t->naive_size = 0;
+}
+
+// Liveness analysis over the replay order (forward steps 0..n-1, backward steps n..2n-1,
+// parameter update at 2n), then packs every value and gradient into one workspace
+int ag_plan(AGTape* t) {
+    if (!t || t->n_nodes == 0 || t->planned) return -1;
+
+    size_t n = t->n_nodes;
+    size_t end = 2 * n;
+#define BWD(i) (2 * n - 1 - (size_t)(i))
+
+    for (size_t i = 0; i < n; i++) {
+        AGNode* node = &t->nodes[i];
+        node->value_start = node->value_end = i;
+        node->grad_start = end;
+        node->grad_end = node->op == AG_PARAM ? end : BWD(i);
+    }
+    t->nodes[n - 1].value_end = end;
+    t->nodes[n - 1].grad_start = BWD(n - 1);
+
+    for (size_t j = 0; j < n; j++) {
+        AGNode* node = &t->nodes[j];
+        int inputs[] = {node->a, node->b};
+        for (size_t k = 0; k < 2; k++) {
+            if (inputs[k] < 0) continue;
+            AGNode* in = &t->nodes[inputs[k]];
+            in->value_end = max_size(in->value_end, j);
+            if (node->requires_grad && in->requires_grad) in->grad_start = min_size(in->grad_start, BWD(j));
+        }
+
+        // Values the backward step of j reads
+        if (!node->requires_grad) continue;
+        if (node->op == AG_MATMUL) {
+            AGNode* a = &t->nodes[node->a];
+            AGNode* b = &t->nodes[node->b];
+            if (b->requires_grad) a->value_end = max_size(a->value_end, BWD(j));
+            if (a->requires_grad) b->value_end = max_size(b->value_end, BWD(j));
+        } else if (node->op == AG_RELU) {
+            node->value_end = max_size(node->value_end, BWD(j));
+        } else if (node->op == AG_SVM_LOSS) {
+            AGNode* a = &t->nodes[node->a];
+            a->value_end = max_size(a->value_end, BWD(j));
+        }
+    }
+#undef BWD
+
+    AGBuffer* bufs = (AGBuffer*)malloc(2 * n * sizeof(AGBuffer));
+    t->grad_ready = (bool*)calloc(n, sizeof(bool));
+    if (!bufs || !t->grad_ready) {
+        free(bufs);
+        plan_reset(t);
+        return -1;
+    }
+
+    size_t n_bufs = 0;
+    t->naive_size = 0;
+    for (size_t i = 0; i < n; i++) {
+        AGNode* node = &t->nodes[i];
+        size_t bytes = node->shape[0] * node->shape[1] * sizeof(double);
+        bytes = (bytes + AG_ALIGN - 1) / AG_ALIGN * AG_ALIGN;
+
+        if (is_computed(node)) {
+            AGBuffer v = {bytes, node->value_start, node->value_end, &node->value_offset};
+            bufs[n_bufs++] = v;
+            t->naive_size += bytes;
+        }
+        if (node->requires_grad && node->grad_start <= node->grad_end) {
+            AGBuffer g = {bytes, node->grad_start, node->grad_end, &node->grad_offset};
+            bufs[n_bufs++] = g;
+            t->naive_size += bytes;
+        }
+    }
+
+    t->workspace_size = assign_offsets(bufs, n_bufs);
+    free(bufs);
+
+    t->workspace = (double*)aligned_alloc(AG_ALIGN, t->workspace_size ? t->workspace_size : AG_ALIGN);
+    if (!t->workspace) {
+        plan_reset(t);
+        return -1;
+    }
+
+    char* base = (char*)t->workspace;
+    for (size_t i = 0; i < n; i++) {
+        AGNode* node = &t->nodes[i];
+        if (is_computed(node)) {
+            node->value = mdarray_from_data(2, node->shape, sizeof(double), base + node->value_offset);
+            if (!node->value) {
+                plan_reset(t);
+                return -1;
+            }
+        }
+        if (node->requires_grad && node->grad_start <= node->grad_end) {
+            node->grad = mdarray_from_data(2, node->shape, sizeof(double), base + node->grad_offset);
+            if (!node->grad) {
+                plan_reset(t);
+                return -1;
+            }
+        }
+    }
+
+    t->planned = true;
+    return 0;
+}
+
+static double svm_forward(const double* s, const size_t* labels, size_t classes, size_t batch) {
+    double total = 0.0;
+    for (size_t i = 0; i < batch; i++) {
+        double s_yi = s[labels[i] * batch + i];
+        for (size_t j = 0; j < classes; j++) {
+            if (j == labels[i]) continue;
+            double margin = s[j * batch + i] - s_yi + 1.0;
+            if (margin > 0.0) total += margin;
+        }
+    }
+    return total / batch;
+}
+
+double ag_forward(AGTape* t) {
+    if (!t || !t->planned) return 0.0;
+
+    for (size_t i = 0; i < t->n_nodes; i++) {
+        AGNode* node = &t->nodes[i];
+        if (!is_computed(node)) continue;
+
+        MDArray* a = node->a >= 0 ? t->nodes[node->a].value : NULL;
+        MDArray* b = node->b >= 0 ? t->nodes[node->b].value : NULL;
+        double* out = (double*)node->value->data;
+
+        switch (node->op) {
+        case AG_MATMUL:
+            mdarray_dot_into(a, false, b, false, node->value, 0.0);
+            break;
+        case AG_ADD_BIAS: {
+            // Straight into the planned buffer, nothing to allocate per step
+            const double* x = (const double*)a->data;
+            const double* bias = (const double*)b->data;
+            size_t rows = node->shape[0], cols = node->shape[1];
+            for (size_t r = 0; r < rows; r++) {
+                for (size_t c = 0; c < cols; c++) out[r * cols + c] = x[r * cols + c] + bias[r];
+            }
+            break;
+        }
+        case AG_RELU: {
+            const double* x = (const double*)a->data;
+            for (size_t k = 0; k < node->value->total_size; k++) out[k] = x[k] > 0.0 ? x[k] : 0.0;
+            break;
+        }
+        case AG_SVM_LOSS:
+            out[0] = svm_forward((const double*)a->data, node->labels, a->shape[0], a->shape[1]);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return ((double*)t->nodes[t->n_nodes - 1].value->data)[0];
+}
+
+// Gradient buffer of node id, *accumulate is false the first time it is written per pass
+static double* grad_dst(AGTape* t, int id, bool* accumulate) {
+    *accumulate = t->grad_ready[id];
+    t->grad_ready[id] = true;
+    return (double*)t->nodes[id].grad->data;
+}
+
+void ag_backward(AGTape* t) {
+    if (!t || !t->planned) return;
+
+    size_t n = t->n_nodes;
+    memset(t->grad_ready, 0, n * sizeof(bool));
+    AGNode* root = &t->nodes[n - 1];
+    if (!root->grad) return;
+    mdarray_ones(root->grad);
+    t->grad_ready[n - 1] = true;
+
+    for (size_t j = n; j-- > 0;) {
+        AGNode* node = &t->nodes[j];
+        if (!node->requires_grad || !is_computed(node) || !t->grad_ready[j]) continue;
+
+        const double* g = (const double*)node->grad->data;
+        AGNode* a = node->a >= 0 ? &t->nodes[node->a] : NULL;
+        AGNode* b = node->b >= 0 ? &t->nodes[node->b] : NULL;
+        bool acc;
+
+        switch (node->op) {
+        case AG_MATMUL:
+            // dA = dC * B^T, dB = A^T * dC
+            if (a->requires_grad) {
+                grad_dst(t, node->a, &acc);
+                mdarray_dot_into(node->grad, false, b->value, true, a->grad, acc ? 1.0 : 0.0);
+            }
+            if (b->requires_grad) {
+                grad_dst(t, node->b, &acc);
+                mdarray_dot_into(a->value, true, node->grad, false, b->grad, acc ? 1.0 : 0.0);
+            }
+            break;
+        case AG_ADD_BIAS: {
+            size_t rows = node->shape[0], cols = node->shape[1];
+            if (a->requires_grad) {
+                double* ga = grad_dst(t, node->a, &acc);
+                for (size_t k = 0; k < rows * cols; k++) ga[k] = (acc ? ga[k] : 0.0) + g[k];
+            }
+            if (b->requires_grad) {
+                double* gb = grad_dst(t, node->b, &acc);
+                for (size_t r = 0; r < rows; r++) {
+                    double sum = 0.0;
+                    for (size_t c = 0; c < cols; c++) sum += g[r * cols + c];
+                    gb[r] = (acc ? gb[r] : 0.0) + sum;
+                }
+            }
+            break;
+        }
+        case AG_RELU: {
+            const double* y = (const double*)node->value->data;
+            double* ga = grad_dst(t, node->a, &acc);
+            for (size_t k = 0; k < node->value->total_size; k++) {
+                ga[k] = (acc ? ga[k] : 0.0) + (y[k] > 0.0 ? g[k] : 0.0);
+            }
+            break;
+        }
+        case AG_SVM_LOSS: {
+            const double* s = (const double*)a->value->data;
+            size_t classes = a->shape[0], batch = a->shape[1];
+            double scale = g[0] / batch;
+            double* ga = grad_dst(t, node->a, &acc);
+            if (!acc) memset(ga, 0, classes * batch * sizeof(double));
+            for (size_t i = 0; i < batch; i++) {
+                size_t yi = node->labels[i];
+                double s_yi = s[yi * batch + i];
+                size_t count = 0;
+                for (size_t c = 0; c < classes; c++) {
+                    if (c == yi) continue;
+                    if (s[c * batch + i] - s_yi + 1.0 > 0.0) {
+                        ga[c * batch + i] += scale;
+                        count++;
+                    }
+                }
+                ga[yi * batch + i] -= scale * (double)count;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+}
+
+void ag_sgd_step(AGTape* t, double lr) {
+    if (!t || !t->planned) return;
+
+    for (size_t i = 0; i < t->n_nodes; i++) {
+        AGNode* node = &t->nodes[i];
+        if (node->op != AG_PARAM || !node->grad || !t->grad_ready[i]) continue;
+
+        double* w = (double*)node->value->data;
+        const double* g = (const double*)node->grad->data;
+        for (size_t k = 0; k < node->value->total_size; k++) w[k] -= lr * g[k];
+    }
+}
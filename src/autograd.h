@@ -0,0 +1,63 @@
+// autograd.h
+#ifndef AUTOGRAD_H
+#define AUTOGRAD_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "mdarray.h"
+
+typedef enum {
+    AG_INPUT,                     // External array, no gradient
+    AG_PARAM,                     // External array, gradient kept until ag_sgd_step
+    AG_MATMUL,                    // a(m, k) * b(k, n)
+    AG_ADD_BIAS,                  // a(m, n) + b(m, 1) broadcast over columns
+    AG_RELU,
+    AG_SVM_LOSS                   // Multiclass hinge loss of (classes, N) scores, scalar
+} AGOp;
+
+typedef struct {
+    AGOp op;
+    int a;                        // Input node ids, -1 if unused
+    int b;
+    size_t shape[2];
+    bool requires_grad;
+    const size_t* labels;         // AG_SVM_LOSS only
+
+    MDArray* value;               // External for INPUT/PARAM, otherwise a workspace view
+    MDArray* grad;                // Workspace view, NULL when no gradient flows here
+
+    // Filled in by ag_plan: lifetime in tape steps and byte offset in the workspace
+    size_t value_start, value_end, value_offset;
+    size_t grad_start, grad_end, grad_offset;
+} AGNode;
+
+// Records a static graph once, then replays forward/backward inside one planned buffer.
+// Buffers are reused across steps, so gradients are only valid until the next ag_forward.
+typedef struct {
+    AGNode* nodes;
+    size_t n_nodes;
+    size_t capacity;
+    bool* grad_ready;             // Per backward pass: first write assigns, later ones add
+
+    double* workspace;
+    size_t workspace_size;        // Bytes after liveness-based sharing
+    size_t naive_size;            // Bytes if every buffer had its own allocation
+    bool planned;
+} AGTape;
+
+AGTape* ag_tape_new(void);
+void ag_tape_free(AGTape* t);
+int ag_input(AGTape* t, MDArray* x);
+int ag_param(AGTape* t, MDArray* w);
+int ag_matmul(AGTape* t, int a, int b);
+int ag_add_bias(AGTape* t, int a, int bias);
+int ag_relu(AGTape* t, int a);
+int ag_svm_loss(AGTape* t, int scores, const size_t* labels);
+int ag_plan(AGTape* t);
+double ag_forward(AGTape* t);
+void ag_backward(AGTape* t);
+void ag_sgd_step(AGTape* t, double lr);
+MDArray* ag_value(AGTape* t, int id);
+MDArray* ag_grad(AGTape* t, int id);
+
+#endif // AUTOGRAD_H
@@ -0,0 +1,441 @@
+#include "conv.h"
+#include "gemm.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ConvAlgo algo = CONV_ALGO_AUTO;
+static const char* algo_names[] = {"auto", "im2col", "direct"};
+
+typedef struct {
+    size_t n, c, h, w;
+    size_t f, kh, kw;
+    size_t oh, ow;
+    size_t patch;                 // c * kh * kw, rows of the unfolded image
+    size_t pixels;                // oh * ow, columns of the unfolded image
+} ConvDims;
+
+typedef struct {
+    ConvDims d;
+    ConvConfig* config;
+    bool direct;
+    const double* x;
+    const double* w;
+    const double* bias;
+    double* out;
+    const double* dout;
+    double* dx;
+    double* dw_part;              // Per-thread (F, patch) sums, reduced in tid order
+    double* db_part;              // Per-thread (F) sums
+    double* scratch;              // Per-thread im2col and gradient buffers, allocated up front
+    size_t scratch_size;          // Doubles per thread in scratch
+} ConvJob;
+
+void conv_set_algo(ConvAlgo a) {
+    algo = a;
+}
+
+const char* conv_algo_name(ConvAlgo a) {
+    return a <= CONV_ALGO_DIRECT ? algo_names[a] : "unknown";
+}
+
+static int conv_dims(MDArray* x, MDArray* w, MDArray* bias, ConvConfig* config, ConvDims* d) {
+    if ((x->ndim != 3 && x->ndim != 4) || w->ndim != 4 || config->stride == 0) {
+        printf("conv2d: expected (N, C, H, W) images and (F, C, KH, KW) filters\n");
+        return -1;
+    }
+    d->n = x->shape[0];
+    d->c = x->ndim == 4 ? x->shape[1] : 1;
+    d->h = x->shape[x->ndim - 2];
+    d->w = x->shape[x->ndim - 1];
+    d->f = w->shape[0];
+    d->kh = w->shape[2];
+    d->kw = w->shape[3];
+    if (w->shape[1] != d->c || (bias && bias->total_size != d->f) ||
+        d->h + 2 * config->pad < d->kh || d->w + 2 * config->pad < d->kw) {
+        printf("conv2d: images, filters and bias do not line up\n");
+        return -1;
+    }
+    d->oh = (d->h + 2 * config->pad - d->kh) / config->stride + 1;
+    d->ow = (d->w + 2 * config->pad - d->kw) / config->stride + 1;
+    d->patch = d->c * d->kh * d->kw;
+    d->pixels = d->oh * d->ow;
+    return 0;
+}
+
+static bool use_direct(ConvDims* d, ConvConfig* config) {
+    bool fits = d->kh == CONV_DIRECT_K && d->kw == CONV_DIRECT_K && config->stride == 1;
+    return fits && algo != CONV_ALGO_IM2COL;
+}
+
+// Valid output columns [lo, hi) for filter column kx with stride 1
+static void direct_span(ConvDims* d, size_t pad, size_t kx, size_t* lo, size_t* hi) {
+    *lo = pad > kx ? pad - kx : 0;
+    *hi = d->w + pad - kx < d->ow ? d->w + pad - kx : d->ow;
+    if (*hi < *lo) *hi = *lo;
+}
+
+// col (patch, pixels): row (c, ky, kx) holds that filter tap's input for every output pixel
+static void im2col(ConvDims* d, size_t stride, size_t pad, const double* x, double* col) {
+    for (size_t c = 0; c < d->c; c++) {
+        for (size_t ky = 0; ky < d->kh; ky++) {
+            for (size_t kx = 0; kx < d->kw; kx++) {
+                double* row = col + ((c * d->kh + ky) * d->kw + kx) * d->pixels;
+                for (size_t oy = 0; oy < d->oh; oy++) {
+                    size_t iy = oy * stride + ky;
+                    for (size_t ox = 0; ox < d->ow; ox++) {
+                        size_t ix = ox * stride + kx;
+                        bool inside = iy >= pad && iy - pad < d->h && ix >= pad && ix - pad < d->w;
+                        row[oy * d->ow + ox] = inside ? x[(c * d->h + iy - pad) * d->w + ix - pad] : 0.0;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Adjoint of im2col, dx must be zeroed
+static void col2im(ConvDims* d, size_t stride, size_t pad, const double* col, double* dx) {
+    for (size_t c = 0; c < d->c; c++) {
+        for (size_t ky = 0; ky < d->kh; ky++) {
+            for (size_t kx = 0; kx < d->kw; kx++) {
+                const double* row = col + ((c * d->kh + ky) * d->kw + kx) * d->pixels;
+                for (size_t oy = 0; oy < d->oh; oy++) {
+                    size_t iy = oy * stride + ky;
+                    if (iy < pad || iy - pad >= d->h) continue;
+                    for (size_t ox = 0; ox < d->ow; ox++) {
+                        size_t ix = ox * stride + kx;
+                        if (ix >= pad && ix - pad < d->w) dx[(c * d->h + iy - pad) * d->w + ix - pad] += row[oy * d->ow + ox];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The batch is already split across threads, so each image's GEMM stays on its thread
+static void gemm_serial(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                        const double* a, const double* b, double beta, double* c) {
+    GemmParams params;
+    gemm_params_for(trans_a, trans_b, m, n, k, &params);
+    params.n_threads = 1;
+    gemm_dgemm_blocked_params(&params, trans_a, trans_b, m, n, k, 1.0, a, b, beta, c);
+}
+
+// One image, filters slid directly over the input: every (f, c, ky, kx) tap is a scaled
+// row-shifted add of the input plane into the output plane, which stays in L1
+static void forward_direct(ConvDims* d, size_t pad, const double* x, const double* w, double* out) {
+    for (size_t f = 0; f < d->f; f++) {
+        double* plane = out + f * d->pixels;
+        for (size_t c = 0; c < d->c; c++) {
+            const double* in = x + c * d->h * d->w;
+            for (size_t ky = 0; ky < CONV_DIRECT_K; ky++) {
+                for (size_t kx = 0; kx < CONV_DIRECT_K; kx++) {
+                    double wv = w[((f * d->c + c) * CONV_DIRECT_K + ky) * CONV_DIRECT_K + kx];
+                    size_t lo, hi;
+                    direct_span(d, pad, kx, &lo, &hi);
+                    for (size_t oy = 0; oy < d->oh; oy++) {
+                        if (oy + ky < pad || oy + ky - pad >= d->h) continue;
+                        // Input column of output column lo, never left of the image
+                        const double* irow = in + (oy + ky - pad) * d->w + lo + kx - pad;
+                        double* orow = plane + oy * d->ow + lo;
+                        for (size_t ox = 0; ox < hi - lo; ox++) orow[ox] += wv * irow[ox];
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void backward_direct(ConvDims* d, size_t pad, const double* x, const double* w, const double* g,
+                            double* dw, double* dx) {
+    for (size_t f = 0; f < d->f; f++) {
+        const double* plane = g + f * d->pixels;
+        for (size_t c = 0; c < d->c; c++) {
+            const double* in = x + c * d->h * d->w;
+            double* din = dx ? dx + c * d->h * d->w : NULL;
+            for (size_t ky = 0; ky < CONV_DIRECT_K; ky++) {
+                for (size_t kx = 0; kx < CONV_DIRECT_K; kx++) {
+                    size_t t = ((f * d->c + c) * CONV_DIRECT_K + ky) * CONV_DIRECT_K + kx;
+                    double wv = w[t], sum = 0.0;
+                    size_t lo, hi;
+                    direct_span(d, pad, kx, &lo, &hi);
+                    for (size_t oy = 0; oy < d->oh; oy++) {
+                        if (oy + ky < pad || oy + ky - pad >= d->h) continue;
+                        size_t offset = (oy + ky - pad) * d->w + lo + kx - pad;
+                        const double* grow = plane + oy * d->ow + lo;
+                        const double* irow = in + offset;
+                        for (size_t ox = 0; ox < hi - lo; ox++) sum += grow[ox] * irow[ox];
+                        if (din) {
+                            double* drow = din + offset;
+                            for (size_t ox = 0; ox < hi - lo; ox++) drow[ox] += wv * grow[ox];
+                        }
+                    }
+                    dw[t] += sum;
+                }
+            }
+        }
+    }
+}
+
+static void forward_worker(size_t tid, size_t n_threads, void* arg) {
+    ConvJob* job = (ConvJob*)arg;
+    ConvDims* d = &job->d;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, d->n, &lo, &hi);
+    if (hi <= lo) return;
+    double* col = job->direct ? NULL : job->scratch + tid * job->scratch_size;
+
+    size_t in_size = d->c * d->h * d->w, out_size = d->f * d->pixels;
+    for (size_t i = lo; i < hi; i++) {
+        const double* x = job->x + i * in_size;
+        double* out = job->out + i * out_size;
+        if (job->direct) {
+            memset(out, 0, out_size * sizeof(double));
+            forward_direct(d, job->config->pad, x, job->w, out);
+        } else {
+            im2col(d, job->config->stride, job->config->pad, x, col);
+            gemm_serial(false, false, d->f, d->pixels, d->patch, job->w, col, 0.0, out);
+        }
+        // Bias and ReLU while the image's output is still in cache
+        for (size_t f = 0; f < d->f; f++) {
+            double b = job->bias ? job->bias[f] : 0.0;
+            double* plane = out + f * d->pixels;
+            if (job->config->relu) {
+                for (size_t p = 0; p < d->pixels; p++) plane[p] = plane[p] + b > 0.0 ? plane[p] + b : 0.0;
+            } else {
+                for (size_t p = 0; p < d->pixels; p++) plane[p] += b;
+            }
+        }
+    }
+}
+
+MDArray* conv2d_forward(MDArray* x, MDArray* w, MDArray* bias, ConvConfig* config) {
+    ConvJob job = {0};
+    if (conv_dims(x, w, bias, config, &job.d) != 0) return NULL;
+
+    size_t shape[] = {job.d.n, job.d.f, job.d.oh, job.d.ow};
+    MDArray* out = mdarray_create(4, shape, sizeof(double));
+    if (!out) return NULL;
+
+    job.config = config;
+    job.direct = use_direct(&job.d, config);
+    job.x = (const double*)x->data;
+    job.w = (const double*)w->data;
+    job.bias = bias ? (const double*)bias->data : NULL;
+    job.out = (double*)out->data;
+
+    size_t n_threads = parallel_threads() < job.d.n ? parallel_threads() : job.d.n;
+    if (n_threads == 0) n_threads = 1;
+    if (!job.direct) {
+        job.scratch_size = job.d.patch * job.d.pixels;
+        job.scratch = (double*)malloc(n_threads * job.scratch_size * sizeof(double));
+        if (!job.scratch) {
+            printf("conv2d_forward: out of memory for %zu im2col buffers\n", n_threads);
+            mdarray_free(out);
+            return NULL;
+        }
+    }
+    parallel_run(n_threads, forward_worker, &job);
+    free(job.scratch);
+    return out;
+}
+
+static void backward_worker(size_t tid, size_t n_threads, void* arg) {
+    ConvJob* job = (ConvJob*)arg;
+    ConvDims* d = &job->d;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, d->n, &lo, &hi);
+    if (hi <= lo) return;
+
+    size_t in_size = d->c * d->h * d->w, out_size = d->f * d->pixels;
+    double* g = job->scratch + tid * job->scratch_size;
+    double* col = job->direct ? NULL : g + out_size;
+    double* dcol = col ? col + d->patch * d->pixels : NULL;
+    double* dw = job->dw_part + tid * d->f * d->patch;
+    double* db = job->db_part + tid * d->f;
+
+    for (size_t i = lo; i < hi; i++) {
+        const double* x = job->x + i * in_size;
+        const double* dout = job->dout + i * out_size;
+        double* dx = job->dx ? job->dx + i * in_size : NULL;
+
+        // Gradient at the pre-activation, and the bias gradient from the same pass
+        for (size_t f = 0; f < d->f; f++) {
+            double sum = 0.0;
+            for (size_t p = 0; p < d->pixels; p++) {
+                size_t t = f * d->pixels + p;
+                g[t] = job->config->relu && job->out[i * out_size + t] <= 0.0 ? 0.0 : dout[t];
+                sum += g[t];
+            }
+            db[f] += sum;
+        }
+
+        if (dx) memset(dx, 0, in_size * sizeof(double));
+        if (job->direct) {
+            backward_direct(d, job->config->pad, x, job->w, g, dw, dx);
+        } else {
+            im2col(d, job->config->stride, job->config->pad, x, col);
+            gemm_serial(false, true, d->f, d->patch, d->pixels, g, col, 1.0, dw);
+            if (dx) {
+                gemm_serial(true, false, d->patch, d->pixels, d->f, job->w, g, 0.0, dcol);
+                col2im(d, job->config->stride, job->config->pad, dcol, dx);
+            }
+        }
+    }
+}
+
+// out is the forward output, needed for the ReLU mask. dw and dbias are overwritten with
+// the batch sums; dx is optional and skipped for the first layer.
+int conv2d_backward(MDArray* x, MDArray* w, MDArray* out, MDArray* dout, ConvConfig* config,
+                    MDArray* dx, MDArray* dw, MDArray* dbias) {
+    ConvJob job = {0};
+    if (conv_dims(x, w, dbias, config, &job.d) != 0) return -1;
+    ConvDims* d = &job.d;
+    size_t out_total = d->n * d->f * d->pixels;
+    if (dout->total_size != out_total || out->total_size != out_total || dw->total_size != w->total_size ||
+        (dx && dx->total_size != x->total_size)) {
+        printf("conv2d_backward: gradients do not match the forward shapes\n");
+        return -1;
+    }
+
+    size_t n_threads = parallel_threads() < d->n ? parallel_threads() : d->n;
+    if (n_threads == 0) n_threads = 1;
+    job.dw_part = (double*)calloc(n_threads * d->f * d->patch, sizeof(double));
+    job.db_part = (double*)calloc(n_threads * d->f, sizeof(double));
+    job.direct = use_direct(d, config);
+    // Pre-activation gradient, then the unfolded image and its gradient for im2col
+    job.scratch_size = d->f * d->pixels + (job.direct ? 0 : 2 * d->patch * d->pixels);
+    job.scratch = (double*)malloc(n_threads * job.scratch_size * sizeof(double));
+    if (!job.dw_part || !job.db_part || !job.scratch) {
+        printf("conv2d_backward: out of memory for %zu per-thread buffers\n", n_threads);
+        free(job.dw_part);
+        free(job.db_part);
+        free(job.scratch);
+        return -1;
+    }
+
+    job.config = config;
+    job.x = (const double*)x->data;
+    job.w = (const double*)w->data;
+    job.out = (double*)out->data;
+    job.dout = (const double*)dout->data;
+    job.dx = dx ? (double*)dx->data : NULL;
+    parallel_run(n_threads, backward_worker, &job);
+
+    double* dwv = (double*)dw->data;
+    double* dbv = dbias ? (double*)dbias->data : NULL;
+    memset(dwv, 0, d->f * d->patch * sizeof(double));
+    if (dbv) memset(dbv, 0, d->f * sizeof(double));
+    for (size_t t = 0; t < n_threads; t++) {
+        for (size_t i = 0; i < d->f * d->patch; i++) dwv[i] += job.dw_part[t * d->f * d->patch + i];
+        for (size_t f = 0; dbv && f < d->f; f++) dbv[f] += job.db_part[t * d->f + f];
+    }
+
+    free(job.dw_part);
+    free(job.db_part);
+    free(job.scratch);
+    return 0;
+}
+
+typedef struct {
+    const double* x;
+    double* out;
+    size_t* argmax;
+    double* dx;
+    const double* dout;
+    size_t planes;
+    size_t h, w, oh, ow;
+    size_t size, stride;
+} PoolJob;
+
+static void pool_forward_worker(size_t tid, size_t n_threads, void* arg) {
+    PoolJob* job = (PoolJob*)arg;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->planes, &lo, &hi);
+
+    for (size_t pl = lo; pl < hi; pl++) {
+        const double* in = job->x + pl * job->h * job->w;
+        for (size_t oy = 0; oy < job->oh; oy++) {
+            for (size_t ox = 0; ox < job->ow; ox++) {
+                size_t best = oy * job->stride * job->w + ox * job->stride;
+                for (size_t ky = 0; ky < job->size; ky++) {
+                    for (size_t kx = 0; kx < job->size; kx++) {
+                        size_t at = (oy * job->stride + ky) * job->w + ox * job->stride + kx;
+                        if (in[at] > in[best]) best = at;
+                    }
+                }
+                size_t o = (pl * job->oh + oy) * job->ow + ox;
+                job->out[o] = in[best];
+                if (job->argmax) job->argmax[o] = pl * job->h * job->w + best;
+            }
+        }
+    }
+}
+
+// size x size windows every stride pixels, no padding. argmax (optional, one entry per
+// output) receives the flat index in x of each window's maximum for the backward pass.
+MDArray* maxpool2d_forward(MDArray* x, size_t size, size_t stride, size_t* argmax) {
+    if ((x->ndim != 3 && x->ndim != 4) || size == 0 || stride == 0 ||
+        x->shape[x->ndim - 2] < size || x->shape[x->ndim - 1] < size) {
+        printf("maxpool2d: expected (N, C, H, W) images at least %zux%zu\n", size, size);
+        return NULL;
+    }
+
+    PoolJob job = {0};
+    job.h = x->shape[x->ndim - 2];
+    job.w = x->shape[x->ndim - 1];
+    job.planes = x->total_size / (job.h * job.w);
+    job.oh = (job.h - size) / stride + 1;
+    job.ow = (job.w - size) / stride + 1;
+    job.size = size;
+    job.stride = stride;
+
+    size_t shape[] = {x->shape[0], x->ndim == 4 ? x->shape[1] : 1, job.oh, job.ow};
+    MDArray* out = mdarray_create(4, shape, sizeof(double));
+    if (!out) return NULL;
+    job.x = (const double*)x->data;
+    job.out = (double*)out->data;
+    job.argmax = argmax;
+
+    size_t n_threads = parallel_threads() < job.planes ? parallel_threads() : job.planes;
+    parallel_run(n_threads ? n_threads : 1, pool_forward_worker, &job);
+    return out;
+}
+
+// A plane's windows only index into the same input plane, so threads never share dx
+static void pool_backward_worker(size_t tid, size_t n_threads, void* arg) {
+    PoolJob* job = (PoolJob*)arg;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->planes, &lo, &hi);
+
+    size_t plane_out = job->oh * job->ow;
+    memset(job->dx + lo * job->h * job->w, 0, (hi - lo) * job->h * job->w * sizeof(double));
+    for (size_t o = lo * plane_out; o < hi * plane_out; o++) job->dx[job->argmax[o]] += job->dout[o];
+}
+
+int maxpool2d_backward(MDArray* dout, const size_t* argmax, MDArray* dx) {
+    if ((dout->ndim != 4) || (dx->ndim != 3 && dx->ndim != 4) || dout->shape[0] != dx->shape[0] || !argmax) {
+        printf("maxpool2d_backward: dout must be (N, C, OH, OW) and match dx\n");
+        return -1;
+    }
+
+    PoolJob job = {0};
+    job.h = dx->shape[dx->ndim - 2];
+    job.w = dx->shape[dx->ndim - 1];
+    job.planes = dx->total_size / (job.h * job.w);
+    job.oh = dout->shape[2];
+    job.ow = dout->shape[3];
+    if (dout->total_size != job.planes * job.oh * job.ow) {
+        printf("maxpool2d_backward: dout must be (N, C, OH, OW) and match dx\n");
+        return -1;
+    }
+    job.dx = (double*)dx->data;
+    job.dout = (const double*)dout->data;
+    job.argmax = (size_t*)argmax;
+
+    size_t n_threads = parallel_threads() < job.planes ? parallel_threads() : job.planes;
+    parallel_run(n_threads ? n_threads : 1, pool_backward_worker, &job);
+    return 0;
+}
@@ -0,0 +1,34 @@
+// conv.h
+#ifndef CONV_H
+#define CONV_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "mdarray.h"
+
+#define CONV_DIRECT_K 3           // Filter size with a hand-written direct kernel
+
+typedef enum {
+    CONV_ALGO_AUTO,               // Direct for 3x3 stride 1 filters, im2col otherwise
+    CONV_ALGO_IM2COL,             // Unfold patches, then one blocked GEMM per image
+    CONV_ALGO_DIRECT
+} ConvAlgo;
+
+// Images are NCHW doubles: x (N, C, H, W), or (N, H, W) for one channel. Filters are
+// w (F, C, KH, KW) with bias (F) in any shape holding F values. Outputs are (N, F, OH, OW)
+// with OH = (H + 2 * pad - KH) / stride + 1.
+typedef struct {
+    size_t stride;
+    size_t pad;
+    bool relu;                    // Apply max(0, .) to the forward output
+} ConvConfig;
+
+void conv_set_algo(ConvAlgo algo);
+const char* conv_algo_name(ConvAlgo algo);
+MDArray* conv2d_forward(MDArray* x, MDArray* w, MDArray* bias, ConvConfig* config);
+int conv2d_backward(MDArray* x, MDArray* w, MDArray* out, MDArray* dout, ConvConfig* config,
+                    MDArray* dx, MDArray* dw, MDArray* dbias);
+MDArray* maxpool2d_forward(MDArray* x, size_t size, size_t stride, size_t* argmax);
+int maxpool2d_backward(MDArray* dout, const size_t* argmax, MDArray* dx);
+
+#endif // CONV_H
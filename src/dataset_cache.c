@@ -0,0 +1,297 @@
+#include "dataset_cache.h"
+#include "parallel.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IDX_HEADER_SIZE 16
+#define IDX_IMAGE_MAGIC 0x00000803   // Unsigned bytes, three dimensions
+
+typedef struct {
+    void* data;
+    size_t size;
+} Mapping;
+
+static int map_file(const char* path, Mapping* m) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+
+    m->size = (size_t)st.st_size;
+    m->data = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m->data == MAP_FAILED) return -1;
+    return 0;
+}
+
+static uint64_t fnv1a(const unsigned char* bytes, size_t len) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < len; i++) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint32_t read_be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+uint64_t dataset_hash_file(const char* path) {
+    Mapping m;
+    if (map_file(path, &m) < 0) return 0;
+    uint64_t h = fnv1a((const unsigned char*)m.data, m.size);
+    munmap(m.data, m.size);
+    return h;
+}
+
+// N * rows * cols, or -1 if it does not fit in a size_t
+static int shape_total(const uint64_t shape[3], size_t* total) {
+    uint64_t t;
+    if (__builtin_mul_overflow(shape[0], shape[1], &t) || __builtin_mul_overflow(t, shape[2], &t) ||
+        t > SIZE_MAX) {
+        return -1;
+    }
+    *total = (size_t)t;
+    return 0;
+}
+
+static int write_all(FILE* f, const void* buf, size_t len) {
+    return fwrite(buf, 1, len, f) == len ? 0 : -1;
+}
+
+// Converts an IDX image file into a page-aligned cache that can be mmapped as an MDArray
+int dataset_cache_build(const char* idx_path, const char* cache_path, size_t itemsize) {
+    if (itemsize != 1 && itemsize != sizeof(double)) {
+        printf("Unsupported cache itemsize %zu\n", itemsize);
+        return -1;
+    }
+
+    Mapping src;
+    if (map_file(idx_path, &src) < 0) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    struct stat st;
+    if (stat(idx_path, &st) != 0) {
+        perror("Error reading file status");
+        munmap(src.data, src.size);
+        return -1;
+    }
+
+    const unsigned char* bytes = (const unsigned char*)src.data;
+    if (src.size < IDX_HEADER_SIZE || read_be32(bytes) != IDX_IMAGE_MAGIC) {
+        printf("Not an IDX image file %s\n", idx_path);
+        munmap(src.data, src.size);
+        return -1;
+    }
+
+    DatasetCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DATASET_CACHE_MAGIC;
+    header.version = DATASET_CACHE_VERSION;
+    header.source_hash = fnv1a(bytes, src.size);
+    header.source_size = src.size;
+    header.source_mtime = (int64_t)st.st_mtime;
+    header.shape[0] = read_be32(bytes + 4);
+    header.shape[1] = read_be32(bytes + 8);
+    header.shape[2] = read_be32(bytes + 12);
+    header.itemsize = itemsize;
+    header.scale = 1.0;
+    header.data_offset = DATASET_CACHE_ALIGN;
+
+    size_t total;
+    if (shape_total(header.shape, &total) != 0 || total > src.size - IDX_HEADER_SIZE) {
+        printf("Truncated IDX file %s\n", idx_path);
+        munmap(src.data, src.size);
+        return -1;
+    }
+
+    // Write to a temporary file first so readers never see a half-written cache
+    size_t tmp_len = strlen(cache_path) + 5;
+    char* tmp_path = (char*)malloc(tmp_len);
+    if (!tmp_path) {
+        munmap(src.data, src.size);
+        return -1;
+    }
+    snprintf(tmp_path, tmp_len, "%s.tmp", cache_path);
+
+    FILE* out = fopen(tmp_path, "wb");
+    if (!out) {
+        perror("Error opening file");
+        free(tmp_path);
+        munmap(src.data, src.size);
+        return -1;
+    }
+
+    unsigned char page[DATASET_CACHE_ALIGN];
+    memset(page, 0, sizeof(page));
+    memcpy(page, &header, sizeof(header));
+    int rc = write_all(out, page, sizeof(page));
+
+    const unsigned char* pixels = bytes + IDX_HEADER_SIZE;
+    if (itemsize == 1) {
+        if (rc == 0) rc = write_all(out, pixels, total);
+    } else {
+        double chunk[4096];
+        for (size_t i = 0; i < total && rc == 0; i += 4096) {
+            size_t n = total - i < 4096 ? total - i : 4096;
+            for (size_t k = 0; k < n; k++) chunk[k] = (double)pixels[i + k];
+            rc = write_all(out, chunk, n * sizeof(double));
+        }
+    }
+
+    if (fclose(out) != 0) rc = -1;
+    if (rc == 0) rc = rename(tmp_path, cache_path);
+    if (rc != 0) {
+        printf("Failed to write dataset cache %s\n", cache_path);
+        unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    munmap(src.data, src.size);
+    return rc;
+}
+
+// Returns 1 if the cache still matches the source file. When only the mtime moved and the
+// content hash still matches, *touched receives the new mtime so the header can be updated.
+static int cache_is_fresh(const DatasetCacheHeader* header, const char* idx_path, int64_t* touched) {
+    if (!idx_path) return 1;
+
+    struct stat st;
+    if (stat(idx_path, &st) < 0) return 1;  // Source gone, the cache is all we have
+
+    if ((uint64_t)st.st_size != header->source_size) return 0;
+    if ((int64_t)st.st_mtime == header->source_mtime) return 1;
+
+    // Touched but maybe unchanged: fall back to the content hash
+    if (dataset_hash_file(idx_path) != header->source_hash) return 0;
+    *touched = (int64_t)st.st_mtime;
+    return 1;
+}
+
+// Records the source's new mtime so the next open skips the rehash. Best effort: a read-only
+// cache still works, it just keeps hashing.
+static void refresh_mtime(const char* cache_path, int64_t mtime) {
+    int fd = open(cache_path, O_WRONLY);
+    if (fd < 0) return;
+    ssize_t n = pwrite(fd, &mtime, sizeof(mtime), offsetof(DatasetCacheHeader, source_mtime));
+    (void)n;
+    close(fd);
+}
+
+DatasetCache* dataset_cache_open(const char* idx_path, const char* cache_path) {
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < DATASET_CACHE_ALIGN) {
+        close(fd);
+        return NULL;
+    }
+
+    // Private writable mapping: callers may scribble on images without touching the file
+    size_t map_size = (size_t)st.st_size;
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    DatasetCacheHeader* header = (DatasetCacheHeader*)map;
+    size_t total = 0;
+    int64_t touched = header->source_mtime;
+    // Bounds by division, so a corrupt shape cannot wrap around and pass
+    if (header->magic != DATASET_CACHE_MAGIC || header->version != DATASET_CACHE_VERSION ||
+        (header->itemsize != 1 && header->itemsize != sizeof(double)) ||
+        shape_total(header->shape, &total) != 0 || header->data_offset > map_size ||
+        total > (map_size - header->data_offset) / header->itemsize ||
+        !cache_is_fresh(header, idx_path, &touched)) {
+        munmap(map, map_size);
+        return NULL;
+    }
+    if (touched != header->source_mtime) {
+        refresh_mtime(cache_path, touched);
+        header->source_mtime = touched;
+    }
+
+    madvise(map, map_size, MADV_WILLNEED);
+
+    DatasetCache* cache = (DatasetCache*)malloc(sizeof(DatasetCache));
+    if (!cache) {
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    size_t shape[] = {header->shape[0], header->shape[1], header->shape[2]};
+    cache->map = map;
+    cache->map_size = map_size;
+    cache->scale = header->scale;
+    cache->images = mdarray_from_data(3, shape, header->itemsize, (char*)map + header->data_offset);
+    if (!cache->images) {
+        munmap(map, map_size);
+        free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+// Opens the cache, (re)building it first if it is missing or stale
+DatasetCache* dataset_cache_load(const char* idx_path, const char* cache_path, size_t itemsize) {
+    DatasetCache* cache = dataset_cache_open(idx_path, cache_path);
+    if (cache && cache->images->itemsize == itemsize) return cache;
+    dataset_cache_close(cache);
+
+    printf("Building dataset cache %s\n", cache_path);
+    if (dataset_cache_build(idx_path, cache_path, itemsize) != 0) return NULL;
+    return dataset_cache_open(idx_path, cache_path);
+}
+
+typedef struct {
+    const DatasetCache* cache;
+    double* dst;
+    size_t n;
+} DecodeJob;
+
+static void decode_worker(size_t tid, size_t n_threads, void* ctx) {
+    DecodeJob* job = (DecodeJob*)ctx;
+    const MDArray* src = job->cache->images;
+    double scale = job->cache->scale;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->n, &lo, &hi);
+    if (src->itemsize == 1) {
+        const unsigned char* p = (const unsigned char*)src->data;
+        for (size_t i = lo; i < hi; i++) job->dst[i] = (double)p[i] * scale;
+    } else {
+        const double* p = (const double*)src->data;
+        for (size_t i = lo; i < hi; i++) job->dst[i] = p[i] * scale;
+    }
+}
+
+// Pixels as a new double array with the stored scale applied. Decoded by all threads so
+// each one first-touches the slice it will train on; the cache can be closed afterwards.
+MDArray* dataset_cache_decode(const DatasetCache* cache) {
+    MDArray* out = mdarray_create(3, cache->images->shape, sizeof(double));
+    if (!out) return NULL;
+    DecodeJob job = {cache, (double*)out->data, out->total_size};
+    parallel_run(parallel_threads(), decode_worker, &job);
+    return out;
+}
+
+void dataset_cache_close(DatasetCache* cache) {
+    if (cache) {
+        mdarray_free(cache->images);
+        munmap(cache->map, cache->map_size);
+        free(cache);
+    }
+}
@@ -0,0 +1,41 @@
+// dataset_cache.h
+#ifndef DATASET_CACHE_H
+#define DATASET_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mdarray.h"
+
+#define DATASET_CACHE_MAGIC   0x4e4e4343u  // "NNCC"
+#define DATASET_CACHE_VERSION 1
+#define DATASET_CACHE_ALIGN   4096         // Pixel data starts on a page boundary
+
+// On-disk header, padded to DATASET_CACHE_ALIGN bytes
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;   // FNV-1a of the whole source IDX file
+    uint64_t source_size;   // Cheap staleness check before rehashing
+    int64_t source_mtime;
+    uint64_t shape[3];      // (N, rows, cols)
+    uint64_t itemsize;      // 1 for raw uint8 pixels, 8 for double
+    double scale;           // pixel value = stored value * scale
+    uint64_t data_offset;
+} DatasetCacheHeader;
+
+// A mapped cache file, images is a zero-copy view into the mapping
+typedef struct {
+    void* map;
+    size_t map_size;
+    double scale;
+    MDArray* images;
+} DatasetCache;
+
+uint64_t dataset_hash_file(const char* path);
+int dataset_cache_build(const char* idx_path, const char* cache_path, size_t itemsize);
+DatasetCache* dataset_cache_open(const char* idx_path, const char* cache_path);
+DatasetCache* dataset_cache_load(const char* idx_path, const char* cache_path, size_t itemsize);
+MDArray* dataset_cache_decode(const DatasetCache* cache);
+void dataset_cache_close(DatasetCache* cache);
+
+#endif // DATASET_CACHE_H
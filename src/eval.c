@@ -0,0 +1,195 @@
+#include "eval.h"
+#include "parallel.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct {
+    EvalSet* set;
+    const double* w;
+    const double* b;
+    size_t classes;
+    size_t (*confusion)[EVAL_CLASSES][EVAL_CLASSES];  // One matrix per thread
+    int failed;
+} EvalJob;
+
+static int read_be32(int fd, off_t offset, uint32_t* out) {
+    unsigned char b[4];
+    if (pread(fd, b, 4, offset) != 4) return -1;
+    *out = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+    return 0;
+}
+
+EvalSet* eval_set_open(const char* images_path, const char* labels_path) {
+    EvalSet* set = (EvalSet*)calloc(1, sizeof(EvalSet));
+    if (!set) return NULL;
+
+    set->fd = open(images_path, O_RDONLY);
+    int lfd = open(labels_path, O_RDONLY);
+    uint32_t magic, n, rows, cols, lmagic, ln;
+    if (set->fd < 0 || lfd < 0 ||
+        read_be32(set->fd, 0, &magic) || read_be32(set->fd, 4, &n) ||
+        read_be32(set->fd, 8, &rows) || read_be32(set->fd, 12, &cols) ||
+        read_be32(lfd, 0, &lmagic) || read_be32(lfd, 4, &ln) ||
+        magic != 2051 || lmagic != 2049 || n != ln) {
+        printf("eval_set_open: cannot read %s / %s as IDX images and labels\n", images_path, labels_path);
+        if (lfd >= 0) close(lfd);
+        eval_set_close(set);
+        return NULL;
+    }
+
+    set->n = n;
+    set->features = (size_t)rows * cols;
+    set->data_offset = 16;
+    set->labels = (uint8_t*)malloc(n ? n : 1);
+    ssize_t got = set->labels ? pread(lfd, set->labels, n, 8) : -1;
+    close(lfd);
+    if (got != (ssize_t)n) {
+        printf("eval_set_open: short read on %s\n", labels_path);
+        eval_set_close(set);
+        return NULL;
+    }
+    // Checked once here so the workers can index the confusion matrix with them directly
+    for (size_t i = 0; i < set->n; i++) {
+        if (set->labels[i] >= EVAL_CLASSES) {
+            printf("eval_set_open: label %u of sample %zu in %s is not below %d\n",
+                   set->labels[i], i, labels_path, EVAL_CLASSES);
+            eval_set_close(set);
+            return NULL;
+        }
+    }
+    return set;
+}
+
+void eval_set_close(EvalSet* set) {
+    if (set) {
+        if (set->fd >= 0) close(set->fd);
+        free(set->labels);
+        free(set);
+    }
+}
+
+// The class scores of one sample live in registers only, the 10xN matrix is never built
+#define EVAL_ARGMAX(T, x, w, b, classes, features, best)               \
+    do {                                                               \
+        double best_s_ = 0.0;                                          \
+        for (size_t c_ = 0; c_ < (classes); c_++) {                    \
+            const double* wc_ = (w) + c_ * (features);                 \
+            double s_ = (b)[c_];                                       \
+            for (size_t k_ = 0; k_ < (features); k_++) {               \
+                T v_ = (x)[k_];                                        \
+                if (v_) s_ += wc_[k_] * (double)v_;                    \
+            }                                                          \
+            if (c_ == 0 || s_ > best_s_) {                             \
+                best_s_ = s_;                                          \
+                (best) = c_;                                           \
+            }                                                          \
+        }                                                              \
+    } while (0)
+
+// Predicted class of every (N, ...) float64 image
+int eval_predict(MDArray* weights, MDArray* biases, MDArray* images, size_t* out) {
+    size_t n = images->shape[0];
+    size_t features = n ? images->total_size / n : 0;
+    if (weights->ndim != 2 || weights->shape[1] != features || biases->total_size != weights->shape[0] ||
+        images->itemsize != sizeof(double)) {
+        printf("eval_predict: weights (%zux%zu) do not match %zu features\n",
+               weights->shape[0], weights->shape[1], features);
+        return -1;
+    }
+    const double* w = (const double*)weights->data;
+    const double* b = (const double*)biases->data;
+    const double* x = (const double*)images->data;
+    for (size_t j = 0; j < n; j++) {
+        size_t best = 0;
+        EVAL_ARGMAX(double, x + j * features, w, b, weights->shape[0], features, best);
+        out[j] = best;
+    }
+    return 0;
+}
+
+static void eval_worker(size_t tid, size_t n_threads, void* arg) {
+    EvalJob* job = (EvalJob*)arg;
+    EvalSet* set = job->set;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, set->n, &lo, &hi);
+
+    size_t (*confusion)[EVAL_CLASSES] = job->confusion[tid];
+    uint8_t* buf = (uint8_t*)malloc(EVAL_BATCH * set->features);
+    if (!buf) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (size_t start = lo; start < hi; start += EVAL_BATCH) {
+        size_t m = hi - start < EVAL_BATCH ? hi - start : EVAL_BATCH;
+        size_t bytes = m * set->features;
+        off_t offset = set->data_offset + (off_t)(start * set->features);
+        if (pread(set->fd, buf, bytes, offset) != (ssize_t)bytes) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        for (size_t j = 0; j < m; j++) {
+            size_t best = 0;
+            EVAL_ARGMAX(uint8_t, buf + j * set->features, job->w, job->b, job->classes, set->features, best);
+            confusion[set->labels[start + j]][best]++;
+        }
+    }
+    free(buf);
+}
+
+// Streams the whole set through the model on n_threads threads
+int eval_run(EvalSet* set, MDArray* weights, MDArray* biases, size_t n_threads, EvalResult* result) {
+    if (weights->ndim != 2 || weights->shape[0] > EVAL_CLASSES || weights->shape[1] != set->features ||
+        biases->total_size != weights->shape[0]) {
+        printf("eval_run: weights do not match the evaluation set\n");
+        return -1;
+    }
+    if (n_threads == 0) n_threads = 1;
+
+    EvalJob job;
+    job.set = set;
+    job.w = (const double*)weights->data;
+    job.b = (const double*)biases->data;
+    job.classes = weights->shape[0];
+    job.failed = 0;
+    job.confusion = (size_t (*)[EVAL_CLASSES][EVAL_CLASSES])calloc(n_threads, sizeof(*job.confusion));
+    if (!job.confusion) return -1;
+
+    double t0 = now_sec();
+    parallel_run(n_threads, eval_worker, &job);
+    double dt = now_sec() - t0;
+
+    memset(result, 0, sizeof(EvalResult));
+    for (size_t t = 0; t < n_threads; t++) {
+        for (size_t i = 0; i < EVAL_CLASSES; i++) {
+            for (size_t j = 0; j < EVAL_CLASSES; j++) result->confusion[i][j] += job.confusion[t][i][j];
+        }
+    }
+    free(job.confusion);
+    if (job.failed) {
+        printf("eval_run: failed to read images\n");
+        return -1;
+    }
+
+    result->n = set->n;
+    for (size_t i = 0; i < EVAL_CLASSES; i++) result->correct += result->confusion[i][i];
+    result->accuracy = set->n ? (double)result->correct / (double)set->n : 0.0;
+    result->seconds = dt;
+    result->images_per_sec = dt > 0.0 ? (double)set->n / dt : 0.0;
+    return 0;
+}
+
+void eval_print_confusion(EvalResult* result) {
+    printf("Confusion matrix (rows: label, columns: prediction)\n     ");
+    for (size_t j = 0; j < EVAL_CLASSES; j++) printf("%6zu", j);
+    printf("\n");
+    for (size_t i = 0; i < EVAL_CLASSES; i++) {
+        printf("%5zu", i);
+        for (size_t j = 0; j < EVAL_CLASSES; j++) printf("%6zu", result->confusion[i][j]);
+        printf("\n");
+    }
+}
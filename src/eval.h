@@ -0,0 +1,38 @@
+// eval.h
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "mdarray.h"
+
+#define EVAL_CLASSES 10
+#define EVAL_BATCH   256          // Images each thread reads per pread
+
+// IDX image/label pair opened for streaming: labels are small and read up front, pixels
+// are fetched with pread by whichever thread needs them
+typedef struct {
+    int fd;
+    size_t n;
+    size_t features;              // rows * cols
+    off_t data_offset;            // First pixel byte in the image file
+    uint8_t* labels;
+} EvalSet;
+
+typedef struct {
+    size_t n;
+    size_t correct;
+    double accuracy;
+    double seconds;
+    double images_per_sec;
+    size_t confusion[EVAL_CLASSES][EVAL_CLASSES];  // [true label][prediction]
+} EvalResult;
+
+EvalSet* eval_set_open(const char* images_path, const char* labels_path);
+void eval_set_close(EvalSet* set);
+int eval_predict(MDArray* weights, MDArray* biases, MDArray* images, size_t* out);
+int eval_run(EvalSet* set, MDArray* weights, MDArray* biases, size_t n_threads, EvalResult* result);
+void eval_print_confusion(EvalResult* result);
+
+#endif // EVAL_H
@@ -0,0 +1,394 @@
+#include "gemm.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <pthread.h>
+
+#ifdef NNC_HAVE_CBLAS
+#include <cblas.h>
+#endif
+
+// Configure-time default, see NNC_GEMM_BACKEND in CMakeLists.txt
+#ifndef NNC_GEMM_DEFAULT
+#define NNC_GEMM_DEFAULT "blocked"
+#endif
+
+// Below this many multiply-adds the blocked kernel stays on the calling thread
+#define GEMM_PARALLEL_MIN_FLOPS (1u << 20)
+
+static const char* backend_names[GEMM_BACKEND_COUNT] = {"reference", "blocked", "cblas"};
+static GemmBackend resolved = GEMM_BACKEND_BLOCKED;   // Default and NNC_GEMM, read once
+static pthread_once_t resolve_once = PTHREAD_ONCE_INIT;
+static int selected = -1;                                // gemm_set_backend, atomic
+
+static void scale_c(size_t m, size_t n, double beta, double* c) {
+    for (size_t i = 0; i < m * n; i++) c[i] = beta == 0.0 ? 0.0 : c[i] * beta;
+}
+
+static void gemm_reference(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                           double alpha, const double* a, const double* b, double beta, double* c) {
+    scale_c(m, n, beta, c);
+    for (size_t i = 0; i < m; i++) {
+        for (size_t j = 0; j < n; j++) {
+            double sum = 0.0;
+            for (size_t p = 0; p < k; p++) {
+                double aip = trans_a ? a[p * m + i] : a[i * k + p];
+                double bpj = trans_b ? b[j * k + p] : b[p * n + j];
+                sum += aip * bpj;
+            }
+            c[i * n + j] += alpha * sum;
+        }
+    }
+}
+
+typedef struct {
+    size_t m, n, k;
+    double alpha;
+    const double* a;              // (m, k) row-major
+    const double* b;              // (k, n) row-major
+    double* c;
+    const GemmParams* params;
+} BlockedJob;
+
+// Shapes with tuned parameters, filled from the profile file or by the autotuner
+typedef struct {
+    bool trans_a, trans_b;
+    size_t m, n, k;
+    GemmParams params;
+} GemmProfile;
+
+static GemmProfile profiles[GEMM_MAX_PROFILES];
+static size_t n_profiles = 0;
+
+// Rows i .. i + rows of c += alpha * a * b over one panel, every b element loaded once per
+// group of rows. Each c element still sums in k order, so the result matches unroll 1.
+static void panel_rows(BlockedJob* job, size_t i, size_t rows, size_t j0, size_t len, size_t p0, size_t p1) {
+    size_t n = job->n, k = job->k;
+    double* c0 = job->c + i * n + j0;
+    const double* a0 = job->a + i * k;
+    if (rows == 4) {
+        double *c1 = c0 + n, *c2 = c1 + n, *c3 = c2 + n;
+        const double *a1 = a0 + k, *a2 = a1 + k, *a3 = a2 + k;
+        for (size_t p = p0; p < p1; p++) {
+            double x0 = job->alpha * a0[p], x1 = job->alpha * a1[p];
+            double x2 = job->alpha * a2[p], x3 = job->alpha * a3[p];
+            const double* brow = job->b + p * n + j0;
+            for (size_t j = 0; j < len; j++) {
+                double bj = brow[j];
+                c0[j] += x0 * bj;
+                c1[j] += x1 * bj;
+                c2[j] += x2 * bj;
+                c3[j] += x3 * bj;
+            }
+        }
+    } else if (rows == 2) {
+        double* c1 = c0 + n;
+        const double* a1 = a0 + k;
+        for (size_t p = p0; p < p1; p++) {
+            double x0 = job->alpha * a0[p], x1 = job->alpha * a1[p];
+            const double* brow = job->b + p * n + j0;
+            for (size_t j = 0; j < len; j++) {
+                double bj = brow[j];
+                c0[j] += x0 * bj;
+                c1[j] += x1 * bj;
+            }
+        }
+    } else {
+        for (size_t p = p0; p < p1; p++) {
+            double aip = job->alpha * a0[p];
+            if (aip == 0.0) continue;
+            const double* brow = job->b + p * n + j0;
+            for (size_t j = 0; j < len; j++) c0[j] += aip * brow[j];
+        }
+    }
+}
+
+// Each thread owns a range of output columns. Inside it, a block_k x block_n panel of b is
+// streamed against every row of a, accumulating in k order into the output row. With
+// alpha == 1 and beta == 0 that is the reference's summation, bit for bit; otherwise alpha
+// and beta are applied per term rather than once, so results differ in the last bits.
+static void blocked_worker(size_t tid, size_t n_threads, void* arg) {
+    BlockedJob* job = (BlockedJob*)arg;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->n, &lo, &hi);
+
+    size_t m = job->m, k = job->k;
+    size_t bn = job->params->block_n, bk = job->params->block_k, u = job->params->unroll;
+    for (size_t j0 = lo; j0 < hi; j0 += bn) {
+        size_t len = hi - j0 < bn ? hi - j0 : bn;
+        for (size_t p0 = 0; p0 < k; p0 += bk) {
+            size_t p1 = k - p0 < bk ? k : p0 + bk;
+            size_t i = 0;
+            for (; u > 1 && i + u <= m; i += u) panel_rows(job, i, u, j0, len, p0, p1);
+            for (; i < m; i++) panel_rows(job, i, 1, j0, len, p0, p1);
+        }
+    }
+}
+
+// Transposed operands are packed row-major once so the inner loop is always unit stride
+static double* pack_transpose(const double* src, size_t rows, size_t cols) {
+    double* dst = (double*)malloc(rows * cols * sizeof(double));
+    if (!dst) return NULL;
+    for (size_t r0 = 0; r0 < rows; r0 += 32) {
+        for (size_t c0 = 0; c0 < cols; c0 += 32) {
+            size_t r1 = rows - r0 < 32 ? rows : r0 + 32, c1 = cols - c0 < 32 ? cols : c0 + 32;
+            for (size_t r = r0; r < r1; r++) {
+                for (size_t c = c0; c < c1; c++) dst[c * rows + r] = src[r * cols + c];
+            }
+        }
+    }
+    return dst;
+}
+
+void gemm_default_params(GemmParams* params) {
+    params->block_n = GEMM_BLOCK_N;
+    params->block_k = GEMM_BLOCK_K;
+    params->unroll = GEMM_UNROLL;
+    params->n_threads = 0;
+}
+
+// Adds or replaces the parameters used for products of this shape and orientation
+int gemm_set_params(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, const GemmParams* params) {
+    if (params->block_n == 0 || params->block_k == 0 ||
+        (params->unroll != 1 && params->unroll != 2 && params->unroll != 4)) {
+        printf("gemm_set_params: invalid parameters for %zux%zux%zu\n", m, n, k);
+        return -1;
+    }
+    size_t slot = 0;
+    while (slot < n_profiles) {
+        GemmProfile* pr = &profiles[slot];
+        if (pr->trans_a == trans_a && pr->trans_b == trans_b && pr->m == m && pr->n == n && pr->k == k) break;
+        slot++;
+    }
+    if (slot == GEMM_MAX_PROFILES) {
+        printf("gemm_set_params: more than %d tuned shapes\n", GEMM_MAX_PROFILES);
+        return -1;
+    }
+    profiles[slot].trans_a = trans_a;
+    profiles[slot].trans_b = trans_b;
+    profiles[slot].m = m;
+    profiles[slot].n = n;
+    profiles[slot].k = k;
+    profiles[slot].params = *params;
+    if (slot == n_profiles) n_profiles++;
+    return 0;
+}
+
+void gemm_clear_params(void) {
+    n_profiles = 0;
+}
+
+size_t gemm_params_count(void) {
+    return n_profiles;
+}
+
+static double log2_ratio(size_t x, size_t y) {
+    double r = log2((double)(x ? x : 1) / (double)(y ? y : 1));
+    return r < 0.0 ? -r : r;
+}
+
+// Exact shape if it was tuned, else the closest tuned shape with the same orientation within
+// a factor of 8 overall (so a batch of 1900 reuses the 2000 profile), else the defaults
+void gemm_params_for(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, GemmParams* out) {
+    gemm_default_params(out);
+    double best = 3.0;
+    for (size_t i = 0; i < n_profiles; i++) {
+        GemmProfile* pr = &profiles[i];
+        if (pr->trans_a != trans_a || pr->trans_b != trans_b) continue;
+        double d = log2_ratio(m, pr->m) + log2_ratio(n, pr->n) + log2_ratio(k, pr->k);
+        if (d <= best) {
+            best = d;
+            *out = pr->params;
+        }
+    }
+}
+
+// NNC_GEMM_PROFILE overrides the default file in the working directory
+const char* gemm_profile_path(void) {
+    const char* env = getenv("NNC_GEMM_PROFILE");
+    return env && *env ? env : "nnc_gemm.profile";
+}
+
+// Returns the number of shapes read, or -1 if the file cannot be opened or is malformed.
+// A profile from a machine with a different CPU count is still loaded, with a warning.
+int gemm_load_profile(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+
+    char line[256];
+    int loaded = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n') continue;
+        size_t cpus, ta, tb, m, n, k;
+        GemmParams params;
+        if (sscanf(line, "cpus %zu", &cpus) == 1) {
+            if (cpus != parallel_threads()) {
+                printf("%s was tuned with %zu threads, running with %zu\n", path, cpus, parallel_threads());
+            }
+        } else if (sscanf(line, "%zu %zu %zu %zu %zu %zu %zu %zu %zu", &ta, &tb, &m, &n, &k, &params.block_n,
+                          &params.block_k, &params.unroll, &params.n_threads) == 9 && ta <= 1 && tb <= 1) {
+            if (gemm_set_params(ta, tb, m, n, k, &params) == 0) loaded++;
+        } else {
+            printf("%s: cannot parse '%s'\n", path, strtok(line, "\n"));
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return loaded;
+}
+
+int gemm_save_profile(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    fprintf(f, "# NNC blocked GEMM profile, written by --autotune\n");
+    fprintf(f, "cpus %zu\n", parallel_threads());
+    fprintf(f, "# trans_a trans_b m n k block_n block_k unroll threads\n");
+    for (size_t i = 0; i < n_profiles; i++) {
+        GemmProfile* pr = &profiles[i];
+        fprintf(f, "%d %d %zu %zu %zu %zu %zu %zu %zu\n", pr->trans_a, pr->trans_b, pr->m, pr->n, pr->k,
+                pr->params.block_n, pr->params.block_k, pr->params.unroll, pr->params.n_threads);
+    }
+    fclose(f);
+    return 0;
+}
+
+void gemm_dgemm_blocked_params(const GemmParams* params, bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                               double alpha, const double* a, const double* b, double beta, double* c) {
+    double* a_packed = trans_a ? pack_transpose(a, k, m) : NULL;
+    double* b_packed = trans_b ? pack_transpose(b, n, k) : NULL;
+    if ((trans_a && !a_packed) || (trans_b && !b_packed)) {
+        free(a_packed);
+        free(b_packed);
+        gemm_reference(trans_a, trans_b, m, n, k, alpha, a, b, beta, c);
+        return;
+    }
+
+    scale_c(m, n, beta, c);
+    BlockedJob job = {m, n, k, alpha, trans_a ? a_packed : a, trans_b ? b_packed : b, c, params};
+    // A tuned count never exceeds what this process may use (NNC_THREADS, worker budgets)
+    size_t n_threads = params->n_threads;
+    if (n_threads == 0) n_threads = (double)m * n * k < GEMM_PARALLEL_MIN_FLOPS ? 1 : parallel_threads();
+    if (n_threads > parallel_threads()) n_threads = parallel_threads();
+    if (n_threads > n) n_threads = n ? n : 1;
+    parallel_run(n_threads, blocked_worker, &job);
+
+    free(a_packed);
+    free(b_packed);
+}
+
+static void gemm_blocked(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                         double alpha, const double* a, const double* b, double beta, double* c) {
+    GemmParams params;
+    gemm_params_for(trans_a, trans_b, m, n, k, &params);
+    gemm_dgemm_blocked_params(&params, trans_a, trans_b, m, n, k, alpha, a, b, beta, c);
+}
+
+#ifdef NNC_HAVE_CBLAS
+// CBLAS takes int sizes and leading dimensions, all of which are m, n or k here. Larger
+// products go to the blocked kernel rather than being truncated.
+static void gemm_cblas(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                       double alpha, const double* a, const double* b, double beta, double* c) {
+    if (m == 0 || n == 0) return;
+    if (k == 0) {
+        scale_c(m, n, beta, c);
+        return;
+    }
+    if (m > INT_MAX || n > INT_MAX || k > INT_MAX) {
+        gemm_blocked(trans_a, trans_b, m, n, k, alpha, a, b, beta, c);
+        return;
+    }
+    cblas_dgemm(CblasRowMajor, trans_a ? CblasTrans : CblasNoTrans, trans_b ? CblasTrans : CblasNoTrans,
+                (int)m, (int)n, (int)k, alpha, a, trans_a ? (int)m : (int)k,
+                b, trans_b ? (int)k : (int)n, beta, c, (int)n);
+}
+#endif
+
+static GemmFn backend_fn(GemmBackend backend) {
+    switch (backend) {
+    case GEMM_BACKEND_REFERENCE: return gemm_reference;
+    case GEMM_BACKEND_BLOCKED: return gemm_blocked;
+#ifdef NNC_HAVE_CBLAS
+    case GEMM_BACKEND_CBLAS: return gemm_cblas;
+#endif
+    default: return NULL;
+    }
+}
+
+bool gemm_backend_available(GemmBackend backend) {
+    return backend < GEMM_BACKEND_COUNT && backend_fn(backend) != NULL;
+}
+
+const char* gemm_backend_name(GemmBackend backend) {
+    return backend < GEMM_BACKEND_COUNT ? backend_names[backend] : "unknown";
+}
+
+int gemm_backend_from_name(const char* name, GemmBackend* out) {
+    for (size_t i = 0; i < GEMM_BACKEND_COUNT; i++) {
+        if (strcmp(name, backend_names[i]) == 0) {
+            *out = (GemmBackend)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int gemm_set_backend(GemmBackend backend) {
+    if (!gemm_backend_available(backend)) return -1;
+    __atomic_store_n(&selected, (int)backend, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// NNC_GEMM overrides the configure-time default, unknown or missing backends fall back to it
+static void resolve_backend(void) {
+    GemmBackend backend = GEMM_BACKEND_BLOCKED;
+    if (gemm_backend_from_name(NNC_GEMM_DEFAULT, &backend) != 0 || !gemm_backend_available(backend)) {
+        backend = GEMM_BACKEND_BLOCKED;
+    }
+    const char* env = getenv("NNC_GEMM");
+    if (env && *env) {
+        GemmBackend requested;
+        if (gemm_backend_from_name(env, &requested) != 0 || !gemm_backend_available(requested)) {
+            printf("NNC_GEMM=%s is not available, using %s\n", env, gemm_backend_name(backend));
+        } else {
+            backend = requested;
+        }
+    }
+    resolved = backend;
+}
+
+// Safe to call from any thread; the environment is only read on the first call
+GemmBackend gemm_get_backend(void) {
+    int chosen = __atomic_load_n(&selected, __ATOMIC_ACQUIRE);
+    if (chosen >= 0) return (GemmBackend)chosen;
+    pthread_once(&resolve_once, resolve_backend);
+    return resolved;
+}
+
+void gemm_dgemm_with(GemmBackend backend, bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                     double alpha, const double* a, const double* b, double beta, double* c) {
+    GemmFn fn = backend_fn(backend);
+    if (!fn) fn = backend_fn(gemm_get_backend());
+    fn(trans_a, trans_b, m, n, k, alpha, a, b, beta, c);
+}
+
+void gemm_dgemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                double alpha, const double* a, const double* b, double beta, double* c) {
+    gemm_dgemm_with(gemm_get_backend(), trans_a, trans_b, m, n, k, alpha, a, b, beta, c);
+}
+
+// batch independent products, matrix i starting stride elements after matrix i - 1
+void gemm_dgemm_batched(size_t batch, bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                        double alpha, const double* a, size_t stride_a, const double* b, size_t stride_b,
+                        double beta, double* c, size_t stride_c) {
+    GemmFn fn = backend_fn(gemm_get_backend());
+    for (size_t i = 0; i < batch; i++) {
+        fn(trans_a, trans_b, m, n, k, alpha, a + i * stride_a, b + i * stride_b, beta, c + i * stride_c);
+    }
+}
@@ -0,0 +1,56 @@
+// gemm.h
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define GEMM_BLOCK_N 256          // Output columns kept hot per panel
+#define GEMM_BLOCK_K 64           // Rows of B per panel, 64 x 256 doubles = 128 KB
+#define GEMM_UNROLL 1             // Rows of A sharing each pass over a B panel row
+#define GEMM_MAX_PROFILES 64
+
+typedef enum {
+    GEMM_BACKEND_REFERENCE,       // Plain dot products, the numerical baseline
+    GEMM_BACKEND_BLOCKED,         // Cache-blocked and threaded over output columns
+    GEMM_BACKEND_CBLAS,           // System BLAS, only when CMake found one
+    GEMM_BACKEND_COUNT
+} GemmBackend;
+
+// c(m, n) = alpha * op(a) * op(b) + beta * c, all row-major and contiguous. op(a) is (m, k),
+// so a is stored (m, k) or, transposed, (k, m); likewise b is (k, n) or (n, k).
+typedef void (*GemmFn)(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                       double alpha, const double* a, const double* b, double beta, double* c);
+
+// Tunables of the blocked backend, see gemm_tune.c for how they are chosen
+typedef struct {
+    size_t block_n;
+    size_t block_k;
+    size_t unroll;                // 1, 2 or 4
+    size_t n_threads;             // 0 picks parallel_threads() for large enough products
+} GemmParams;
+
+bool gemm_backend_available(GemmBackend backend);
+const char* gemm_backend_name(GemmBackend backend);
+int gemm_backend_from_name(const char* name, GemmBackend* out);
+int gemm_set_backend(GemmBackend backend);
+GemmBackend gemm_get_backend(void);
+void gemm_dgemm(bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                double alpha, const double* a, const double* b, double beta, double* c);
+void gemm_dgemm_with(GemmBackend backend, bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                     double alpha, const double* a, const double* b, double beta, double* c);
+void gemm_default_params(GemmParams* params);
+int gemm_set_params(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, const GemmParams* params);
+void gemm_params_for(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, GemmParams* out);
+void gemm_clear_params(void);
+size_t gemm_params_count(void);
+void gemm_dgemm_blocked_params(const GemmParams* params, bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                               double alpha, const double* a, const double* b, double beta, double* c);
+const char* gemm_profile_path(void);
+int gemm_load_profile(const char* path);
+int gemm_save_profile(const char* path);
+void gemm_dgemm_batched(size_t batch, bool trans_a, bool trans_b, size_t m, size_t n, size_t k,
+                        double alpha, const double* a, size_t stride_a, const double* b, size_t stride_b,
+                        double beta, double* c, size_t stride_c);
+
+#endif // GEMM_H
@@ -0,0 +1,107 @@
+#include "gemm_tune.h"
+#include "parallel.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static const size_t block_n_candidates[] = {64, 128, 256, 512, 1024};
+static const size_t block_k_candidates[] = {16, 32, 64, 128, 256};
+static const size_t unroll_candidates[] = {1, 2, 4};
+
+typedef struct {
+    bool trans_a, trans_b;
+    size_t m, n, k;
+    const double* a;
+    const double* b;
+    double* c;
+    int reps;
+    size_t timed;
+} TuneJob;
+
+// Best of reps runs, in GFLOP/s
+static double time_params(TuneJob* job, const GemmParams* params) {
+    double best = 1e30;
+    for (int r = 0; r < job->reps; r++) {
+        double t0 = now_sec();
+        gemm_dgemm_blocked_params(params, job->trans_a, job->trans_b, job->m, job->n, job->k,
+                                  1.0, job->a, job->b, 0.0, job->c);
+        double dt = now_sec() - t0;
+        if (dt < best) best = dt;
+    }
+    job->timed++;
+    return best > 0.0 ? 2.0 * job->m * job->n * job->k / best / 1e9 : 0.0;
+}
+
+static void try_params(TuneJob* job, const GemmParams* cand, GemmParams* best, double* best_gflops) {
+    double g = time_params(job, cand);
+    if (g > *best_gflops) {
+        *best_gflops = g;
+        *best = *cand;
+    }
+}
+
+// Coordinate search instead of the full grid: tiles first with the default unroll on all
+// threads, then the unroll for the winning tiles, then the thread count. Tile sizes past the
+// matrix edge all behave the same, so only the first of them is timed.
+int gemm_tune_shape(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, int reps, GemmTuneResult* out) {
+    if (m == 0 || n == 0 || k == 0) return -1;
+    double* a = (double*)malloc(m * k * sizeof(double));
+    double* b = (double*)malloc(k * n * sizeof(double));
+    double* c = (double*)malloc(m * n * sizeof(double));
+    if (!a || !b || !c) {
+        free(a);
+        free(b);
+        free(c);
+        return -1;
+    }
+    unsigned seed = 1;
+    for (size_t i = 0; i < m * k; i++) a[i] = (double)((seed = seed * 1103515245u + 12345u) >> 16) / 65536.0 - 0.5;
+    for (size_t i = 0; i < k * n; i++) b[i] = (double)((seed = seed * 1103515245u + 12345u) >> 16) / 65536.0 - 0.5;
+
+    TuneJob job = {trans_a, trans_b, m, n, k, a, b, c, reps > 0 ? reps : 1, 0};
+    size_t max_threads = parallel_threads();
+
+    GemmParams best;
+    gemm_default_params(&best);
+    best.n_threads = max_threads;
+    double default_gflops = time_params(&job, &best);
+    double best_gflops = default_gflops;
+
+    GemmParams cand = best;
+    for (size_t i = 0; i < sizeof(block_n_candidates) / sizeof(block_n_candidates[0]); i++) {
+        if (i > 0 && block_n_candidates[i - 1] >= n) break;
+        for (size_t j = 0; j < sizeof(block_k_candidates) / sizeof(block_k_candidates[0]); j++) {
+            if (j > 0 && block_k_candidates[j - 1] >= k) break;
+            cand.block_n = block_n_candidates[i];
+            cand.block_k = block_k_candidates[j];
+            try_params(&job, &cand, &best, &best_gflops);
+        }
+    }
+
+    cand = best;
+    for (size_t i = 0; i < sizeof(unroll_candidates) / sizeof(unroll_candidates[0]); i++) {
+        if (unroll_candidates[i] == best.unroll || unroll_candidates[i] > m) continue;
+        cand.unroll = unroll_candidates[i];
+        try_params(&job, &cand, &best, &best_gflops);
+    }
+
+    // Powers of two below the core count; small products often lose to thread start-up
+    cand = best;
+    for (size_t t = 1; t < max_threads; t *= 2) {
+        cand.n_threads = t;
+        try_params(&job, &cand, &best, &best_gflops);
+    }
+
+    free(a);
+    free(b);
+    free(c);
+
+    if (gemm_set_params(trans_a, trans_b, m, n, k, &best) != 0) return -1;
+    if (out) {
+        out->params = best;
+        out->gflops = best_gflops;
+        out->default_gflops = default_gflops;
+        out->candidates = job.timed;
+    }
+    return 0;
+}
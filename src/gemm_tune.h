@@ -0,0 +1,18 @@
+// gemm_tune.h
+#ifndef GEMM_TUNE_H
+#define GEMM_TUNE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "gemm.h"
+
+typedef struct {
+    GemmParams params;            // Winner, also registered with gemm_set_params
+    double gflops;
+    double default_gflops;        // GEMM_BLOCK_N / GEMM_BLOCK_K / GEMM_UNROLL on all threads
+    size_t candidates;            // Configurations timed
+} GemmTuneResult;
+
+int gemm_tune_shape(bool trans_a, bool trans_b, size_t m, size_t n, size_t k, int reps, GemmTuneResult* out);
+
+#endif // GEMM_TUNE_H
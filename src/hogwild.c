@@ -0,0 +1,234 @@
+#include "hogwild.h"
+#include "parallel.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HOGWILD_MAX_CLASSES 16
+
+// Shared parameters are read and written without locks. Relaxed atomics make the races
+// well defined and still compile to plain loads and stores on x86.
+#define HW_LOAD(p) __extension__({ double v_; __atomic_load((p), &v_, __ATOMIC_RELAXED); v_; })
+#define HW_STORE(p, v) do { double v_ = (v); __atomic_store((p), &v_, __ATOMIC_RELAXED); } while (0)
+
+typedef struct {
+    double* w;
+    double* b;
+    const double* x;
+    const size_t* labels;
+    size_t n;
+    size_t classes;
+    size_t features;
+    HogwildConfig* config;
+    size_t updates;               // Summed with atomics when threads finish
+    double* partial;              // Per-thread loss sums
+    int failed;                   // Set with atomics by a thread that could not get its buffers
+} HogwildJob;
+
+static uint64_t xorshift64(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// Indices of the non-zero pixels, MNIST is ~80% zeros so updates only touch these
+static size_t nonzeros(const double* x, size_t features, uint16_t* idx) {
+    size_t nnz = 0;
+    for (size_t k = 0; k < features; k++) {
+        if (x[k] != 0.0) idx[nnz++] = (uint16_t)k;
+    }
+    return nnz;
+}
+
+static void scores_sparse(HogwildJob* job, const double* x, const uint16_t* idx, size_t nnz, double* scores) {
+    for (size_t c = 0; c < job->classes; c++) {
+        const double* wc = job->w + c * job->features;
+        double s = HW_LOAD(&job->b[c]);
+        for (size_t t = 0; t < nnz; t++) s += HW_LOAD(&wc[idx[t]]) * x[idx[t]];
+        scores[c] = s;
+    }
+}
+
+static void epoch_worker(size_t tid, size_t n_threads, void* arg) {
+    HogwildJob* job = (HogwildJob*)arg;
+    HogwildConfig* cfg = job->config;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->n, &lo, &hi);
+    if (hi <= lo) return;
+
+    size_t bs = cfg->batch_size;
+    size_t n_batches = (hi - lo + bs - 1) / bs;
+    size_t* order = (size_t*)malloc(n_batches * sizeof(size_t));
+    uint16_t* idx = (uint16_t*)malloc(bs * job->features * sizeof(uint16_t));
+    size_t* nnz = (size_t*)malloc(bs * sizeof(size_t));
+    double* dscores = (double*)malloc(bs * job->classes * sizeof(double));
+    if (!order || !idx || !nnz || !dscores) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        goto done;
+    }
+
+    // Each thread streams its own shard in a shuffled mini-batch order
+    uint64_t rng = cfg->seed * 0x9e3779b97f4a7c15ull + tid + 1;
+    for (size_t i = 0; i < n_batches; i++) order[i] = i;
+    for (size_t i = n_batches; i > 1; i--) {
+        size_t j = xorshift64(&rng) % i;
+        size_t tmp = order[i - 1];
+        order[i - 1] = order[j];
+        order[j] = tmp;
+    }
+
+    size_t updates = 0;
+    for (size_t bi = 0; bi < n_batches; bi++) {
+        size_t start = lo + order[bi] * bs;
+        size_t end = start + bs < hi ? start + bs : hi;
+        size_t m = end - start;
+
+        // SVM gradient of every sample against the current (possibly moving) weights
+        for (size_t s = 0; s < m; s++) {
+            const double* x = job->x + (start + s) * job->features;
+            uint16_t* ids = idx + s * job->features;
+            nnz[s] = nonzeros(x, job->features, ids);
+
+            double scores[HOGWILD_MAX_CLASSES];
+            scores_sparse(job, x, ids, nnz[s], scores);
+
+            double* ds = dscores + s * job->classes;
+            size_t yi = job->labels[start + s];
+            size_t count = 0;
+            for (size_t c = 0; c < job->classes; c++) {
+                ds[c] = 0.0;
+                if (c != yi && scores[c] - scores[yi] + 1.0 > 0.0) {
+                    ds[c] = 1.0;
+                    count++;
+                }
+            }
+            ds[yi] = -(double)count;
+        }
+
+        // Lock-free sparse update: only rows with a non-zero gradient, only non-zero pixels
+        double step = cfg->lr / (double)m;
+        for (size_t s = 0; s < m; s++) {
+            const double* x = job->x + (start + s) * job->features;
+            const uint16_t* ids = idx + s * job->features;
+            const double* ds = dscores + s * job->classes;
+            for (size_t c = 0; c < job->classes; c++) {
+                if (ds[c] == 0.0) continue;
+                double g = step * ds[c];
+                double* wc = job->w + c * job->features;
+                for (size_t t = 0; t < nnz[s]; t++) {
+                    double* p = &wc[ids[t]];
+                    HW_STORE(p, HW_LOAD(p) - g * x[ids[t]]);
+                }
+                HW_STORE(&job->b[c], HW_LOAD(&job->b[c]) - g);
+            }
+        }
+        updates++;
+    }
+    __atomic_fetch_add(&job->updates, updates, __ATOMIC_RELAXED);
+
+done:
+    free(order);
+    free(idx);
+    free(nnz);
+    free(dscores);
+}
+
+static int setup_job(HogwildJob* job, MDArray* weights, MDArray* biases, MDArray* images, const size_t* labels) {
+    if (weights->ndim != 2 || weights->shape[0] > HOGWILD_MAX_CLASSES || weights->shape[1] > UINT16_MAX + 1 ||
+        biases->total_size != weights->shape[0] || images->total_size / images->shape[0] != weights->shape[1]) {
+        printf("hogwild: weights, biases and images do not line up\n");
+        return -1;
+    }
+    memset(job, 0, sizeof(HogwildJob));
+    job->w = (double*)weights->data;
+    job->b = (double*)biases->data;
+    job->x = (const double*)images->data;
+    job->labels = labels;
+    job->n = images->shape[0];
+    job->classes = weights->shape[0];
+    job->features = weights->shape[1];
+    return 0;
+}
+
+// One asynchronous pass over the data, weights and biases are updated in place
+int hogwild_epoch(MDArray* weights, MDArray* biases, MDArray* images, const size_t* labels,
+                  HogwildConfig* config, HogwildStats* stats) {
+    HogwildJob job;
+    if (setup_job(&job, weights, biases, images, labels) != 0) return -1;
+    if (config->batch_size == 0) config->batch_size = 1;
+    if (config->n_threads == 0) config->n_threads = 1;
+    job.config = config;
+
+    double t0 = now_sec();
+    parallel_run(config->n_threads, epoch_worker, &job);
+    double dt = now_sec() - t0;
+    if (job.failed) {
+        printf("hogwild_epoch: out of memory in a worker thread, its shard was skipped\n");
+        return -1;
+    }
+
+    if (stats) {
+        stats->seconds = dt;
+        stats->images_per_sec = dt > 0.0 ? (double)job.n / dt : 0.0;
+        stats->updates = job.updates;
+    }
+    return 0;
+}
+
+static void loss_worker(size_t tid, size_t n_threads, void* arg) {
+    HogwildJob* job = (HogwildJob*)arg;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->n, &lo, &hi);
+
+    uint16_t* idx = (uint16_t*)malloc(job->features * sizeof(uint16_t));
+    if (!idx) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    double total = 0.0;
+    for (size_t j = lo; j < hi; j++) {
+        const double* x = job->x + j * job->features;
+        size_t nnz = nonzeros(x, job->features, idx);
+        double scores[HOGWILD_MAX_CLASSES];
+        scores_sparse(job, x, idx, nnz, scores);
+
+        size_t yi = job->labels[j];
+        for (size_t c = 0; c < job->classes; c++) {
+            double margin = scores[c] - scores[yi] + 1.0;
+            if (c != yi && margin > 0.0) total += margin;
+        }
+    }
+
+    job->partial[tid] = total;
+    free(idx);
+}
+
+// Mean multiclass SVM loss over all images, same definition as svm_loss
+double hogwild_svm_loss(MDArray* weights, MDArray* biases, MDArray* images, const size_t* labels,
+                        size_t n_threads) {
+    HogwildJob job;
+    if (setup_job(&job, weights, biases, images, labels) != 0) return -1.0;
+    if (n_threads == 0) n_threads = 1;
+
+    job.partial = (double*)calloc(n_threads, sizeof(double));
+    if (!job.partial) {
+        printf("hogwild_svm_loss: out of memory\n");
+        return -1.0;
+    }
+    parallel_run(n_threads, loss_worker, &job);
+
+    double total = 0.0;
+    for (size_t t = 0; t < n_threads; t++) total += job.partial[t];
+    free(job.partial);
+    if (job.failed) {
+        // A shard that was never scored would make the loss look lower than it is
+        printf("hogwild_svm_loss: out of memory in a worker thread\n");
+        return -1.0;
+    }
+    return total / (double)job.n;
+}
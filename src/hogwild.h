@@ -0,0 +1,27 @@
+// hogwild.h
+#ifndef HOGWILD_H
+#define HOGWILD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mdarray.h"
+
+typedef struct {
+    size_t n_threads;             // 1 gives plain sequential mini-batch SGD
+    size_t batch_size;
+    double lr;
+    uint64_t seed;                // Mini-batch order, mixed with the thread id
+} HogwildConfig;
+
+typedef struct {
+    double seconds;
+    double images_per_sec;
+    size_t updates;               // Mini-batch updates applied by all threads
+} HogwildStats;
+
+int hogwild_epoch(MDArray* weights, MDArray* biases, MDArray* images, const size_t* labels,
+                  HogwildConfig* config, HogwildStats* stats);
+double hogwild_svm_loss(MDArray* weights, MDArray* biases, MDArray* images, const size_t* labels,
+                        size_t n_threads);
+
+#endif // HOGWILD_H
@@ -0,0 +1,192 @@
+#include "image_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+// libjpeg's default error_exit calls exit(), which would take the whole trainer down from the
+// writer thread. This one jumps back into image_writer_encode, which fails the job instead.
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} WriterErrorMgr;
+
+static void writer_error_exit(j_common_ptr cinfo) {
+    WriterErrorMgr* err = (WriterErrorMgr*)cinfo->err;
+    char message[JMSG_LENGTH_MAX];
+    err->pub.format_message(cinfo, message);
+    fprintf(stderr, "image_writer: %s\n", message);
+    longjmp(err->jump, 1);
+}
+
+// Writes a grayscale canvas as a baseline JPEG. Returns -1, and removes the partial file,
+// when the file cannot be opened or libjpeg reports an error.
+int image_writer_encode(const unsigned char* pixels, size_t width, size_t height, int quality, const char* path) {
+    FILE* outfile = fopen(path, "wb");
+    if (!outfile) {
+        perror("Error opening file");
+        return -1;
+    }
+
+    struct jpeg_compress_struct cinfo;
+    WriterErrorMgr jerr;
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = writer_error_exit;
+    if (setjmp(jerr.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        fclose(outfile);
+        remove(path);
+        return -1;
+    }
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, outfile);
+
+    cinfo.image_width = (JDIMENSION)width;
+    cinfo.image_height = (JDIMENSION)height;
+    cinfo.input_components = 1;
+    cinfo.in_color_space = JCS_GRAYSCALE;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)&pixels[cinfo.next_scanline * width];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    fclose(outfile);
+    return 0;
+}
+
+static void* writer_main(void* arg) {
+    ImageWriter* w = (ImageWriter*)arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->stop && w->count == 0) pthread_cond_wait(&w->cond, &w->lock);
+        if (w->count == 0) break;
+
+        // Take the job out of the ring so encoding runs without the lock
+        ImageWriterJob job = w->jobs[w->head];
+        w->head = (w->head + 1) % w->capacity;
+        w->count--;
+        pthread_mutex_unlock(&w->lock);
+
+        int rc = image_writer_encode(job.pixels, job.width, job.height, job.quality, job.path);
+        free(job.pixels);
+
+        pthread_mutex_lock(&w->lock);
+        if (rc == 0) w->written++;
+        else w->failed++;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+ImageWriter* image_writer_start(size_t capacity) {
+    if (capacity == 0) return NULL;
+
+    ImageWriter* w = (ImageWriter*)calloc(1, sizeof(ImageWriter));
+    if (!w) return NULL;
+    w->jobs = (ImageWriterJob*)calloc(capacity, sizeof(ImageWriterJob));
+    if (!w->jobs) {
+        free(w);
+        return NULL;
+    }
+    w->capacity = capacity;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+    if (pthread_create(&w->thread, NULL, writer_main, w) != 0) {
+        printf("image_writer_start: could not start the writer thread\n");
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        free(w->jobs);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+// Queues samples [first, first + count) of a (N, H, W) tensor, tiled cols per row. Pixels are
+// copied straight from the buffer, float64 or uint8, so the tensor may be freed afterwards.
+// Returns -1 when the job was dropped.
+int image_writer_submit(ImageWriter* w, MDArray* imgs, size_t first, size_t count, size_t cols,
+                        int quality, const char* path) {
+    if (imgs->ndim != 3 || first + count > imgs->shape[0] || count == 0 ||
+        (imgs->itemsize != sizeof(double) && imgs->itemsize != 1)) {
+        printf("image_writer_submit: expected (N, H, W) float64 or uint8 images\n");
+        return -1;
+    }
+    if (strlen(path) >= IMAGE_WRITER_PATH_MAX) {
+        printf("image_writer_submit: path too long\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    bool full = w->count == w->capacity;
+    if (full) w->dropped++;
+    pthread_mutex_unlock(&w->lock);
+    if (full) return -1;
+
+    if (cols == 0 || cols > count) cols = count;
+    size_t rows = (count + cols - 1) / cols;
+    size_t h = imgs->shape[1], wd = imgs->shape[2];
+    size_t s0 = imgs->strides[0] * imgs->itemsize;
+    size_t s1 = imgs->strides[1] * imgs->itemsize;
+    size_t s2 = imgs->strides[2] * imgs->itemsize;
+
+    ImageWriterJob job;
+    job.width = cols * wd;
+    job.height = rows * h;
+    job.quality = quality;
+    strcpy(job.path, path);
+    job.pixels = (unsigned char*)calloc(job.width * job.height, 1);
+    if (!job.pixels) return -1;
+
+    const char* base = (const char*)imgs->data;
+    for (size_t i = 0; i < count; i++) {
+        size_t ty = (i / cols) * h, tx = (i % cols) * wd;
+        for (size_t y = 0; y < h; y++) {
+            unsigned char* dst = job.pixels + (ty + y) * job.width + tx;
+            const char* src = base + (first + i) * s0 + y * s1;
+            for (size_t x = 0; x < wd; x++) {
+                double v = imgs->itemsize == 1 ? (double)*(const unsigned char*)(src + x * s2)
+                                               : *(const double*)(src + x * s2);
+                dst[x] = v <= 0.0 ? 0 : v >= 255.0 ? 255 : (unsigned char)(v + 0.5);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&w->lock);
+    if (w->count == w->capacity) {
+        // The ring filled up while we were copying
+        w->dropped++;
+        pthread_mutex_unlock(&w->lock);
+        free(job.pixels);
+        return -1;
+    }
+    w->jobs[(w->head + w->count) % w->capacity] = job;
+    w->count++;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+// Encodes whatever is still queued, then joins the worker
+void image_writer_stop(ImageWriter* w) {
+    if (!w) return;
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    free(w->jobs);
+    free(w);
+}
@@ -0,0 +1,44 @@
+// image_writer.h
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "mdarray.h"
+
+#define IMAGE_WRITER_PATH_MAX 256
+
+// One JPEG to encode: samples already tiled into a grayscale canvas
+typedef struct {
+    unsigned char* pixels;        // height * width, owned by the job
+    size_t width;
+    size_t height;
+    int quality;
+    char path[IMAGE_WRITER_PATH_MAX];
+} ImageWriterJob;
+
+// Background JPEG encoder. Submitting copies the pixels into a bounded ring and returns
+// immediately; when the ring is full the job is dropped instead of waiting.
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    ImageWriterJob* jobs;         // Ring of capacity slots
+    size_t capacity;
+    size_t head;                  // Next job for the worker
+    size_t count;                 // Jobs queued
+    bool stop;
+
+    size_t written;
+    size_t dropped;
+    size_t failed;
+} ImageWriter;
+
+ImageWriter* image_writer_start(size_t capacity);
+int image_writer_submit(ImageWriter* w, MDArray* imgs, size_t first, size_t count, size_t cols,
+                        int quality, const char* path);
+void image_writer_stop(ImageWriter* w);
+int image_writer_encode(const unsigned char* pixels, size_t width, size_t height, int quality, const char* path);
+
+#endif // IMAGE_WRITER_H
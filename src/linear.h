@@ -1,6 +1,13 @@
+// linear.h
+#ifndef LINEAR_H
+#define LINEAR_H
+
 #include <stdio.h>
 #include <stdlib.h>
 #include "mdarray.h"
+#include "mdexpr.h"
+#include "mdsparse.h"
+#include "eval.h"
 
 // Structure to hold array metadata
 typedef struct {
@@ -21,15 +28,31 @@ LinearModel* linearmodel_new(MDArray* images, MDArray* labels) {
 
     size_t shape_w[] = {10, 28*28};
     model->weights = mdarray_create(2, shape_w, sizeof(double));
-    mdarray_randn(model->weights, 0.01);
-
     size_t shape_b[] = {10, 1};
     model->biases  = mdarray_create(2, shape_b, sizeof(double));
+    if (!model->weights || !model->biases) {
+        mdarray_free(model->weights);
+        mdarray_free(model->biases);
+        free(model);
+        return NULL;
+    }
+
+    mdarray_randn(model->weights, 0.01);
     mdarray_zeros(model->biases);
 
     return model;
 }
 
+// scores (10, N) += biases (10, 1), one fused mdexpr pass. svm_loss_backward builds its
+// margin mask the same way; the loss itself is a reduction, which mdexpr cannot express.
+int linearmodel_add_bias(LinearModel* model, MDArray* scores) {
+    MDExprGraph* g = mdexpr_graph_new();
+    if (!g) return -1;
+    int rc = mdexpr_eval_into(g, mdexpr_add(g, mdexpr_leaf(g, scores), mdexpr_leaf(g, model->biases)), scores);
+    mdexpr_graph_free(g);
+    return rc;
+}
+
 MDArray* linearmodel_forward(LinearModel* model) {
     size_t n = model->images->shape[0];
 
@@ -45,54 +68,91 @@ MDArray* linearmodel_forward(LinearModel* model) {
     MDArray* scores = mdarray_dot(model->weights, imgs_t);
     mdarray_free(imgs_t);
 
-    // Add biases (10, 1) broadcast to each column
-    for (size_t i = 0; i < 10; i++) {
-        size_t bias_idx[] = {i, 0};
-        double b = *(double*)mdarray_get_element(model->biases, bias_idx);
-        for (size_t j = 0; j < n; j++) {
-            size_t idx[] = {i, j};
-            double* s = (double*)mdarray_get_element(scores, idx);
-            double val = *s + b;
-            mdarray_set_element(scores, idx, &val);
-        }
+    // Add biases (10, 1) broadcast to each column, in place
+    if (!scores || linearmodel_add_bias(model, scores) != 0) {
+        mdarray_free(scores);
+        return NULL;
     }
-
     return scores;
 }
 
+// Predicted class of every image in out (N), argmax fused with the forward pass
+int linearmodel_predict(LinearModel* model, MDArray* images, size_t* out) {
+    return eval_predict(model->weights, model->biases, images, out);
+}
+
+// dscores = (scores - s_y + 1 > 0) / N as one fused mdexpr pass over (classes, N), s_y being
+// the (1, N) row of correct-class scores broadcast down the classes. Only the leaves are
+// read and only dscores is written. The correct-class entries are then set to -count / N.
 MDArray* svm_loss_backward(MDArray* scores, size_t* labels, size_t batch_size) {
     size_t num_classes = scores->shape[0];
     size_t shape[] = {num_classes, batch_size};
+    size_t shape_y[] = {1, batch_size};
     MDArray* dscores = mdarray_create(2, shape, sizeof(double));
-    mdarray_zeros(dscores);
+    MDArray* s_y = mdarray_create(2, shape_y, sizeof(double));
+    MDExprGraph* g = mdexpr_graph_new();
+    if (!dscores || !s_y || !g) goto fail;
+
+    const double* s = (const double*)scores->data;
+    double* sy = (double*)s_y->data;
+    for (size_t i = 0; i < batch_size; i++) sy[i] = s[labels[i] * batch_size + i];
+
+    MDExpr* margin = mdexpr_add(g, mdexpr_sub(g, mdexpr_leaf(g, scores), mdexpr_leaf(g, s_y)), mdexpr_scalar(g, 1.0));
+    MDExpr* grad = mdexpr_mul(g, mdexpr_gt(g, margin, mdexpr_scalar(g, 0.0)), mdexpr_scalar(g, 1.0 / batch_size));
+    if (mdexpr_eval_into(g, grad, dscores) != 0) goto fail;
 
+    double* ds = (double*)dscores->data;
     for (size_t i = 0; i < batch_size; i++) {
         size_t yi = labels[i];
-        size_t idx_correct[] = {yi, i};
-        double s_yi = *(double*)mdarray_get_element(scores, idx_correct);
+        size_t count = 0;
+        for (size_t j = 0; j < num_classes; j++) {
+            if (j != yi && ds[j * batch_size + i] != 0.0) count++;
+        }
+        ds[yi * batch_size + i] = -(double)count / batch_size;
+    }
+
+    mdexpr_graph_free(g);
+    mdarray_free(s_y);
+    return dscores;
 
+fail:
+    mdexpr_graph_free(g);
+    mdarray_free(s_y);
+    mdarray_free(dscores);
+    return NULL;
+}
+
+double svm_loss_grad(MDArray* scores, size_t* labels, size_t batch_size, MDArray* dscores) {
+    size_t num_classes = scores->shape[0];
+    const double* s = (const double*)scores->data;
+    double* ds = (double*)dscores->data;
+    double total_loss = 0.0;
+
+    for (size_t i = 0; i < batch_size; i++) {
+        size_t yi = labels[i];
+        double s_yi = s[yi * batch_size + i];
         size_t count = 0;
         for (size_t j = 0; j < num_classes; j++) {
-            if (j == yi) continue;
-            size_t idx_j[] = {j, i};
-            double s_j = *(double*)mdarray_get_element(scores, idx_j);
-            double margin = s_j - s_yi + 1.0;
-            if (margin > 0.0) {
-                double grad = 1.0 / batch_size;
-                mdarray_set_element(dscores, idx_j, &grad);
-                count++;
+            double grad = 0.0;
+            if (j != yi) {
+                double margin = s[j * batch_size + i] - s_yi + 1.0;
+                if (margin > 0.0) {
+                    total_loss += margin;
+                    grad = 1.0 / batch_size;
+                    count++;
+                }
             }
+            ds[j * batch_size + i] = grad;
         }
-
-        double neg_grad = -(double)count / batch_size;
-        mdarray_set_element(dscores, idx_correct, &neg_grad);
+        ds[yi * batch_size + i] = -(double)count / batch_size;
     }
 
-    return dscores;
+    return total_loss / batch_size;
 }
 
-void linearmodel_backward(LinearModel* model, MDArray* scores, size_t* labels, size_t batch_size, double lr) {
-    MDArray* dscores = svm_loss_backward(scores, labels, batch_size);
+// SGD step from the gradient at the scores (10, N), whichever loss produced it
+void linearmodel_backward_dscores(LinearModel* model, MDArray* dscores, double lr) {
+    size_t batch_size = dscores->shape[1];
 
     // Reconstruct X_t (784, N) from images, same as forward pass
     size_t n = model->images->shape[0];
@@ -131,8 +191,63 @@ void linearmodel_backward(LinearModel* model, MDArray* scores, size_t* labels, s
         }
     }
 
+    mdarray_free(dW);
+}
+
+void linearmodel_backward(LinearModel* model, MDArray* scores, size_t* labels, size_t batch_size, double lr) {
+    MDArray* dscores = svm_loss_backward(scores, labels, batch_size);
+    linearmodel_backward_dscores(model, dscores, lr);
+    mdarray_free(dscores);
+}
+
+// Same as linearmodel_forward with the images as an (N, 784) CSR matrix
+MDArray* linearmodel_forward_sparse(LinearModel* model, MDSparse* x) {
+    size_t shape[] = {model->weights->shape[0], x->rows};
+    MDArray* scores = mdarray_create(2, shape, sizeof(double));
+    if (!scores) return NULL;
+    if (mdsparse_dot_wxt(model->weights, x, scores) != 0) {
+        mdarray_free(scores);
+        return NULL;
+    }
+
+    if (linearmodel_add_bias(model, scores) != 0) {
+        mdarray_free(scores);
+        return NULL;
+    }
+    return scores;
+}
+
+// Same as linearmodel_backward, x is the CSC (or CSR) copy of the images. Returns -1, with
+// the model untouched, when the gradient cannot be computed.
+int linearmodel_backward_sparse(LinearModel* model, MDArray* scores, MDSparse* x, size_t* labels,
+                                size_t batch_size, double lr) {
+    MDArray* dscores = svm_loss_backward(scores, labels, batch_size);
+    MDArray* dW = dscores ? mdarray_create(2, model->weights->shape, sizeof(double)) : NULL;
+
+    // dW(10, 784) = dscores(10, N) * X(N, 784)
+    if (!dW || mdsparse_dot_dx(dscores, x, dW) != 0) {
+        printf("linearmodel_backward_sparse: could not compute the gradient\n");
+        mdarray_free(dscores);
+        mdarray_free(dW);
+        return -1;
+    }
+
+    size_t classes = dscores->shape[0];
+    const double* ds = (const double*)dscores->data;
+    double* b = (double*)model->biases->data;
+    for (size_t i = 0; i < classes; i++) {
+        double sum = 0.0;
+        for (size_t j = 0; j < batch_size; j++) sum += ds[i * batch_size + j];
+        b[i] -= lr * sum;
+    }
+
+    double* w = (double*)model->weights->data;
+    const double* dw = (const double*)dW->data;
+    for (size_t k = 0; k < model->weights->total_size; k++) w[k] -= lr * dw[k];
+
     mdarray_free(dscores);
     mdarray_free(dW);
+    return 0;
 }
 
 double svm_loss(MDArray* scores, size_t* labels, size_t batch_size) {
@@ -155,3 +270,5 @@ double svm_loss(MDArray* scores, size_t* labels, size_t batch_size) {
 
     return total_loss / batch_size;
 }
+
+#endif // LINEAR_H
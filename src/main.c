@@ -1,59 +1,35 @@
+#define _GNU_SOURCE
 #include <stdio.h>
-#include <jpeglib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <signal.h>
 #include <math.h>
 #include "mdarray.h"
 #include "linear.h"
+#include "server.h"
+#include "dataset_cache.h"
+#include "quant.h"
+#include "autograd.h"
+#include "mlp.h"
+#include "allreduce.h"
+#include "hogwild.h"
+#include "augment.h"
+#include "conv.h"
+#include "softmax.h"
+#include "parallel.h"
+#include "image_writer.h"
+#include "mdsparse.h"
+#include "mixed.h"
+#include "eval.h"
+#include "memory.h"
+#include "gemm_tune.h"
+#include "timing.h"
 
 #define IMG_SIZE 784
-
-void write_jpeg(MDArray* imgs) {
-    unsigned char grayscale_data[IMG_SIZE];
-    for (size_t x = 0; x < 28; x++) {
-        for (size_t y = 0; y < 28; y++) {
-            size_t idx[] = {0, x, y};
-            grayscale_data[x * 28 + y] = (unsigned char)*(double*)mdarray_get_element(imgs, idx);
-        }
-    }
-
-    // Set up libjpeg structures
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
-
-    // Open the output file
-    FILE *outfile = fopen("example.jpeg", "wb");
-    if (!outfile) {
-        perror("Error opening file");
-        return;
-    }
-    jpeg_stdio_dest(&cinfo, outfile);
-
-    // Set image parameters
-    cinfo.image_width = 28;       // Image width
-    cinfo.image_height = 28;      // Image height
-    cinfo.input_components = 1;   // Grayscale (1 channel)
-    cinfo.in_color_space = JCS_GRAYSCALE;
-
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, 100, TRUE); // Quality: 0-100
-    jpeg_start_compress(&cinfo, TRUE);
-
-    // Write the grayscale image row by row
-    while (cinfo.next_scanline < cinfo.image_height) {
-        JSAMPROW row_pointer[1];
-        row_pointer[0] = &grayscale_data[cinfo.next_scanline * 28];
-        //size_t idx[] = {0, cinfo.next_scanline, 0};
-        //row_pointer[0] = (unsigned char*)mdarray_get_element(imgs, idx);
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
-    }
-
-    // Finish compression and cleanup
-    jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
-    fclose(outfile);
-}
+#define MAX_HIDDEN 8                // Hidden layers accepted by --mlp
 
 int read_int(FILE* file) {
     unsigned char msb[4];
@@ -66,6 +42,19 @@ int read_int(FILE* file) {
     return out;
 }
 
+typedef struct {
+    const unsigned char* src;
+    double* dst;
+    size_t n;
+} ConvertJob;
+
+static void convert_worker(size_t tid, size_t n_threads, void* ctx) {
+    ConvertJob* job = (ConvertJob*)ctx;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->n, &lo, &hi);
+    for (size_t i = lo; i < hi; i++) job->dst[i] = (double)job->src[i];
+}
+
 MDArray* read_images(char* filename) {
     FILE *file = fopen(filename, "rb");
     if (file == NULL) {
@@ -87,24 +76,22 @@ MDArray* read_images(char* filename) {
     printf("Number images: %d\n", n_samples);
     printf("Image shape %dx%d\n", r_size, c_size);
 
-    unsigned char imgbytes[IMG_SIZE];
-    size_t bytes_read;
-
     size_t shape[] = {n_samples, r_size, c_size};
     MDArray* imgs = mdarray_create(3, shape, sizeof(double));
-    int index = 0;
+    unsigned char* bytes = (unsigned char*)malloc(imgs->total_size);
+    size_t bytes_read = bytes ? fread(bytes, 1, imgs->total_size, file) : 0;
+    if (bytes_read < imgs->total_size) {
+        printf("Short read: %zu of %zu pixels\n", bytes_read, imgs->total_size);
+        if (bytes) memset(bytes + bytes_read, 0, imgs->total_size - bytes_read);
+    }
 
-    while ((bytes_read = fread(imgbytes, 1, IMG_SIZE, file)) > 0) {
-        for (size_t i = 0; i < bytes_read; i++) {
-            size_t indices[] = {index, i/28, i%28};
-            unsigned char c = imgbytes[i];
-            double x = (double)c;
-            mdarray_set_element(imgs, indices, &x);
-        }
-        index++;
+    // Converted by all threads so each writes (and first-touches) the slice it will train on
+    if (bytes) {
+        ConvertJob job = {bytes, (double*)imgs->data, imgs->total_size};
+        parallel_run(parallel_threads(), convert_worker, &job);
+        free(bytes);
     }
 
-    write_jpeg(imgs);
     fclose(file);
 
     return imgs;
@@ -145,10 +132,766 @@ MDArray* read_labels(char* filename) {
     return labels;
 }
 
-int main() {
-    MDArray* images = read_images("../data/train-images.idx3-ubyte");
+// Runs the trained model on a batch coming from the inference server
+static MDArray* serve_forward(void* ctx, MDArray* batch) {
+    LinearModel* model = (LinearModel*)ctx;
+    MDArray* images = model->images;
+    model->images = batch;
+    MDArray* scores = linearmodel_forward(model);
+    model->images = images;
+    return scores;
+}
+
+static size_t argmax_column(MDArray* scores, size_t j) {
+    size_t best = 0;
+    for (size_t c = 1; c < scores->shape[0]; c++) {
+        size_t idx[] = {c, j}, best_idx[] = {best, j};
+        if (*(double*)mdarray_get_element(scores, idx) > *(double*)mdarray_get_element(scores, best_idx)) best = c;
+    }
+    return best;
+}
+
+// Checks the int8 path against the float forward pass on the training images
+static void compare_quantized(LinearModel* model, size_t* labels) {
+    QuantLinear* q = quant_linear_new(model->weights, model->biases);
+    MDArray* packed = quant_pack_inputs(model->images);
+    double t0 = now_sec();
+    MDArray* ref = q && packed ? linearmodel_forward(model) : NULL;
+    double t1 = now_sec();
+    MDArray* qscores = ref ? quant_linear_forward(q, packed) : NULL;
+    double t2 = now_sec();
+    if (!qscores) {
+        printf("Int8 comparison skipped: quantization or forward pass failed\n");
+        mdarray_free(ref);
+        mdarray_free(packed);
+        quant_linear_free(q);
+        return;
+    }
+
+    size_t n = ref->shape[1];
+    size_t agree = 0, correct_ref = 0, correct_q = 0;
+    for (size_t j = 0; j < n; j++) {
+        size_t a = argmax_column(ref, j);
+        size_t b = argmax_column(qscores, j);
+        agree += a == b;
+        correct_ref += a == labels[j];
+        correct_q += b == labels[j];
+    }
+
+    printf("Int8 forward (%s): %.2f%% argmax agreement, accuracy %.2f%% vs %.2f%% float64\n",
+           quant_kernel_name(), 100.0 * agree / n, 100.0 * correct_q / n, 100.0 * correct_ref / n);
+    printf("Float64 forward %.3f s, int8 forward %.3f s (%.1fx)\n", t1 - t0, t2 - t1, (t1 - t0) / (t2 - t1));
+
+    mdarray_free(ref);
+    mdarray_free(qscores);
+    mdarray_free(packed);
+    quant_linear_free(q);
+}
+
+// Same training loop driven by the autograd tape: recorded and planned once, replayed per step
+static int train_autograd(LinearModel* model, size_t* labels, int iters, double lr) {
+    size_t n = model->images->shape[0];
+    size_t shape_flat[] = {n, 784};
+    MDArray* imgs_flat = mdarray_resize(model->images, 2, shape_flat);
+    MDArray* x_t = imgs_flat ? mdarray_transpose_2d(imgs_flat) : NULL;
+    mdarray_free(imgs_flat);
+
+    AGTape* t = x_t ? ag_tape_new() : NULL;
+    if (!t) {
+        printf("Failed to allocate autograd tape\n");
+        mdarray_free(x_t);
+        return -1;
+    }
+    int x = ag_input(t, x_t);
+    int w = ag_param(t, model->weights);
+    int b = ag_param(t, model->biases);
+    ag_svm_loss(t, ag_add_bias(t, ag_matmul(t, w, x), b), labels);
+    if (ag_plan(t) != 0) {
+        printf("Failed to plan autograd tape\n");
+        ag_tape_free(t);
+        mdarray_free(x_t);
+        return -1;
+    }
+    printf("Autograd workspace %.2f MB (%.2f MB without reuse)\n",
+           t->workspace_size / 1e6, t->naive_size / 1e6);
+
+    for (int iter = 0; iter < iters; iter++) {
+        double loss = ag_forward(t);
+        printf("Iteration %d, SVM loss: %f\n", iter, loss);
+        ag_backward(t);
+        ag_sgd_step(t, lr);
+    }
+
+    ag_tape_free(t);
+    mdarray_free(x_t);
+    return 0;
+}
+
+static int train_mlp(MDArray* images, MDArray* labels, size_t* label_arr,
+                     size_t n_hidden, size_t* hidden, int iters, double lr) {
+    MLP* mlp = mlp_new(images, labels, n_hidden, hidden);
+    if (!mlp) {
+        printf("Could not allocate the MLP\n");
+        return -1;
+    }
+
+    size_t n = images->shape[0];
+    int status = 0;
+    for (int iter = 0; iter < iters; iter++) {
+        MDArray* scores = mlp_forward(mlp);
+        if (!scores) {
+            printf("Iteration %d, MLP forward pass failed\n", iter);
+            status = -1;
+            break;
+        }
+        double loss = svm_loss(scores, label_arr, n);
+        printf("Iteration %d, MLP SVM loss: %f\n", iter, loss);
+        if (mlp_backward(mlp, scores, label_arr, n, lr) != 0) {
+            printf("Iteration %d, MLP backward pass failed\n", iter);
+            status = -1;
+            break;
+        }
+    }
+
+    mlp_free(mlp);
+    return status;
+}
+
+// Pins the calling process to the rank-th group of share CPUs it is allowed to run on
+static void pin_to_cpus(size_t rank, size_t share, const cpu_set_t* allowed) {
+    size_t count = (size_t)CPU_COUNT(allowed);
+    if (count == 0 || share == 0) return;
+    size_t first = rank * share % count, seen = 0;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, allowed)) continue;
+        if (seen >= first && seen < first + share) CPU_SET(cpu, &set);
+        seen++;
+    }
+    sched_setaffinity(0, sizeof(set), &set);
+}
+
+// Data-parallel training: this process and n_workers - 1 forked children each own a
+// contiguous shard and sum their shard-weighted gradients with a ring allreduce. dW rows
+// are handed to the communication thread as soon as each one is computed.
+static int train_data_parallel(LinearModel* model, size_t* labels, size_t n_workers, int iters, double lr) {
+    size_t n = model->images->shape[0];
+    size_t classes = model->weights->shape[0];
+    size_t n_w = model->weights->total_size;
+    size_t n_b = model->biases->total_size;
+    size_t count = n_w + n_b + 1;  // dW | db | loss
+
+    AllreduceGroup* group = allreduce_group_new(n_workers, count);
+    if (!group) return -1;
+
+    // Rank 0 is this process, its affinity is restored once the children are gone
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+    }
+
+    // Each rank gets its share of the cores for GEMM and other parallel regions
+    size_t share = parallel_threads() / n_workers;
+    if (share == 0) share = 1;
+
+    fflush(stdout);
+    pid_t* pids = (pid_t*)calloc(n_workers, sizeof(pid_t));
+    if (!pids) {
+        allreduce_group_free(group);
+        return -1;
+    }
+    size_t rank = 0;
+    for (size_t r = 1; r < n_workers; r++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            // The ranks already forked would wait on the barrier forever
+            perror("fork");
+            for (size_t q = 1; q < r; q++) kill(pids[q], SIGKILL);
+            for (size_t q = 1; q < r; q++) waitpid(pids[q], NULL, 0);
+            free(pids);
+            allreduce_group_free(group);
+            return -1;
+        }
+        if (pid == 0) {
+            rank = r;
+            break;
+        }
+        pids[r] = pid;
+    }
+    pin_to_cpus(rank, share, &allowed);
+    parallel_set_budget(share);
+
+    // Copy the shard after pinning so its pages are first touched on this worker's node.
+    // Everything is allocated before the first collective, a rank that cannot start votes
+    // the whole group down instead of leaving the others on the barrier.
+    size_t lo = rank * n / n_workers, hi = (rank + 1) * n / n_workers, shard_n = hi - lo;
+    size_t shape[] = {shard_n, 28, 28};
+    MDArray* shard = mdarray_create(3, shape, sizeof(double));
+    double* grad = (double*)malloc(count * sizeof(double));
+    AllreduceStream* stream = grad ? allreduce_stream_start(group, rank, grad, classes + 1) : NULL;
+    int failed = allreduce_check(group, shard && grad && stream);
+    if (failed) printf("Rank %zu: data-parallel setup failed\n", rank);
+
+    MDArray* all_images = model->images;
+    if (shard) {
+        memcpy(shard->data, (double*)all_images->data + lo * IMG_SIZE, shard_n * IMG_SIZE * sizeof(double));
+        model->images = shard;
+    }
+    double weight = (double)shard_n / (double)n;
+    const double* x = shard ? (const double*)shard->data : NULL;
+
+    for (int iter = 0; iter < iters && !failed; iter++) {
+        double t0 = now_sec();
+        MDArray* scores = linearmodel_forward(model);
+        double loss = scores ? svm_loss(scores, labels + lo, shard_n) : -1.0;
+        MDArray* dscores = scores ? svm_loss_backward(scores, labels + lo, shard_n) : NULL;
+        if (allreduce_check(group, dscores != NULL) != 0) {
+            printf("Rank %zu: iteration %d failed\n", rank, iter);
+            mdarray_free(scores);
+            mdarray_free(dscores);
+            failed = 1;
+            break;
+        }
+        const double* ds = (const double*)dscores->data;
+
+        double* db = grad + n_w;
+        for (size_t i = 0; i < classes; i++) {
+            double sum = 0.0;
+            for (size_t j = 0; j < shard_n; j++) sum += ds[i * shard_n + j];
+            db[i] = weight * sum;
+        }
+        grad[n_w + n_b] = weight * loss;
+        allreduce_stream_post(stream, n_w, n_b + 1);
+
+        for (size_t i = 0; i < classes; i++) {
+            double* row = grad + i * IMG_SIZE;
+            memset(row, 0, IMG_SIZE * sizeof(double));
+            for (size_t j = 0; j < shard_n; j++) {
+                double d = weight * ds[i * shard_n + j];
+                if (d == 0.0) continue;
+                const double* xj = x + j * IMG_SIZE;
+                for (size_t k = 0; k < IMG_SIZE; k++) row[k] += d * xj[k];
+            }
+            allreduce_stream_post(stream, i * IMG_SIZE, IMG_SIZE);
+        }
+        allreduce_stream_wait(stream);
+
+        // Every rank applies the same summed gradient, so the replicas stay identical
+        double* w = (double*)model->weights->data;
+        double* b = (double*)model->biases->data;
+        for (size_t k = 0; k < n_w; k++) w[k] -= lr * grad[k];
+        for (size_t k = 0; k < n_b; k++) b[k] -= lr * db[k];
+
+        if (rank == 0) {
+            double dt = now_sec() - t0;
+            printf("Iteration %d, SVM loss: %f (%zu workers, %.0f images/s)\n",
+                   iter, grad[n_w + n_b], n_workers, (double)n / dt);
+        }
+        mdarray_free(scores);
+        mdarray_free(dscores);
+    }
+
+    allreduce_stream_stop(stream);
+    free(grad);
+    model->images = all_images;
+    mdarray_free(shard);
+
+    if (rank != 0) _exit(failed ? 1 : 0);
+    for (size_t r = 1; r < n_workers; r++) {
+        int wstatus;
+        if (waitpid(pids[r], &wstatus, 0) < 0 || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) failed = 1;
+    }
+    if (CPU_COUNT(&allowed) > 0) sched_setaffinity(0, sizeof(allowed), &allowed);
+    parallel_set_budget(0);
+    free(pids);
+    allreduce_group_free(group);
+    return failed ? -1 : 0;
+}
+
+// Hogwild: n_threads threads stream their own mini-batches into the shared weights without
+// locks. A 1-thread run from the same starting point is the synchronous reference.
+static int train_hogwild(LinearModel* model, size_t* labels, size_t n_threads, int epochs, double lr) {
+    size_t n = model->images->shape[0];
+    size_t shape_flat[] = {n, IMG_SIZE};
+    MDArray* w_sync = mdarray_create(2, model->weights->shape, sizeof(double));
+    MDArray* b_sync = mdarray_create(2, model->biases->shape, sizeof(double));
+    MDArray* x = mdarray_resize(model->images, 2, shape_flat);
+    if (!w_sync || !b_sync || !x) {
+        printf("Hogwild: out of memory for the synchronous reference\n");
+        mdarray_free(w_sync);
+        mdarray_free(b_sync);
+        mdarray_free(x);
+        return -1;
+    }
+    memcpy(w_sync->data, model->weights->data, model->weights->total_size * sizeof(double));
+    memcpy(b_sync->data, model->biases->data, model->biases->total_size * sizeof(double));
+
+    HogwildConfig async = {n_threads, 32, lr, 1};
+    HogwildConfig sync = {1, 32, lr, 1};
+    size_t eval_threads = parallel_threads();
+    int status = 0;
+    for (int epoch = 0; epoch < epochs; epoch++) {
+        HogwildStats sa, ss;
+        async.seed = sync.seed = (uint64_t)epoch + 1;
+        double la = -1.0, ls = -1.0;
+        if (hogwild_epoch(model->weights, model->biases, x, labels, &async, &sa) == 0 &&
+            hogwild_epoch(w_sync, b_sync, x, labels, &sync, &ss) == 0) {
+            la = hogwild_svm_loss(model->weights, model->biases, x, labels, eval_threads);
+            ls = la >= 0.0 ? hogwild_svm_loss(w_sync, b_sync, x, labels, eval_threads) : -1.0;
+        }
+        if (ls < 0.0) {
+            status = -1;
+            break;
+        }
+        printf("Epoch %d, SVM loss: %f hogwild (%zu threads, %.0f images/s), %f sync (%.0f images/s)\n",
+               epoch, la, n_threads, sa.images_per_sec, ls, ss.images_per_sec);
+    }
+
+    mdarray_free(x);
+    mdarray_free(w_sync);
+    mdarray_free(b_sync);
+    return status;
+}
+
+// Mini-batch SGD on warped copies of the training set, produced by worker threads while
+// the trainer runs the previous batch
+static int train_augmented(LinearModel* model, size_t* labels, size_t n_workers, int epochs, double lr) {
+    MDArray* clean = model->images;
+    size_t n = clean->shape[0];
+    uint8_t* pixels = (uint8_t*)malloc(n * AUGMENT_PIXELS);
+    if (!pixels) {
+        printf("Augmentation: out of memory for %zu source images\n", n);
+        return -1;
+    }
+    const double* src = (const double*)clean->data;
+    for (size_t i = 0; i < n * AUGMENT_PIXELS; i++) pixels[i] = (uint8_t)src[i];
+
+    size_t batch = 64;
+    AugmentConfig config = {2.0, 0.15, 0.1, 1.0, 1};
+    AugmentPipeline* p = augment_start(pixels, labels, n, batch, n_workers, &config);
+    if (!p) {
+        printf("Augmentation: failed to start the pipeline with %zu worker(s)\n", n_workers);
+        free(pixels);
+        return -1;
+    }
+    printf("Augmenting with %zu worker(s), %s sampling\n", p->n_workers, augment_kernel_name());
+
+    size_t steps = n / batch > 0 ? n / batch : 1;
+    int status = 0;
+    for (int epoch = 0; epoch < epochs && status == 0; epoch++) {
+        double t0 = now_sec(), total = 0.0;
+        for (size_t s = 0; s < steps; s++) {
+            AugmentSlot* slot = augment_next(p);
+            model->images = slot->images;
+            MDArray* scores = linearmodel_forward(model);
+            if (!scores) {
+                printf("Augmentation: forward pass failed at step %zu\n", s);
+                augment_release(p, slot);
+                status = -1;
+                break;
+            }
+            total += svm_loss(scores, slot->labels, batch);
+            linearmodel_backward(model, scores, slot->labels, batch, lr);
+            mdarray_free(scores);
+            augment_release(p, slot);
+        }
+        if (status != 0) break;
+        double dt = now_sec() - t0;
+        printf("Epoch %d, SVM loss: %f on augmented batches (%.0f images/s)\n",
+               epoch, total / (double)steps, dt > 0.0 ? (double)(steps * batch) / dt : 0.0);
+    }
+
+    model->images = clean;
+    augment_stop(p);
+    free(pixels);
+    return status;
+}
+
+// Small CNN: 3x3 conv with ReLU (filters channels), 2x2 max pool, then a linear SVM layer on
+// the pooled maps. Mini-batch SGD, one pass over the training set per epoch.
+static int train_cnn(MDArray* images, size_t* labels, size_t filters, int epochs, double lr) {
+    size_t n = images->shape[0], batch = 250;
+    size_t pooled = filters * (28 / 2) * (28 / 2);
+    size_t shape_wc[] = {filters, 1, 3, 3}, shape_bc[] = {filters, 1};
+    size_t shape_wf[] = {10, pooled}, shape_bf[] = {10, 1};
+    MDArray* wc = mdarray_create(4, shape_wc, sizeof(double));
+    MDArray* bc = mdarray_create(2, shape_bc, sizeof(double));
+    MDArray* wf = mdarray_create(2, shape_wf, sizeof(double));
+    MDArray* bf = mdarray_create(2, shape_bf, sizeof(double));
+    MDArray* dwc = mdarray_create(4, shape_wc, sizeof(double));
+    MDArray* dbc = mdarray_create(2, shape_bc, sizeof(double));
+    MDArray* dwf = mdarray_create(2, shape_wf, sizeof(double));
+    size_t* argmax = (size_t*)malloc(batch * pooled * sizeof(size_t));
+    int status = 0;
+    if (!wc || !bc || !wf || !bf || !dwc || !dbc || !dwf || !argmax) {
+        printf("CNN: out of memory for %zu filters\n", filters);
+        status = -1;
+        epochs = 0;
+    } else {
+        mdarray_randn(wc, 0.01);
+        mdarray_zeros(bc);
+        mdarray_randn(wf, 0.001);
+        mdarray_zeros(bf);
+        printf("CNN: %zu 3x3 filters, 2x2 max pool, linear %zu -> 10\n", filters, pooled);
+    }
+
+    ConvConfig conv = {1, 1, true};
+    for (int epoch = 0; epoch < epochs && status == 0; epoch++) {
+        double t0 = now_sec(), total = 0.0;
+        size_t steps = 0;
+        for (size_t lo = 0; lo + batch <= n; lo += batch) {
+            size_t shape_x[] = {batch, 28, 28}, shape_feat[] = {batch, pooled}, shape_s[] = {10, batch};
+            MDArray* x = mdarray_view(images, lo * IMG_SIZE, 3, shape_x);
+            MDArray* act = x ? conv2d_forward(x, wc, bc, &conv) : NULL;
+            MDArray* pool = act ? maxpool2d_forward(act, 2, 2, argmax) : NULL;
+            MDArray* feat = pool ? mdarray_resize(pool, 2, shape_feat) : NULL;
+            MDArray* scores = feat ? mdarray_create(2, shape_s, sizeof(double)) : NULL;
+            MDArray* dscores = scores ? mdarray_create(2, shape_s, sizeof(double)) : NULL;
+            MDArray* dfeat = dscores ? mdarray_create(2, shape_feat, sizeof(double)) : NULL;
+            MDArray* dpool = dfeat ? mdarray_resize(dfeat, 4, pool->shape) : NULL;
+            MDArray* dact = dpool ? mdarray_create(4, act->shape, sizeof(double)) : NULL;
+            double loss = -1.0;
+
+            if (dact && mdarray_dot_into(wf, false, feat, true, scores, 0.0) == 0) {
+                double* sv = (double*)scores->data;
+                for (size_t c = 0; c < 10; c++) {
+                    for (size_t i = 0; i < batch; i++) sv[c * batch + i] += ((double*)bf->data)[c];
+                }
+                loss = svm_loss_grad(scores, labels + lo, batch, dscores);
+            }
+            // Backward: linear layer, pool, conv; the first layer needs no input gradient
+            bool ok = loss >= 0.0 &&
+                      mdarray_dot_into(dscores, false, feat, false, dwf, 0.0) == 0 &&
+                      mdarray_dot_into(dscores, true, wf, false, dfeat, 0.0) == 0 &&
+                      maxpool2d_backward(dpool, argmax, dact) == 0 &&
+                      conv2d_backward(x, wc, act, dact, &conv, NULL, dwc, dbc) == 0;
+
+            if (ok) {
+                const double* ds = (const double*)dscores->data;
+                for (size_t c = 0; c < 10; c++) {
+                    double db = 0.0;
+                    for (size_t i = 0; i < batch; i++) db += ds[c * batch + i];
+                    ((double*)bf->data)[c] -= lr * db;
+                }
+                for (size_t i = 0; i < wf->total_size; i++) ((double*)wf->data)[i] -= lr * ((double*)dwf->data)[i];
+                for (size_t i = 0; i < wc->total_size; i++) ((double*)wc->data)[i] -= lr * ((double*)dwc->data)[i];
+                for (size_t i = 0; i < filters; i++) ((double*)bc->data)[i] -= lr * ((double*)dbc->data)[i];
+                total += loss;
+                steps++;
+            }
+
+            mdarray_free(dact);
+            mdarray_free(dpool);
+            mdarray_free(dfeat);
+            mdarray_free(dscores);
+            mdarray_free(scores);
+            mdarray_free(feat);
+            mdarray_free(pool);
+            mdarray_free(act);
+            mdarray_free(x);
+            if (!ok) {
+                printf("CNN: step at sample %zu failed, stopping\n", lo);
+                status = -1;
+                break;
+            }
+        }
+        if (status != 0) break;
+        double dt = now_sec() - t0;
+        printf("Epoch %d, CNN SVM loss: %f (%.0f images/s)\n", epoch, total / (double)(steps ? steps : 1),
+               dt > 0.0 ? (double)(steps * batch) / dt : 0.0);
+    }
+
+    free(argmax);
+    mdarray_free(wc);
+    mdarray_free(bc);
+    mdarray_free(wf);
+    mdarray_free(bf);
+    mdarray_free(dwc);
+    mdarray_free(dbc);
+    mdarray_free(dwf);
+    return status;
+}
+
+// Linear model on sparse images: CSR for the forward gather, CSC for the dW gather
+static int train_sparse(LinearModel* model, size_t* labels, int iters, double lr) {
+    double t0 = now_sec();
+    MDSparse* csr = mdsparse_from_dense(model->images);
+    MDSparse* csc = csr ? mdsparse_to_csc(csr) : NULL;
+    if (!csc) {
+        printf("Could not convert the images to sparse form\n");
+        mdsparse_free(csr);
+        return -1;
+    }
+    printf("Sparse images: %zu non-zeros, %.1f%% dense, converted in %.3f s\n",
+           csr->nnz, 100.0 * mdsparse_density(csr), now_sec() - t0);
+
+    size_t n = csr->rows;
+    int status = 0;
+    for (int iter = 0; iter < iters; iter++) {
+        double t1 = now_sec();
+        MDArray* scores = linearmodel_forward_sparse(model, csr);
+        if (!scores) {
+            printf("Iteration %d, sparse forward pass failed\n", iter);
+            status = -1;
+            break;
+        }
+        double loss = svm_loss(scores, labels, n);
+        int rc = linearmodel_backward_sparse(model, scores, csc, labels, n, lr);
+        mdarray_free(scores);
+        if (rc != 0) {
+            printf("Iteration %d, sparse backward pass failed\n", iter);
+            status = -1;
+            break;
+        }
+        printf("Iteration %d, SVM loss: %f (%.3f s)\n", iter, loss, now_sec() - t1);
+    }
+
+    mdsparse_free(csr);
+    mdsparse_free(csc);
+    return status;
+}
+
+// Float32 compute with float64 master weights, checked step by step against the float64
+// loop started from the same weights
+static int train_mixed(LinearModel* model, size_t* labels, int iters, double lr, bool bf16) {
+    MixedLinear* m = mixed_linear_new(model->images, model->weights->shape[0], bf16);
+    LinearModel* ref = m ? linearmodel_new(model->images, model->labels) : NULL;
+    if (!ref) {
+        printf("Could not allocate the mixed-precision model\n");
+        mixed_linear_free(m);
+        return -1;
+    }
+    memcpy(ref->weights->data, model->weights->data, model->weights->total_size * sizeof(double));
+    memcpy(ref->biases->data, model->biases->data, model->biases->total_size * sizeof(double));
+
+    size_t n = model->images->shape[0];
+    double max_rel = 0.0;
+    int status = 0;
+    printf("Mixed precision: float32 %s kernels, images stored as %s\n",
+           mixed_kernel_name(), bf16 ? "bfloat16" : "float32");
+    for (int iter = 0; iter < iters; iter++) {
+        double t0 = now_sec();
+        double loss = mixed_linear_step(m, model->weights, model->biases, labels, lr);
+        double t1 = now_sec();
+        if (loss < 0.0) {
+            printf("Iteration %d, mixed-precision step failed\n", iter);
+            status = -1;
+            break;
+        }
+
+        MDArray* scores = linearmodel_forward(ref);
+        if (!scores) {
+            printf("Iteration %d, float64 reference step failed\n", iter);
+            status = -1;
+            break;
+        }
+        double ref_loss = svm_loss(scores, labels, n);
+        linearmodel_backward(ref, scores, labels, n, lr);
+        mdarray_free(scores);
+        double t2 = now_sec();
+
+        double rel = fabs(loss - ref_loss) / (fabs(ref_loss) > 1e-12 ? fabs(ref_loss) : 1.0);
+        if (rel > max_rel) max_rel = rel;
+        printf("Iteration %d, SVM loss: %f mixed (%.3f s), %f float64 (%.3f s)\n",
+               iter, loss, t1 - t0, ref_loss, t2 - t1);
+    }
+    if (status == 0) {
+        printf("Loss parity: max relative difference %.2e (%s)\n", max_rel, max_rel < 1e-3 ? "ok" : "FAILED");
+    }
+
+    mdarray_free(ref->weights);
+    mdarray_free(ref->biases);
+    free(ref);
+    mixed_linear_free(m);
+    return status;
+}
+
+// Tunes the blocked GEMM for the products this run will issue and saves the profile
+static void autotune_gemm(size_t n, size_t n_hidden, const size_t* hidden) {
+    typedef struct {
+        bool trans_a, trans_b;
+        size_t m, n, k;
+    } Shape;
+    Shape shapes[2 + 8];
+    size_t count = 0;
+    if (n_hidden > 0) {
+        // MLP weight gradients dZ * X^T, the rest of its products have their own kernels
+        for (size_t l = 0; l <= n_hidden; l++) {
+            size_t in = l == 0 ? IMG_SIZE : hidden[l - 1];
+            size_t out = l == n_hidden ? 10 : hidden[l];
+            shapes[count++] = (Shape){false, true, out, in, n};
+        }
+    } else {
+        shapes[count++] = (Shape){false, false, 10, n, IMG_SIZE};     // Forward W * X^T
+        shapes[count++] = (Shape){false, false, 10, IMG_SIZE, n};     // Backward dS * X
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Shape* sh = &shapes[i];
+        GemmTuneResult r;
+        double t0 = now_sec();
+        if (gemm_tune_shape(sh->trans_a, sh->trans_b, sh->m, sh->n, sh->k, 3, &r) != 0) continue;
+        printf("GEMM %zux%zux%zu: block_n %zu, block_k %zu, unroll %zu, %zu threads, %.2f GFLOP/s (default %.2f), "
+               "%zu candidates in %.1f s\n", sh->m, sh->n, sh->k, r.params.block_n, r.params.block_k,
+               r.params.unroll, r.params.n_threads, r.gflops, r.default_gflops, r.candidates, now_sec() - t0);
+    }
+    if (gemm_save_profile(gemm_profile_path()) == 0) printf("GEMM profile written to %s\n", gemm_profile_path());
+}
+
+static int evaluate(EvalSet* set, LinearModel* model, const char* tag, bool confusion) {
+    EvalResult r;
+    if (eval_run(set, model->weights, model->biases, parallel_threads(), &r) != 0) return -1;
+    printf("%s test accuracy %.2f%% (%zu/%zu), %.0f images/s\n",
+           tag, 100.0 * r.accuracy, r.correct, r.n, r.images_per_sec);
+    if (confusion) eval_print_confusion(&r);
+    return 0;
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [--iters N] [--no-cache] [--autograd] [--mlp H1,H2,...] [--workers N] [--hogwild THREADS] [--augment WORKERS] [--cnn FILTERS] [--loss svm|softmax] [--sparse] [--mixed] [--bf16] [--eval] [--numa default|local|interleave|partitioned] [--hugepages MB] [--autotune] [--quantize] [--export-jpeg FILE] [--serve SOCKET] [--batch N] [--delay-ms MS]\n", prog);
+}
+
+int main(int argc, char** argv) {
+    ServerConfig serve = {NULL, 64, 2.0};
+    int iters = 100;
+    int use_cache = 1;
+    int quantize = 0;
+    int autograd = 0;
+    size_t hidden[MAX_HIDDEN];
+    size_t n_hidden = 0;
+    size_t workers = 1;
+    size_t hogwild = 0;
+    size_t augment = 0;
+    size_t cnn = 0;
+    int softmax = 0;
+    const char* export_path = NULL;
+    int sparse = 0;
+    int mixed = 0;
+    int bf16 = 0;
+    int eval = 0;
+    MDMemPolicy numa = MDMEM_DEFAULT;
+    size_t hugepage_mb = 0;
+    int autotune = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serve.socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            use_cache = 0;
+        } else if (strcmp(argv[i], "--quantize") == 0) {
+            quantize = 1;
+        } else if (strcmp(argv[i], "--sparse") == 0) {
+            sparse = 1;
+        } else if (strcmp(argv[i], "--mixed") == 0) {
+            mixed = 1;
+        } else if (strcmp(argv[i], "--bf16") == 0) {
+            // Implies --mixed
+            mixed = 1;
+            bf16 = 1;
+        } else if (strcmp(argv[i], "--numa") == 0 && i + 1 < argc) {
+            if (mdmem_policy_from_name(argv[++i], &numa) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hugepages") == 0 && i + 1 < argc) {
+            // Tensors of at least this many MB get MADV_HUGEPAGE
+            hugepage_mb = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--autotune") == 0) {
+            autotune = 1;
+        } else if (strcmp(argv[i], "--eval") == 0) {
+            eval = 1;
+        } else if (strcmp(argv[i], "--autograd") == 0) {
+            autograd = 1;
+        } else if (strcmp(argv[i], "--mlp") == 0 && i + 1 < argc) {
+            // Comma separated hidden layer widths, e.g. --mlp 128,64, at most MAX_HIDDEN of them
+            n_hidden = 0;
+            for (char* tok = strtok(argv[++i], ","); tok; tok = strtok(NULL, ",")) {
+                char* end;
+                unsigned long width = strtoul(tok, &end, 10);
+                if (n_hidden == MAX_HIDDEN || width == 0 || *end != '\0') {
+                    printf("--mlp takes 1 to %d positive widths\n", MAX_HIDDEN);
+                    usage(argv[0]);
+                    return 1;
+                }
+                hidden[n_hidden++] = width;
+            }
+            if (n_hidden == 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--hogwild") == 0 && i + 1 < argc) {
+            hogwild = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--augment") == 0 && i + 1 < argc) {
+            augment = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--loss") == 0 && i + 1 < argc) {
+            const char* loss = argv[++i];
+            if (strcmp(loss, "svm") != 0 && strcmp(loss, "softmax") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+            softmax = strcmp(loss, "softmax") == 0;
+        } else if (strcmp(argv[i], "--cnn") == 0 && i + 1 < argc) {
+            cnn = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--export-jpeg") == 0 && i + 1 < argc) {
+            export_path = argv[++i];
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            serve.max_batch = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--delay-ms") == 0 && i + 1 < argc) {
+            serve.max_delay_ms = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // --mlp and --cnn train their own models; the post-training steps only know LinearModel
+    bool linear_trained = autograd || (n_hidden == 0 && (workers > 1 || hogwild > 0 || augment > 0 || cnn == 0));
+    if (!linear_trained && (eval || quantize || serve.socket_path)) {
+        printf("--eval, --quantize and --serve need the linear model, not --mlp or --cnn\n");
+        usage(argv[0]);
+        return 1;
+    }
+    // Only the plain full-batch loop has a softmax path
+    bool default_loop = !autograd && n_hidden == 0 && workers <= 1 && hogwild == 0 && augment == 0 &&
+                        cnn == 0 && !mixed && !sparse;
+    if (softmax && !default_loop) {
+        printf("--loss softmax is only supported by the default full-batch trainer\n");
+        usage(argv[0]);
+        return 1;
+    }
+
+    mdmem_configure(numa, hugepage_mb << 20);
+    if (numa != MDMEM_DEFAULT || hugepage_mb) {
+        printf("Memory policy %s on %zu NUMA node(s), huge pages %s\n", mdmem_policy_name(numa),
+               mdmem_numa_nodes(), hugepage_mb ? "on" : "off");
+    }
+
+    int tuned = gemm_load_profile(gemm_profile_path());
+    if (tuned > 0) printf("Loaded %d tuned GEMM shapes from %s\n", tuned, gemm_profile_path());
+
+    // Raw uint8 pixels are cached next to the IDX file, mmapped on later runs and decoded
+    // to doubles with the cache's scale, an eighth of the disk and page cache of doubles
+    MDArray* images = NULL;
+    if (use_cache) {
+        DatasetCache* cache = dataset_cache_load("../data/train-images.idx3-ubyte", "../data/train-images.nncache", 1);
+        if (cache) images = dataset_cache_decode(cache);
+        dataset_cache_close(cache);
+    }
+    if (!images) images = read_images("../data/train-images.idx3-ubyte");
     MDArray* labels = read_labels("../data/train-labels.idx1-ubyte");
 
+    // The first 64 samples as an 8x8 grid, encoded while training runs
+    ImageWriter* writer = NULL;
+    if (export_path) {
+        writer = image_writer_start(4);
+        size_t count = images->shape[0] < 64 ? images->shape[0] : 64;
+        if (writer) image_writer_submit(writer, images, 0, count, 8, 100, export_path);
+        else printf("Could not start the JPEG writer, %s will not be written\n", export_path);
+    }
 
     LinearModel* model = linearmodel_new(images, labels);
 
@@ -159,14 +902,75 @@ int main() {
         label_arr[i] = (size_t)*(double*)mdarray_get_element(labels, idx);
     }
 
+    // t10k is streamed from disk, never loaded into an MDArray
+    EvalSet* test_set = NULL;
+    if (eval) {
+        test_set = eval_set_open("../data/t10k-images.idx3-ubyte", "../data/t10k-labels.idx1-ubyte");
+        if (!test_set) {
+            printf("--eval needs a valid t10k image and label set\n");
+            image_writer_stop(writer);
+            free(label_arr);
+            return 1;
+        }
+    }
+
+    if (autotune) autotune_gemm(n, n_hidden, hidden);
+
+    int status = 0;
     double lr = 1e-4;
-    for (int iter = 0; iter < 100; iter++) {
-        MDArray* scores = linearmodel_forward(model);
-        double loss = svm_loss(scores, label_arr, n);
-        printf("Iteration %d, SVM loss: %f\n", iter, loss);
-        linearmodel_backward(model, scores, label_arr, n, lr);
-        mdarray_free(scores);
+    if (autograd) {
+        if (train_autograd(model, label_arr, iters, lr) != 0) status = 1;
+    } else if (n_hidden > 0) {
+        if (train_mlp(images, labels, label_arr, n_hidden, hidden, iters, lr) != 0) status = 1;
+    } else if (workers > 1) {
+        if (train_data_parallel(model, label_arr, workers, iters, lr) != 0) {
+            printf("Data-parallel training with %zu workers failed\n", workers);
+            status = 1;
+        }
+    } else if (hogwild > 0) {
+        if (train_hogwild(model, label_arr, hogwild, iters, lr) != 0) status = 1;
+    } else if (augment > 0) {
+        if (train_augmented(model, label_arr, augment, iters, lr) != 0) status = 1;
+    } else if (cnn > 0) {
+        if (train_cnn(images, label_arr, cnn, iters, 1e-5) != 0) status = 1;
+    } else if (mixed) {
+        if (train_mixed(model, label_arr, iters, lr, bf16) != 0) status = 1;
+    } else if (sparse) {
+        if (train_sparse(model, label_arr, iters, lr) != 0) status = 1;
+    } else {
+        if (softmax) printf("Softmax cross-entropy, %s kernel\n", softmax_kernel_name());
+        for (int iter = 0; iter < iters; iter++) {
+            MDArray* scores = linearmodel_forward(model);
+            MDArray* dscores = scores ? mdarray_create(2, scores->shape, sizeof(double)) : NULL;
+            // Loss and gradient come out of the same pass over the scores
+            double loss = !dscores ? -1.0
+                        : softmax ? softmax_xent(scores, label_arr, n, dscores)
+                                  : svm_loss_grad(scores, label_arr, n, dscores);
+            if (loss < 0.0) {
+                // Neither loss is negative, so this is an error and dscores was never written
+                printf("Iteration %d failed\n", iter);
+                mdarray_free(dscores);
+                mdarray_free(scores);
+                status = 1;
+                break;
+            }
+            printf("Iteration %d, %s loss: %f\n", iter, softmax ? "softmax" : "SVM", loss);
+            linearmodel_backward_dscores(model, dscores, lr);
+            mdarray_free(dscores);
+            mdarray_free(scores);
+            if (test_set) evaluate(test_set, model, "Epoch", false);
+        }
+    }
+
+    if (test_set) {
+        if (evaluate(test_set, model, "Final", true) != 0) status = 1;
+        eval_set_close(test_set);
     }
 
+    if (quantize) compare_quantized(model, label_arr);
+    if (serve.socket_path) server_run(&serve, serve_forward, model);
+
+    image_writer_stop(writer);
     free(label_arr);
+    return status;
 }
@@ -1,16 +1,54 @@
 #include "mdarray.h"
+#include "gemm.h"
+#include "memory.h"
+#include "parallel.h"
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 
-MDArray* mdarray_create(size_t ndim, size_t* shape, size_t itemsize) {
+MDStorage* mdstorage_new(size_t size) {
+    MDStorage* storage = (MDStorage*)malloc(sizeof(MDStorage));
+    if (!storage) return NULL;
+    // Placement and huge pages follow mdmem_configure
+    storage->data = mdmem_alloc(size, &storage->mapped);
+    if (!storage->data) {
+        free(storage);
+        return NULL;
+    }
+    storage->size = size;
+    storage->refcount = 1;
+    return storage;
+}
+
+void mdstorage_retain(MDStorage* storage) {
+    if (storage) __atomic_fetch_add(&storage->refcount, 1, __ATOMIC_RELAXED);
+}
+
+// Frees the buffer when the last tensor or view lets go of it
+void mdstorage_release(MDStorage* storage) {
+    if (storage && __atomic_sub_fetch(&storage->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        mdmem_free(storage->data, storage->size, storage->mapped);
+        free(storage);
+    }
+}
+
+size_t mdstorage_refcount(MDStorage* storage) {
+    return storage ? __atomic_load_n(&storage->refcount, __ATOMIC_ACQUIRE) : 0;
+}
+
+// Header with contiguous strides and no data attached yet
+static MDArray* mdarray_header(size_t ndim, size_t* shape, size_t itemsize) {
     MDArray* arr = (MDArray*)malloc(sizeof(MDArray));
     if (!arr) return NULL;
 
     arr->ndim = ndim;
     arr->itemsize = itemsize;
+    arr->data = NULL;
+    arr->storage = NULL;
+    arr->owns_data = false;
 
     // Allocate and copy shape array
     arr->shape = (size_t*)malloc(ndim * sizeof(size_t));
@@ -39,26 +77,55 @@ MDArray* mdarray_create(size_t ndim, size_t* shape, size_t itemsize) {
         stride *= shape[i];
     }
 
+    return arr;
+}
+
+MDArray* mdarray_create(size_t ndim, size_t* shape, size_t itemsize) {
+    MDArray* arr = mdarray_header(ndim, shape, itemsize);
+    if (!arr) return NULL;
+
     // Allocate data array
-    arr->data = malloc(arr->total_size * itemsize);
-    if (!arr->data) {
-        free(arr->strides);
-        free(arr->shape);
-        free(arr);
+    arr->storage = mdstorage_new(arr->total_size * itemsize);
+    if (!arr->storage) {
+        mdarray_free(arr);
         return NULL;
     }
-
+    arr->data = arr->storage->data;
     arr->owns_data = true;
 
     return arr;
 }
 
+// Wraps an existing buffer without copying, the caller keeps ownership of data
+MDArray* mdarray_from_data(size_t ndim, size_t* shape, size_t itemsize, void* data) {
+    MDArray* arr = mdarray_header(ndim, shape, itemsize);
+    if (!arr) return NULL;
+    arr->data = data;
+    return arr;
+}
+
+// Zero-copy view of arr starting offset elements in, sharing (and retaining) its storage.
+// The view stays valid after arr is freed.
+MDArray* mdarray_view(MDArray* arr, size_t offset, size_t ndim, size_t* shape) {
+    if (!arr) return NULL;
+    MDArray* view = mdarray_header(ndim, shape, arr->itemsize);
+    if (!view) return NULL;
+    if (offset + view->total_size > arr->total_size) {
+        printf("mdarray_view: %zu elements at offset %zu do not fit in %zu\n",
+               view->total_size, offset, arr->total_size);
+        mdarray_free(view);
+        return NULL;
+    }
+
+    view->data = (char*)arr->data + offset * arr->itemsize;
+    view->storage = arr->storage;
+    mdstorage_retain(view->storage);
+    return view;
+}
 
 void mdarray_free(MDArray* arr) {
     if (arr) {
-        if (arr->owns_data) {
-            free(arr->data);
-        }
+        mdstorage_release(arr->storage);
         free(arr->shape);
         free(arr->strides);
         free(arr);
@@ -108,113 +175,194 @@ MDArray* mdarray_dot(MDArray* x, MDArray* y) {
 
     size_t shape[] = {x->shape[0], y->shape[1]};
     MDArray* out = mdarray_create(2, shape, sizeof(double));
-    for(size_t i = 0; i < x->shape[0]; i++) {
-        for(size_t k = 0; k < y->shape[1]; k++) {
-            double outval = 0;  // Reset for each element of output matrix
-            for(size_t j = 0; j < y->shape[0]; j++) {
-                size_t ix[] = {i, j};
-                size_t iy[] = {j, k};
-                double xval = *(double*) mdarray_get_element(x, ix);
-                double yval = *(double*) mdarray_get_element(y, iy);
-                outval += xval*yval;
-            }
-            size_t idx[] = {i, k};
-            mdarray_set_element(out, idx, &outval);  // Write after full sum is computed
-        }
-    }
+    if (!out) return NULL;
+
+    // Backend chosen by NNC_GEMM_BACKEND at configure time or NNC_GEMM at run time
+    gemm_dgemm(false, false, x->shape[0], y->shape[1], x->shape[1], 1.0,
+               (const double*)x->data, (const double*)y->data, 0.0, (double*)out->data);
 
     return out;
 }
 
+// mdarray_dot_into writes out = op(x) * op(y) + beta * out into an existing array,
+// op transposes its argument when the flag is set. Expects contiguous doubles. Example:
+// x       10xN  (trans_x = false)
+// y       784xN (trans_y = true)
+// out     10x784
+int mdarray_dot_into(MDArray* x, bool trans_x, MDArray* y, bool trans_y, MDArray* out, double beta) {
+    if (x->ndim != 2 || y->ndim != 2 || out->ndim != 2) {
+        printf("x, y and out must be 2-D\n");
+        return -1;
+    }
 
-MDArray* mdarray_copy(MDArray* arr, size_t ndim, size_t* start) {
-    MDArray* new_arr = (MDArray*)malloc(sizeof(MDArray));
-    if (!new_arr || !arr) return NULL;
+    size_t m = trans_x ? x->shape[1] : x->shape[0];
+    size_t k = trans_x ? x->shape[0] : x->shape[1];
+    size_t ky = trans_y ? y->shape[1] : y->shape[0];
+    size_t n = trans_y ? y->shape[0] : y->shape[1];
+    if (k != ky || out->shape[0] != m || out->shape[1] != n) {
+        printf("op(x) (%zux%zu) * op(y) (%zux%zu) does not fit out (%zux%zu)\n",
+               m, k, ky, n, out->shape[0], out->shape[1]);
+        return -1;
+    }
 
-    new_arr->ndim = arr->ndim - ndim;
-    new_arr->itemsize = arr->itemsize;
+    gemm_dgemm(trans_x, trans_y, m, n, k, 1.0, (const double*)x->data, (const double*)y->data,
+               beta, (double*)out->data);
 
-    // Allocate and copy shape array
-    new_arr->shape = (size_t*)malloc(new_arr->ndim * sizeof(size_t));
-    if (!arr->shape) {
-        free(arr);
-        return NULL;
-    }
+    return 0;
+}
 
-    memcpy(new_arr->shape, &arr->shape[ndim], new_arr->ndim * sizeof(size_t));
+// Fused products at least this many multiply-adds are split across parallel_run threads
+#define MDARRAY_PARALLEL_DOT (1u << 20)
 
-    // Calculate strides
-    new_arr->strides = (size_t*)malloc(new_arr->ndim * sizeof(size_t));
-    if (!new_arr->strides) {
-        free(new_arr->shape);
-        free(new_arr);
-        return NULL;
-    }
+static size_t dot_threads(size_t h, size_t k, size_t n, size_t units) {
+    size_t n_threads = (double)h * k * n < MDARRAY_PARALLEL_DOT ? 1 : parallel_threads();
+    return n_threads > units ? (units ? units : 1) : n_threads;
+}
 
-    new_arr->total_size = 1;
-    for (size_t i = 0; i < new_arr->ndim; i++) {
-        new_arr->total_size *= new_arr->shape[i];
+typedef struct {
+    size_t h, k, n;
+    const double* a;
+    const double* b;
+    const double* bias;
+    bool relu;
+    double* c;
+} DotBiasReluJob;
+
+// Each thread owns a range of MDARRAY_TILE-wide column tiles of out
+static void dot_bias_relu_worker(size_t tid, size_t n_threads, void* ctx) {
+    DotBiasReluJob* job = (DotBiasReluJob*)ctx;
+    size_t h = job->h, k = job->k, n = job->n;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, (n + MDARRAY_TILE - 1) / MDARRAY_TILE, &lo, &hi);
+    double acc[MDARRAY_TILE];
+
+    for (size_t j0 = lo * MDARRAY_TILE; j0 < n && j0 < hi * MDARRAY_TILE; j0 += MDARRAY_TILE) {
+        size_t len = n - j0 < MDARRAY_TILE ? n - j0 : MDARRAY_TILE;
+        for (size_t i = 0; i < h; i++) {
+            for (size_t j = 0; j < len; j++) acc[j] = job->bias[i];
+            for (size_t p = 0; p < k; p++) {
+                double aip = job->a[i * k + p];
+                const double* brow = job->b + p * n + j0;
+                for (size_t j = 0; j < len; j++) acc[j] += aip * brow[j];
+            }
+            double* crow = job->c + i * n + j0;
+            if (job->relu) {
+                for (size_t j = 0; j < len; j++) crow[j] = acc[j] > 0.0 ? acc[j] : 0.0;
+            } else {
+                for (size_t j = 0; j < len; j++) crow[j] = acc[j];
+            }
+        }
     }
+}
 
-    size_t stride = 1;
-    for (size_t i = new_arr->ndim - 1; i < new_arr->ndim; i--) {
-        new_arr->strides[i] = stride;
-        stride *= new_arr->shape[i];
+// mdarray_dot_bias_relu writes out = relu(w * x + bias) with the bias add and the ReLU
+// applied to each accumulator tile before it is stored, so out is written exactly once.
+// Column tiles are split across threads for large products.
+// w       HxK
+// x       KxN
+// bias    Hx1
+// out     HxN
+int mdarray_dot_bias_relu(MDArray* w, MDArray* x, MDArray* bias, bool relu, MDArray* out) {
+    size_t h = w->shape[0], k = w->shape[1], n = x->shape[1];
+    if (x->shape[0] != k || bias->total_size != h || out->shape[0] != h || out->shape[1] != n) {
+        printf("mdarray_dot_bias_relu: shapes do not line up\n");
+        return -1;
     }
 
-    size_t flat_index = 0;
-    for (size_t i = 0; i < ndim; i++) {
-        flat_index += start[i] * arr->strides[i]; // Find position in old array
-    }
+    DotBiasReluJob job = {h, k, n, (const double*)w->data, (const double*)x->data,
+                          (const double*)bias->data, relu, (double*)out->data};
+    size_t tiles = (n + MDARRAY_TILE - 1) / MDARRAY_TILE;
+    parallel_run(dot_threads(h, k, n, tiles), dot_bias_relu_worker, &job);
+    return 0;
+}
 
-    // Start pointer at given index
-    new_arr->data = &arr->data[flat_index];
-    if (!new_arr->data) {
-        free(new_arr->strides);
-        free(new_arr->shape);
-        free(new_arr);
-        return NULL;
+typedef struct {
+    size_t h, k, n;
+    const double* a;
+    const double* g;
+    const double* y;
+    double* c;
+    double* db;
+} DotTnReluGradJob;
+
+// Each thread owns a range of rows of out, and so the matching entries of dbias
+static void dot_tn_relu_grad_worker(size_t tid, size_t n_threads, void* ctx) {
+    DotTnReluGradJob* job = (DotTnReluGradJob*)ctx;
+    size_t h = job->h, k = job->k, n = job->n;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, k, &lo, &hi);
+    double acc[MDARRAY_TILE];
+
+    for (size_t i = lo; i < hi; i++) job->db[i] = 0.0;
+
+    for (size_t j0 = 0; j0 < n; j0 += MDARRAY_TILE) {
+        size_t len = n - j0 < MDARRAY_TILE ? n - j0 : MDARRAY_TILE;
+        for (size_t i = lo; i < hi; i++) {
+            for (size_t j = 0; j < len; j++) acc[j] = 0.0;
+            for (size_t p = 0; p < h; p++) {
+                double api = job->a[p * k + i];
+                const double* grow = job->g + p * n + j0;
+                for (size_t j = 0; j < len; j++) acc[j] += api * grow[j];
+            }
+            const double* yrow = job->y + i * n + j0;
+            double* crow = job->c + i * n + j0;
+            double sum = 0.0;
+            for (size_t j = 0; j < len; j++) {
+                double v = yrow[j] > 0.0 ? acc[j] : 0.0;
+                crow[j] = v;
+                sum += v;
+            }
+            job->db[i] += sum;
+        }
     }
+}
 
-    new_arr->owns_data = false;
+// mdarray_dot_tn_relu_grad is the backward of a hidden layer: out = (w^T * dz) masked by
+// act > 0, with dbias = row sums of out reduced from the same tile before it is stored.
+// Rows of out are split across threads for large products, so every dbias entry is still
+// summed by one thread in tile order.
+// w       HxK   (weights of the next layer)
+// dz      HxN   (gradient at the next layer's pre-activation)
+// act     KxN   (this layer's ReLU output)
+// out     KxN,  dbias Kx1
+int mdarray_dot_tn_relu_grad(MDArray* w, MDArray* dz, MDArray* act, MDArray* out, MDArray* dbias) {
+    size_t h = w->shape[0], k = w->shape[1], n = dz->shape[1];
+    if (dz->shape[0] != h || act->shape[0] != k || act->shape[1] != n ||
+        out->shape[0] != k || out->shape[1] != n || dbias->total_size != k) {
+        printf("mdarray_dot_tn_relu_grad: shapes do not line up\n");
+        return -1;
+    }
 
-    return new_arr;
+    DotTnReluGradJob job = {h, k, n, (const double*)w->data, (const double*)dz->data,
+                            (const double*)act->data, (double*)out->data, (double*)dbias->data};
+    parallel_run(dot_threads(h, k, n, k), dot_tn_relu_grad_worker, &job);
+    return 0;
 }
 
-MDArray* mdarray_resize(MDArray* arr, size_t ndim, size_t* shape) {
-    MDArray* new_arr = (MDArray*)malloc(sizeof(MDArray));
-    if(!new_arr) return NULL;
 
-    new_arr->ndim = ndim;
-    new_arr->itemsize = arr->itemsize;
-    new_arr->total_size = arr->total_size;
+// Sub-array at index start[0..ndim), e.g. one image of a (N, 28, 28) batch for ndim = 1.
+// Zero-copy: the result shares arr's storage rather than duplicating it.
+MDArray* mdarray_copy(MDArray* arr, size_t ndim, size_t* start) {
+    if (!arr || ndim >= arr->ndim) return NULL;
 
-    // Allocate and copy shape array
-    new_arr->shape = (size_t*)malloc(ndim * sizeof(size_t));
-    if (!arr->shape) {
-        free(arr);
-        return NULL;
+    size_t flat_index = 0;
+    for (size_t i = 0; i < ndim; i++) {
+        if (start[i] >= arr->shape[i]) return NULL;
+        flat_index += start[i] * arr->strides[i]; // Find position in old array
     }
-    memcpy(new_arr->shape, shape, ndim * sizeof(size_t));
 
-    // Calculate strides
-    new_arr->strides = (size_t*)malloc(ndim * sizeof(size_t));
-    if (!new_arr->strides) {
-        free(new_arr->shape);
-        free(new_arr);
-        return NULL;
-    }
+    return mdarray_view(arr, flat_index, arr->ndim - ndim, &arr->shape[ndim]);
+}
 
-    size_t stride = 1;
-    for (size_t i = ndim - 1; i < ndim; i--) {
-        new_arr->strides[i] = stride;
-        stride *= shape[i];
+// Same elements under a new shape, sharing storage
+MDArray* mdarray_resize(MDArray* arr, size_t ndim, size_t* shape) {
+    size_t total = 1;
+    for (size_t i = 0; i < ndim; i++) total *= shape[i];
+    if (total != arr->total_size) {
+        printf("mdarray_resize: %zu elements cannot be viewed as %zu\n", arr->total_size, total);
+        return NULL;
     }
-
-    new_arr->data = arr->data;
-    new_arr->owns_data = false;
-
-    return new_arr;
+    return mdarray_view(arr, 0, ndim, shape);
 }
 
 MDArray* mdarray_sum(MDArray* a, MDArray* b) {
@@ -230,35 +378,94 @@ MDArray* mdarray_sum(MDArray* a, MDArray* b) {
 }
 
 
+// Arrays at least this large are filled by parallel_run threads, which also makes the fill
+// the first touch of each thread's slice
+#define MDARRAY_PARALLEL_FILL (1u << 16)
 
-void mdarray_ones(MDArray* arr) {
-    for(size_t i = 0; i < arr->total_size; i++) {
-        double x = 1;
-        memcpy((char*)arr->data + (i * arr->itemsize), &x, arr->itemsize);
+typedef struct {
+    MDArray* arr;
+    double value;
+} FillJob;
+
+static void fill_worker(size_t tid, size_t n_threads, void* ctx) {
+    FillJob* job = (FillJob*)ctx;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->arr->total_size, &lo, &hi);
+    for (size_t i = lo; i < hi; i++) {
+        memcpy((char*)job->arr->data + (i * job->arr->itemsize), &job->value, job->arr->itemsize);
     }
 }
 
+void mdarray_fill(MDArray* arr, double value) {
+    FillJob job = {arr, value};
+    size_t n_threads = arr->total_size >= MDARRAY_PARALLEL_FILL ? parallel_threads() : 1;
+    parallel_run(n_threads, fill_worker, &job);
+}
+
+void mdarray_ones(MDArray* arr) {
+    mdarray_fill(arr, 1.0);
+}
+
 void mdarray_zeros(MDArray* arr) {
-    for(size_t i = 0; i < arr->total_size; i++) {
-        double x = 0;
-        memcpy((char*)arr->data + (i * arr->itemsize), &x, arr->itemsize);
-    }
+    mdarray_fill(arr, 0.0);
 }
 
-void mdarray_randn(MDArray* arr, double scale) {
-    // Box-Muller transform: pairs of uniform randoms -> normal distribution
-    for (size_t i = 0; i < arr->total_size; i += 2) {
-        double u1 = ((double)rand() + 1.0) / ((double)RAND_MAX + 1.0);
-        double u2 = ((double)rand() + 1.0) / ((double)RAND_MAX + 1.0);
-        double z0 = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2) * scale;
-        double z1 = sqrt(-2.0 * log(u1)) * sin(2.0 * M_PI * u2) * scale;
-        memcpy((char*)arr->data + (i * arr->itemsize), &z0, arr->itemsize);
-        if (i + 1 < arr->total_size) {
-            memcpy((char*)arr->data + ((i + 1) * arr->itemsize), &z1, arr->itemsize);
+// Elements per independently seeded stream. Even, so Box-Muller pairs never straddle two.
+#define MDARRAY_RANDN_BLOCK 4096
+
+typedef struct {
+    MDArray* arr;
+    double scale;
+    uint64_t seed;
+} RandnJob;
+
+// splitmix64: cheap, stateless to seed, and good enough for weight initialisation
+static uint64_t splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// Uniform in (0, 1], so log() below never sees 0
+static double uniform_open(uint64_t* state) {
+    return ((double)(splitmix64(state) >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+}
+
+static void randn_worker(size_t tid, size_t n_threads, void* ctx) {
+    RandnJob* job = (RandnJob*)ctx;
+    MDArray* arr = job->arr;
+    size_t n_blocks = (arr->total_size + MDARRAY_RANDN_BLOCK - 1) / MDARRAY_RANDN_BLOCK;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, n_blocks, &lo, &hi);
+    for (size_t b = lo; b < hi; b++) {
+        uint64_t state = job->seed ^ ((uint64_t)b * 0xD1B54A32D192ED03ull);
+        size_t end = (b + 1) * MDARRAY_RANDN_BLOCK;
+        if (end > arr->total_size) end = arr->total_size;
+        // Box-Muller transform: pairs of uniform randoms -> normal distribution
+        for (size_t i = b * MDARRAY_RANDN_BLOCK; i < end; i += 2) {
+            double u1 = uniform_open(&state);
+            double u2 = uniform_open(&state);
+            double z0 = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2) * job->scale;
+            double z1 = sqrt(-2.0 * log(u1)) * sin(2.0 * M_PI * u2) * job->scale;
+            memcpy((char*)arr->data + (i * arr->itemsize), &z0, arr->itemsize);
+            if (i + 1 < end) {
+                memcpy((char*)arr->data + ((i + 1) * arr->itemsize), &z1, arr->itemsize);
+            }
         }
     }
 }
 
+// Each MDARRAY_RANDN_BLOCK gets its own stream seeded from (seed, block), so large tensors are
+// filled, and first touched, by the threads that own their slices while the values depend only
+// on srand() and never on the thread count. The seed is drawn from rand().
+void mdarray_randn(MDArray* arr, double scale) {
+    uint64_t seed = ((uint64_t)rand() << 32) ^ (uint64_t)rand();
+    RandnJob job = {arr, scale, seed};
+    size_t n_threads = arr->total_size >= MDARRAY_PARALLEL_FILL ? parallel_threads() : 1;
+    parallel_run(n_threads, randn_worker, &job);
+}
+
 MDArray* mdarray_transpose_2d(MDArray* arr) {
     if (!arr || arr->ndim != 2) return NULL;
 
@@ -284,36 +491,5 @@ MDArray* mdarray_get(MDArray* arr, size_t index) {
     if (!arr || index >= arr->shape[0]) return NULL;
     if (arr->ndim == 1) return NULL;
 
-    size_t new_ndim = arr->ndim - 1;
-
-    MDArray* view = (MDArray*)malloc(sizeof(MDArray));
-    if (!view) return NULL;
-
-    view->ndim = new_ndim;
-    view->itemsize = arr->itemsize;
-    view->owns_data = false;
-
-    view->shape = (size_t*)malloc(new_ndim * sizeof(size_t));
-    if (!view->shape) {
-        free(view);
-        return NULL;
-    }
-    memcpy(view->shape, &arr->shape[1], new_ndim * sizeof(size_t));
-
-    view->strides = (size_t*)malloc(new_ndim * sizeof(size_t));
-    if (!view->strides) {
-        free(view->shape);
-        free(view);
-        return NULL;
-    }
-    memcpy(view->strides, &arr->strides[1], new_ndim * sizeof(size_t));
-
-    view->total_size = 1;
-    for (size_t i = 0; i < new_ndim; i++) {
-        view->total_size *= view->shape[i];
-    }
-
-    view->data = (char*)arr->data + (index * arr->strides[0] * arr->itemsize);
-
-    return view;
-}
\ No newline at end of file
+    return mdarray_view(arr, index * arr->strides[0], arr->ndim - 1, &arr->shape[1]);
+}
@@ -5,6 +5,16 @@
 #include <stdio.h>
 #include <stdbool.h>
 
+#define MDARRAY_TILE 256          // Output columns a fused GEMM keeps in a local accumulator
+
+// Heap buffer shared by a tensor and all of its views, freed when the last one is freed
+typedef struct {
+    void* data;
+    size_t size;          // Bytes
+    size_t refcount;      // Updated atomically, views may be freed from any thread
+    bool mapped;          // Allocated by mdmem_alloc as a mapping rather than malloc
+} MDStorage;
+
 // Structure to hold array metadata
 typedef struct {
     void* data;           // Pointer to contiguous data
@@ -13,15 +23,27 @@ typedef struct {
     size_t ndim;          // Number of dimensions
     size_t itemsize;      // Size of each element in bytes
     size_t total_size;    // Total number of elements
-    bool owns_data;       // Whether this array owns its data buffer
+    bool owns_data;       // Whether this array allocated its buffer (false for views)
+    MDStorage* storage;   // Shared buffer behind data, NULL when the data is borrowed
 } MDArray;
 
+MDStorage* mdstorage_new(size_t size);
+void mdstorage_retain(MDStorage* storage);
+void mdstorage_release(MDStorage* storage);
+size_t mdstorage_refcount(MDStorage* storage);
+
 MDArray* mdarray_create(size_t ndim, size_t* shape, size_t itemsize);
+MDArray* mdarray_from_data(size_t ndim, size_t* shape, size_t itemsize, void* data);
+MDArray* mdarray_view(MDArray* arr, size_t offset, size_t ndim, size_t* shape);
 void mdarray_free(MDArray* arr);
 void* mdarray_get_element(MDArray* arr, size_t* indices);
 void mdarray_set_element(MDArray* arr, size_t* indices, void* value);
 size_t mdarray_calculate_index(MDArray* arr, size_t* indices);
 MDArray* mdarray_dot(MDArray* x, MDArray* y);
+int mdarray_dot_into(MDArray* x, bool trans_x, MDArray* y, bool trans_y, MDArray* out, double beta);
+int mdarray_dot_bias_relu(MDArray* w, MDArray* x, MDArray* bias, bool relu, MDArray* out);
+int mdarray_dot_tn_relu_grad(MDArray* w, MDArray* dz, MDArray* act, MDArray* out, MDArray* dbias);
+void mdarray_fill(MDArray* arr, double value);
 void mdarray_ones(MDArray* arr);
 void mdarray_zeros(MDArray* arr);
 void mdarray_randn(MDArray* arr, double scale);
@@ -0,0 +1,225 @@
+#include "mdexpr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Where an instruction reads its input for the current tile
+typedef struct {
+    const double* ptr;
+    size_t stride;                // 0 when the value is broadcast along the tile
+} Operand;
+
+MDExprGraph* mdexpr_graph_new(void) {
+    MDExprGraph* g = (MDExprGraph*)malloc(sizeof(MDExprGraph));
+    if (!g) return NULL;
+    g->nodes = NULL;
+    return g;
+}
+
+void mdexpr_graph_free(MDExprGraph* g) {
+    if (g) {
+        MDExpr* e = g->nodes;
+        while (e) {
+            MDExpr* next = e->next;
+            free(e);
+            e = next;
+        }
+        free(g);
+    }
+}
+
+static MDExpr* new_node(MDExprGraph* g, MDExprOp op) {
+    if (!g) return NULL;
+    MDExpr* e = (MDExpr*)calloc(1, sizeof(MDExpr));
+    if (!e) return NULL;
+    e->op = op;
+    e->slot = -1;
+    e->next = g->nodes;
+    g->nodes = e;
+    return e;
+}
+
+MDExpr* mdexpr_leaf(MDExprGraph* g, MDArray* arr) {
+    if (!arr || arr->ndim == 0 || arr->ndim > 2 || arr->itemsize != sizeof(double)) {
+        printf("mdexpr_leaf expects a 1-D or 2-D double array\n");
+        return NULL;
+    }
+
+    MDExpr* e = new_node(g, MDEXPR_LEAF);
+    if (!e) return NULL;
+    e->leaf = arr;
+    // 1-D arrays broadcast as a single row, like numpy
+    e->shape[0] = arr->ndim == 2 ? arr->shape[0] : 1;
+    e->shape[1] = arr->ndim == 2 ? arr->shape[1] : arr->shape[0];
+    return e;
+}
+
+MDExpr* mdexpr_scalar(MDExprGraph* g, double value) {
+    MDExpr* e = new_node(g, MDEXPR_SCALAR);
+    if (!e) return NULL;
+    e->scalar = value;
+    e->shape[0] = 1;
+    e->shape[1] = 1;
+    return e;
+}
+
+static int broadcast_dim(size_t a, size_t b, size_t* out) {
+    if (a == b || b == 1) *out = a;
+    else if (a == 1) *out = b;
+    else return -1;
+    return 0;
+}
+
+static MDExpr* binary(MDExprGraph* g, MDExprOp op, MDExpr* a, MDExpr* b) {
+    if (!a || !b) return NULL;
+
+    size_t shape[2];
+    if (broadcast_dim(a->shape[0], b->shape[0], &shape[0]) < 0 ||
+        broadcast_dim(a->shape[1], b->shape[1], &shape[1]) < 0) {
+        printf("Cannot broadcast (%zu, %zu) with (%zu, %zu)\n",
+               a->shape[0], a->shape[1], b->shape[0], b->shape[1]);
+        return NULL;
+    }
+
+    MDExpr* e = new_node(g, op);
+    if (!e) return NULL;
+    e->lhs = a;
+    e->rhs = b;
+    e->shape[0] = shape[0];
+    e->shape[1] = shape[1];
+    return e;
+}
+
+MDExpr* mdexpr_add(MDExprGraph* g, MDExpr* a, MDExpr* b) { return binary(g, MDEXPR_ADD, a, b); }
+MDExpr* mdexpr_sub(MDExprGraph* g, MDExpr* a, MDExpr* b) { return binary(g, MDEXPR_SUB, a, b); }
+MDExpr* mdexpr_mul(MDExprGraph* g, MDExpr* a, MDExpr* b) { return binary(g, MDEXPR_MUL, a, b); }
+MDExpr* mdexpr_max(MDExprGraph* g, MDExpr* a, MDExpr* b) { return binary(g, MDEXPR_MAX, a, b); }
+MDExpr* mdexpr_min(MDExprGraph* g, MDExpr* a, MDExpr* b) { return binary(g, MDEXPR_MIN, a, b); }
+MDExpr* mdexpr_gt(MDExprGraph* g, MDExpr* a, MDExpr* b) { return binary(g, MDEXPR_GT, a, b); }
+
+// Post-order walk, every operation node appears once after its inputs
+static size_t schedule(MDExpr* e, MDExpr** order, size_t n, int* slots) {
+    if (e->slot != -1) return n;
+    if (e->op == MDEXPR_LEAF || e->op == MDEXPR_SCALAR) {
+        e->slot = -2;
+        return n;
+    }
+    n = schedule(e->lhs, order, n, slots);
+    n = schedule(e->rhs, order, n, slots);
+    e->slot = (*slots)++;
+    order[n++] = e;
+    return n;
+}
+
+static Operand operand(MDExpr* e, double* tiles, size_t r, size_t c0, size_t len) {
+    Operand o;
+    o.stride = (e->shape[1] == 1 && len > 1) ? 0 : 1;
+
+    if (e->op == MDEXPR_LEAF) {
+        size_t rr = e->shape[0] == 1 ? 0 : r;
+        size_t cc = e->shape[1] == 1 ? 0 : c0;
+        o.ptr = (const double*)e->leaf->data + rr * e->shape[1] + cc;
+    } else if (e->op == MDEXPR_SCALAR) {
+        o.ptr = &e->scalar;
+        o.stride = 0;
+    } else {
+        o.ptr = tiles + (size_t)e->slot * MDEXPR_TILE;
+    }
+    return o;
+}
+
+// One fused instruction over a tile, specialised on which side is broadcast
+#define MDEXPR_LOOP(EXPR)                                                          \
+    if (a.stride && b.stride) {                                                    \
+        for (size_t t = 0; t < n; t++) { double x = a.ptr[t], y = b.ptr[t]; dst[t] = (EXPR); } \
+    } else if (a.stride) {                                                         \
+        double y = *b.ptr;                                                         \
+        for (size_t t = 0; t < n; t++) { double x = a.ptr[t]; dst[t] = (EXPR); }   \
+    } else if (b.stride) {                                                         \
+        double x = *a.ptr;                                                         \
+        for (size_t t = 0; t < n; t++) { double y = b.ptr[t]; dst[t] = (EXPR); }   \
+    } else {                                                                       \
+        double x = *a.ptr, y = *b.ptr;                                             \
+        for (size_t t = 0; t < n; t++) dst[t] = (EXPR);                            \
+    }
+
+static void apply(MDExprOp op, double* dst, Operand a, Operand b, size_t n) {
+    switch (op) {
+    case MDEXPR_ADD: MDEXPR_LOOP(x + y); break;
+    case MDEXPR_SUB: MDEXPR_LOOP(x - y); break;
+    case MDEXPR_MUL: MDEXPR_LOOP(x * y); break;
+    case MDEXPR_MAX: MDEXPR_LOOP(x > y ? x : y); break;
+    case MDEXPR_MIN: MDEXPR_LOOP(x < y ? x : y); break;
+    case MDEXPR_GT: MDEXPR_LOOP(x > y ? 1.0 : 0.0); break;
+    default: break;
+    }
+}
+
+// Evaluates root into out in one pass over the output, intermediates only live in
+// per-node tiles of MDEXPR_TILE elements. out may alias a leaf of the same shape.
+int mdexpr_eval_into(MDExprGraph* g, MDExpr* root, MDArray* out) {
+    if (!g || !root || !out) return -1;
+
+    size_t rows = root->shape[0];
+    size_t cols = root->shape[1];
+    if (out->itemsize != sizeof(double) || out->total_size != rows * cols) {
+        printf("mdexpr_eval_into: output has %zu elements, expression needs (%zu, %zu)\n",
+               out->total_size, rows, cols);
+        return -1;
+    }
+
+    size_t n_nodes = 0;
+    for (MDExpr* e = g->nodes; e; e = e->next) {
+        e->slot = -1;
+        n_nodes++;
+    }
+
+    MDExpr** order = (MDExpr**)malloc(n_nodes * sizeof(MDExpr*));
+    if (!order) return -1;
+    int n_slots = 0;
+    size_t n_ops = schedule(root, order, 0, &n_slots);
+
+    double* tiles = (double*)malloc(((size_t)n_slots + 1) * MDEXPR_TILE * sizeof(double));
+    if (!tiles) {
+        free(order);
+        return -1;
+    }
+
+    double* dst_base = (double*)out->data;
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c0 = 0; c0 < cols; c0 += MDEXPR_TILE) {
+            size_t len = cols - c0 < MDEXPR_TILE ? cols - c0 : MDEXPR_TILE;
+            double* out_tile = dst_base + r * cols + c0;
+
+            if (n_ops == 0) {
+                // Bare leaf or scalar, nothing to fuse
+                Operand o = operand(root, tiles, r, c0, len);
+                for (size_t t = 0; t < len; t++) out_tile[t] = o.ptr[t * o.stride];
+                continue;
+            }
+
+            for (size_t i = 0; i < n_ops; i++) {
+                MDExpr* e = order[i];
+                size_t n = e->shape[1] == 1 ? 1 : len;
+                double* dst = e == root ? out_tile : tiles + (size_t)e->slot * MDEXPR_TILE;
+                apply(e->op, dst, operand(e->lhs, tiles, r, c0, n), operand(e->rhs, tiles, r, c0, n), n);
+            }
+        }
+    }
+
+    free(tiles);
+    free(order);
+    return 0;
+}
+
+MDArray* mdexpr_eval(MDExprGraph* g, MDExpr* root) {
+    if (!root) return NULL;
+
+    MDArray* out = mdarray_create(2, root->shape, sizeof(double));
+    if (!out) return NULL;
+    if (mdexpr_eval_into(g, root, out) != 0) {
+        mdarray_free(out);
+        return NULL;
+    }
+    return out;
+}
@@ -0,0 +1,51 @@
+// mdexpr.h
+#ifndef MDEXPR_H
+#define MDEXPR_H
+
+#include <stddef.h>
+#include "mdarray.h"
+
+#define MDEXPR_TILE 256           // Output elements evaluated per fused step
+
+typedef enum {
+    MDEXPR_LEAF,
+    MDEXPR_SCALAR,
+    MDEXPR_ADD,
+    MDEXPR_SUB,
+    MDEXPR_MUL,
+    MDEXPR_MAX,
+    MDEXPR_MIN,
+    MDEXPR_GT                     // 1.0 where lhs > rhs, else 0.0
+} MDExprOp;
+
+// Node of a deferred elementwise expression, shapes broadcast numpy-style up to 2-D
+typedef struct MDExpr {
+    MDExprOp op;
+    struct MDExpr* lhs;
+    struct MDExpr* rhs;
+    MDArray* leaf;                // MDEXPR_LEAF only, double and contiguous
+    double scalar;                // MDEXPR_SCALAR only
+    size_t shape[2];              // (rows, cols) after broadcasting
+    int slot;                     // Tile buffer assigned during evaluation
+    struct MDExpr* next;          // Every node of the graph, for freeing
+} MDExpr;
+
+// Owns all nodes created against it, nodes may be shared to form a DAG
+typedef struct {
+    MDExpr* nodes;
+} MDExprGraph;
+
+MDExprGraph* mdexpr_graph_new(void);
+void mdexpr_graph_free(MDExprGraph* g);
+MDExpr* mdexpr_leaf(MDExprGraph* g, MDArray* arr);
+MDExpr* mdexpr_scalar(MDExprGraph* g, double value);
+MDExpr* mdexpr_add(MDExprGraph* g, MDExpr* a, MDExpr* b);
+MDExpr* mdexpr_sub(MDExprGraph* g, MDExpr* a, MDExpr* b);
+MDExpr* mdexpr_mul(MDExprGraph* g, MDExpr* a, MDExpr* b);
+MDExpr* mdexpr_max(MDExprGraph* g, MDExpr* a, MDExpr* b);
+MDExpr* mdexpr_min(MDExprGraph* g, MDExpr* a, MDExpr* b);
+MDExpr* mdexpr_gt(MDExprGraph* g, MDExpr* a, MDExpr* b);
+MDArray* mdexpr_eval(MDExprGraph* g, MDExpr* root);
+int mdexpr_eval_into(MDExprGraph* g, MDExpr* root, MDArray* out);
+
+#endif // MDEXPR_H
@@ -0,0 +1,179 @@
+#include "mdsparse.h"
+#include <stdlib.h>
+#include <string.h>
+
+static MDSparse* mdsparse_alloc(MDSparseFormat format, size_t rows, size_t cols, size_t nnz) {
+    MDSparse* sp = (MDSparse*)malloc(sizeof(MDSparse));
+    if (!sp) return NULL;
+
+    size_t n_ptr = (format == MDSPARSE_CSR ? rows : cols) + 1;
+    sp->format = format;
+    sp->rows = rows;
+    sp->cols = cols;
+    sp->nnz = nnz;
+    sp->ptr = (size_t*)calloc(n_ptr, sizeof(size_t));
+    sp->idx = (uint32_t*)malloc((nnz ? nnz : 1) * sizeof(uint32_t));
+    sp->values = (double*)malloc((nnz ? nnz : 1) * sizeof(double));
+    if (!sp->ptr || !sp->idx || !sp->values) {
+        mdsparse_free(sp);
+        return NULL;
+    }
+    return sp;
+}
+
+void mdsparse_free(MDSparse* sp) {
+    if (sp) {
+        free(sp->ptr);
+        free(sp->idx);
+        free(sp->values);
+        free(sp);
+    }
+}
+
+// CSR copy of a contiguous float64 or uint8 tensor, every dimension after the first is
+// flattened into columns, so (N, 28, 28) images become an (N, 784) matrix
+MDSparse* mdsparse_from_dense(MDArray* dense) {
+    if (dense->ndim < 2 || (dense->itemsize != sizeof(double) && dense->itemsize != 1)) {
+        printf("mdsparse_from_dense: expected a float64 or uint8 tensor with ndim >= 2\n");
+        return NULL;
+    }
+    size_t rows = dense->shape[0];
+    size_t cols = rows ? dense->total_size / rows : 0;
+    if (cols > UINT32_MAX) {
+        printf("mdsparse_from_dense: too many columns\n");
+        return NULL;
+    }
+
+    // Count first so the arrays are allocated exactly once
+    size_t nnz = 0;
+    if (dense->itemsize == 1) {
+        const unsigned char* src = (const unsigned char*)dense->data;
+        for (size_t k = 0; k < dense->total_size; k++) nnz += src[k] != 0;
+    } else {
+        const double* src = (const double*)dense->data;
+        for (size_t k = 0; k < dense->total_size; k++) nnz += src[k] != 0.0;
+    }
+
+    MDSparse* sp = mdsparse_alloc(MDSPARSE_CSR, rows, cols, nnz);
+    if (!sp) return NULL;
+
+    size_t pos = 0;
+    for (size_t i = 0; i < rows; i++) {
+        if (dense->itemsize == 1) {
+            const unsigned char* row = (const unsigned char*)dense->data + i * cols;
+            for (size_t j = 0; j < cols; j++) {
+                if (row[j] == 0) continue;
+                sp->idx[pos] = (uint32_t)j;
+                sp->values[pos++] = (double)row[j];
+            }
+        } else {
+            const double* row = (const double*)dense->data + i * cols;
+            for (size_t j = 0; j < cols; j++) {
+                if (row[j] == 0.0) continue;
+                sp->idx[pos] = (uint32_t)j;
+                sp->values[pos++] = row[j];
+            }
+        }
+        sp->ptr[i + 1] = pos;
+    }
+    return sp;
+}
+
+// Same matrix in CSC, by a counting sort on the column index
+MDSparse* mdsparse_to_csc(MDSparse* csr) {
+    if (csr->format != MDSPARSE_CSR || csr->rows > UINT32_MAX) {
+        printf("mdsparse_to_csc: expected a CSR matrix\n");
+        return NULL;
+    }
+    MDSparse* csc = mdsparse_alloc(MDSPARSE_CSC, csr->rows, csr->cols, csr->nnz);
+    if (!csc) return NULL;
+
+    for (size_t p = 0; p < csr->nnz; p++) csc->ptr[csr->idx[p] + 1]++;
+    for (size_t j = 0; j < csr->cols; j++) csc->ptr[j + 1] += csc->ptr[j];
+
+    size_t* next = (size_t*)malloc((csr->cols ? csr->cols : 1) * sizeof(size_t));
+    if (!next) {
+        mdsparse_free(csc);
+        return NULL;
+    }
+    memcpy(next, csc->ptr, csr->cols * sizeof(size_t));
+    for (size_t i = 0; i < csr->rows; i++) {
+        for (size_t p = csr->ptr[i]; p < csr->ptr[i + 1]; p++) {
+            size_t q = next[csr->idx[p]]++;
+            csc->idx[q] = (uint32_t)i;
+            csc->values[q] = csr->values[p];
+        }
+    }
+    free(next);
+    return csc;
+}
+
+double mdsparse_density(MDSparse* sp) {
+    double total = (double)sp->rows * (double)sp->cols;
+    return total > 0.0 ? (double)sp->nnz / total : 0.0;
+}
+
+static int check_dense(MDArray* a, size_t rows, size_t cols) {
+    return a->ndim == 2 && a->itemsize == sizeof(double) && a->shape[0] == rows && a->shape[1] == cols;
+}
+
+// out(C, N) = W(C, K) * X^T where X is an (N, K) CSR matrix: each sample gathers only the
+// weight columns of its non-zero pixels
+int mdsparse_dot_wxt(MDArray* w, MDSparse* x, MDArray* out) {
+    if (x->format != MDSPARSE_CSR || w->ndim != 2 || !check_dense(w, w->shape[0], x->cols) ||
+        !check_dense(out, w->shape[0], x->rows)) {
+        printf("mdsparse_dot_wxt: shapes do not line up\n");
+        return -1;
+    }
+    size_t classes = w->shape[0], k = x->cols, n = x->rows;
+    const double* wd = (const double*)w->data;
+    double* o = (double*)out->data;
+
+    for (size_t j = 0; j < n; j++) {
+        size_t p0 = x->ptr[j], p1 = x->ptr[j + 1];
+        for (size_t c = 0; c < classes; c++) {
+            const double* wc = wd + c * k;
+            double sum = 0.0;
+            for (size_t p = p0; p < p1; p++) sum += wc[x->idx[p]] * x->values[p];
+            o[c * n + j] = sum;
+        }
+    }
+    return 0;
+}
+
+// out(C, K) = D(C, N) * X where X is (N, K). CSC gathers per output column; CSR scatters
+// each sample's non-zeros into the output rows.
+int mdsparse_dot_dx(MDArray* d, MDSparse* x, MDArray* out) {
+    if (d->ndim != 2 || !check_dense(d, d->shape[0], x->rows) || !check_dense(out, d->shape[0], x->cols)) {
+        printf("mdsparse_dot_dx: shapes do not line up\n");
+        return -1;
+    }
+    size_t classes = d->shape[0], k = x->cols, n = x->rows;
+    const double* dd = (const double*)d->data;
+    double* o = (double*)out->data;
+
+    if (x->format == MDSPARSE_CSC) {
+        for (size_t col = 0; col < k; col++) {
+            size_t p0 = x->ptr[col], p1 = x->ptr[col + 1];
+            for (size_t c = 0; c < classes; c++) {
+                const double* dc = dd + c * n;
+                double sum = 0.0;
+                for (size_t p = p0; p < p1; p++) sum += dc[x->idx[p]] * x->values[p];
+                o[c * k + col] = sum;
+            }
+        }
+        return 0;
+    }
+
+    memset(o, 0, classes * k * sizeof(double));
+    for (size_t j = 0; j < n; j++) {
+        size_t p0 = x->ptr[j], p1 = x->ptr[j + 1];
+        for (size_t c = 0; c < classes; c++) {
+            double s = dd[c * n + j];
+            if (s == 0.0) continue;
+            double* oc = o + c * k;
+            for (size_t p = p0; p < p1; p++) oc[x->idx[p]] += s * x->values[p];
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+// mdsparse.h
+#ifndef MDSPARSE_H
+#define MDSPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mdarray.h"
+
+typedef enum {
+    MDSPARSE_CSR,                 // Compressed rows: ptr has rows + 1 entries, idx holds columns
+    MDSPARSE_CSC                  // Compressed columns: ptr has cols + 1 entries, idx holds rows
+} MDSparseFormat;
+
+// 2-D float64 matrix storing only its non-zeros
+typedef struct {
+    MDSparseFormat format;
+    size_t rows;
+    size_t cols;
+    size_t nnz;
+    size_t* ptr;
+    uint32_t* idx;
+    double* values;
+} MDSparse;
+
+MDSparse* mdsparse_from_dense(MDArray* dense);
+MDSparse* mdsparse_to_csc(MDSparse* csr);
+void mdsparse_free(MDSparse* sp);
+double mdsparse_density(MDSparse* sp);
+int mdsparse_dot_wxt(MDArray* w, MDSparse* x, MDArray* out);
+int mdsparse_dot_dx(MDArray* d, MDSparse* x, MDArray* out);
+
+#endif // MDSPARSE_H
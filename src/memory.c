@@ -0,0 +1,176 @@
+#define _GNU_SOURCE
+#include "memory.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// From <numaif.h>, spelled out so there is no libnuma dependency
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4
+#endif
+
+static MDMemPolicy policy = MDMEM_DEFAULT;
+static size_t hugepage_threshold = 0;      // 0 disables huge pages
+static const char* policy_names[] = {"default", "local", "interleave", "partitioned"};
+
+int mdmem_policy_from_name(const char* name, MDMemPolicy* out) {
+    for (size_t i = 0; i < sizeof(policy_names) / sizeof(policy_names[0]); i++) {
+        if (strcmp(name, policy_names[i]) == 0) {
+            *out = (MDMemPolicy)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* mdmem_policy_name(MDMemPolicy p) {
+    return p <= MDMEM_PARTITIONED ? policy_names[p] : "unknown";
+}
+
+MDMemPolicy mdmem_policy(void) {
+    return policy;
+}
+
+// Applies to every MDStorage allocated afterwards. Tensors of at least hugepage_threshold
+// bytes are mapped 2 MB aligned and advised MADV_HUGEPAGE, 0 turns that off.
+int mdmem_configure(MDMemPolicy p, size_t threshold) {
+    if (p > MDMEM_PARTITIONED) return -1;
+    policy = p;
+    hugepage_threshold = threshold;
+    // Partitioned placement only pays off if thread t keeps running where it touched
+    parallel_set_affinity(p == MDMEM_PARTITIONED);
+    return 0;
+}
+
+// Parses a sysfs node list such as "0-1,3" into a bitmask, returns the number of nodes
+size_t mdmem_parse_nodes(const char* list, unsigned long* mask) {
+    size_t count = 0;
+    *mask = 0;
+    const char* p = list;
+    while (*p) {
+        char* end;
+        unsigned long lo = strtoul(p, &end, 10);
+        if (end == p) break;
+        unsigned long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtoul(p + 1, &end, 10);
+            p = end;
+        }
+        for (unsigned long n = lo; n <= hi && n < MDMEM_MAX_NODES; n++) {
+            if (!(*mask & (1ul << n))) count++;
+            *mask |= 1ul << n;
+        }
+        if (*p == ',') p++;
+        else break;
+    }
+    return count;
+}
+
+static size_t memory_nodes(unsigned long* mask) {
+    char buf[256] = {0};
+    FILE* f = fopen("/sys/devices/system/node/has_memory", "r");
+    if (!f) f = fopen("/sys/devices/system/node/online", "r");
+    if (!f || !fgets(buf, sizeof(buf), f)) {
+        if (f) fclose(f);
+        *mask = 1;
+        return 1;
+    }
+    fclose(f);
+    size_t n = mdmem_parse_nodes(buf, mask);
+    if (n == 0) {
+        *mask = 1;
+        n = 1;
+    }
+    return n;
+}
+
+size_t mdmem_numa_nodes(void) {
+    unsigned long mask;
+    return memory_nodes(&mask);
+}
+
+static void apply_policy(void* ptr, size_t size) {
+    static int warned = 0;
+    long rc = 0;
+    if (policy == MDMEM_LOCAL) {
+        rc = syscall(SYS_mbind, ptr, size, MPOL_LOCAL, NULL, 0, 0);
+    } else if (policy == MDMEM_INTERLEAVE) {
+        unsigned long mask;
+        memory_nodes(&mask);
+        rc = syscall(SYS_mbind, ptr, size, MPOL_INTERLEAVE, &mask, (unsigned long)MDMEM_MAX_NODES + 1, 0);
+    }
+    if (rc != 0 && !warned) {
+        warned = 1;
+        perror("mbind");
+    }
+}
+
+// Policy-aware allocation. Buffers under MDMEM_MIN_MAPPED, and anything below the huge page
+// threshold under the default policy, come from malloc: a page-rounded mapping, an mbind call
+// and a parallel first touch per bias vector or scratch row would cost more than placement saves.
+// Everything else comes from an anonymous mapping so mbind and madvise apply to whole pages.
+void* mdmem_alloc(size_t size, bool* mapped) {
+    bool huge = hugepage_threshold > 0 && size >= hugepage_threshold;
+    *mapped = false;
+    if (!huge && (size < MDMEM_MIN_MAPPED || policy == MDMEM_DEFAULT)) return malloc(size ? size : 1);
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t align = huge ? MDMEM_HUGEPAGE_SIZE : page;
+    size_t len = (size + page - 1) / page * page;
+
+    // Over-map and trim so huge page backed buffers start on a 2 MB boundary
+    size_t span = len + (align > page ? align : 0);
+    char* base = (char*)mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) return malloc(size);
+    char* ptr = (char*)(((uintptr_t)base + align - 1) & ~(uintptr_t)(align - 1));
+    if (ptr > base) munmap(base, (size_t)(ptr - base));
+    if (base + span > ptr + len) munmap(ptr + len, (size_t)(base + span - (ptr + len)));
+
+    if (huge) madvise(ptr, len, MADV_HUGEPAGE);
+    apply_policy(ptr, len);
+    if (policy == MDMEM_PARTITIONED) mdmem_first_touch(ptr, len);
+
+    *mapped = true;
+    return ptr;
+}
+
+void mdmem_free(void* ptr, size_t size, bool mapped) {
+    if (!mapped) {
+        free(ptr);
+        return;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    munmap(ptr, (size + page - 1) / page * page);
+}
+
+typedef struct {
+    char* ptr;
+    size_t pages;
+    size_t page;
+} TouchJob;
+
+static void touch_worker(size_t tid, size_t n_threads, void* arg) {
+    TouchJob* job = (TouchJob*)arg;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->pages, &lo, &hi);
+    for (size_t p = lo; p < hi; p++) job->ptr[p * job->page] = 0;
+}
+
+// Writes one byte per page from the thread whose parallel_range slice covers it, so each
+// slice is placed on that thread's node. Anonymous pages are already zero.
+void mdmem_first_touch(void* ptr, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    TouchJob job = {(char*)ptr, (size + page - 1) / page, page};
+    size_t n_threads = size >= MDMEM_MIN_MAPPED ? parallel_threads() : 1;
+    if (n_threads > job.pages) n_threads = job.pages ? job.pages : 1;
+    parallel_run(n_threads, touch_worker, &job);
+}
@@ -0,0 +1,29 @@
+// memory.h
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define MDMEM_HUGEPAGE_SIZE (2u << 20)
+#define MDMEM_MAX_NODES     64
+#define MDMEM_MIN_MAPPED    (64u << 10)   // Smaller tensors stay on malloc under every policy
+
+typedef enum {
+    MDMEM_DEFAULT,                // Plain malloc, pages land wherever they are first written
+    MDMEM_LOCAL,                  // MPOL_LOCAL: on the node of the thread that touches them
+    MDMEM_INTERLEAVE,             // MPOL_INTERLEAVE: round-robin over every node with memory
+    MDMEM_PARTITIONED             // Thread t of parallel_run first-touches slice t
+} MDMemPolicy;
+
+int mdmem_configure(MDMemPolicy policy, size_t hugepage_threshold);
+MDMemPolicy mdmem_policy(void);
+int mdmem_policy_from_name(const char* name, MDMemPolicy* out);
+const char* mdmem_policy_name(MDMemPolicy policy);
+size_t mdmem_parse_nodes(const char* list, unsigned long* mask);
+size_t mdmem_numa_nodes(void);
+void* mdmem_alloc(size_t size, bool* mapped);
+void mdmem_free(void* ptr, size_t size, bool mapped);
+void mdmem_first_touch(void* ptr, size_t size);
+
+#endif // MEMORY_H
@@ -0,0 +1,288 @@
+#include "mixed.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIXED_X86 1
+#endif
+
+#define MIXED_BLOCK_N 64               // Samples decoded and scored together per thread
+#define MIXED_LANES 8                  // dW columns are split across threads in whole vectors
+#define MIXED_PARALLEL_MIN_FLOPS (1u << 20)
+
+typedef float (*MixedDotFn)(const float* a, const float* b, size_t k);
+typedef void (*MixedAxpyFn)(float s, const float* x, float* y, size_t k);
+
+static MixedDotFn dot_fn = NULL;
+static MixedAxpyFn axpy_fn = NULL;
+static const char* kernel_name = "scalar";
+
+static float dot_scalar(const float* a, const float* b, size_t k) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < k; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+static void axpy_scalar(float s, const float* x, float* y, size_t k) {
+    for (size_t i = 0; i < k; i++) y[i] += s * x[i];
+}
+
+#ifdef MIXED_X86
+// Twice the lanes of the float64 path: 8 floats per register, two accumulators to hide FMA latency
+__attribute__((target("avx2,fma")))
+static float dot_avx2(const float* a, const float* b, size_t k) {
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= k; i += 16) {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+    for (; i + 8 <= k; i += 8) acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    float sum = _mm_cvtss_f32(s);
+    for (; i < k; i++) sum += a[i] * b[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(float s, const float* x, float* y, size_t k) {
+    __m256 sv = _mm256_set1_ps(s);
+    size_t i = 0;
+    for (; i + 8 <= k; i += 8) {
+        _mm256_storeu_ps(y + i, _mm256_fmadd_ps(sv, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+    }
+    for (; i < k; i++) y[i] += s * x[i];
+}
+#endif
+
+static void select_kernels(void) {
+    dot_fn = dot_scalar;
+    axpy_fn = axpy_scalar;
+#ifdef MIXED_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        dot_fn = dot_avx2;
+        axpy_fn = axpy_avx2;
+        kernel_name = "avx2-fma";
+    }
+#endif
+}
+
+const char* mixed_kernel_name(void) {
+    if (!dot_fn) select_kernels();
+    return kernel_name;
+}
+
+// Round to nearest even on the dropped 16 bits, NaN stays NaN
+uint16_t mixed_to_bf16(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) return (uint16_t)((bits >> 16) | 0x40);
+    bits += 0x7fffu + ((bits >> 16) & 1u);
+    return (uint16_t)(bits >> 16);
+}
+
+float mixed_from_bf16(uint16_t v) {
+    uint32_t bits = (uint32_t)v << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+void mixed_linear_free(MixedLinear* m) {
+    if (m) {
+        free(m->x32);
+        free(m->x16);
+        free(m->w32);
+        free(m->b32);
+        free(m->scores);
+        free(m->dscores);
+        free(m->dw);
+        free(m);
+    }
+}
+
+// Converts (N, ...) float64 images once, every dimension after the first is one feature.
+// Raw 0-255 pixels are exact in bfloat16, which has 8 significant bits.
+MixedLinear* mixed_linear_new(MDArray* images, size_t classes, bool bf16) {
+    if (!images || images->ndim < 2 || images->itemsize != sizeof(double) || classes == 0) {
+        printf("mixed_linear_new expects (N, ...) float64 images\n");
+        return NULL;
+    }
+    if (!dot_fn) select_kernels();
+
+    MixedLinear* m = (MixedLinear*)calloc(1, sizeof(MixedLinear));
+    if (!m) return NULL;
+    m->n = images->shape[0];
+    m->features = images->total_size / m->n;
+    m->classes = classes;
+    m->bf16 = bf16;
+
+    size_t total = m->n * m->features;
+    const double* src = (const double*)images->data;
+    if (bf16) {
+        m->x16 = (uint16_t*)malloc(total * sizeof(uint16_t));
+        if (m->x16) for (size_t i = 0; i < total; i++) m->x16[i] = mixed_to_bf16((float)src[i]);
+    } else {
+        m->x32 = (float*)malloc(total * sizeof(float));
+        if (m->x32) for (size_t i = 0; i < total; i++) m->x32[i] = (float)src[i];
+    }
+    m->w32 = (float*)malloc(classes * m->features * sizeof(float));
+    m->b32 = (float*)malloc(classes * sizeof(float));
+    m->scores = (float*)malloc(classes * m->n * sizeof(float));
+    m->dscores = (float*)malloc(classes * m->n * sizeof(float));
+    m->dw = (float*)malloc(classes * m->features * sizeof(float));
+    if ((!m->x32 && !m->x16) || !m->w32 || !m->b32 || !m->scores || !m->dscores || !m->dw) {
+        mixed_linear_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+typedef struct {
+    MixedLinear* m;
+    int failed;
+} MixedJob;
+
+// Columns [k0, k0 + width) of samples [j0, j0 + len) as float32, decoded into scratch
+// (len x width) when the images are bfloat16
+static const float* sample_rows(MixedLinear* m, size_t j0, size_t len, size_t k0, size_t width, float* scratch) {
+    if (!m->bf16) return m->x32 + j0 * m->features + k0;
+    for (size_t j = 0; j < len; j++) {
+        const uint16_t* src = m->x16 + (j0 + j) * m->features + k0;
+        for (size_t k = 0; k < width; k++) scratch[j * width + k] = mixed_from_bf16(src[k]);
+    }
+    return scratch;
+}
+
+// scores(C, N) = W * X^T + b. Each thread owns a range of samples and scores them
+// MIXED_BLOCK_N at a time, so a bfloat16 block is decoded once for every class.
+static void forward_worker(size_t tid, size_t n_threads, void* arg) {
+    MixedJob* job = (MixedJob*)arg;
+    MixedLinear* m = job->m;
+    size_t n = m->n, features = m->features;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, n, &lo, &hi);
+    if (hi <= lo) return;
+
+    float* scratch = NULL;
+    if (m->bf16) {
+        scratch = (float*)malloc(MIXED_BLOCK_N * features * sizeof(float));
+        if (!scratch) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    for (size_t j0 = lo; j0 < hi; j0 += MIXED_BLOCK_N) {
+        size_t len = hi - j0 < MIXED_BLOCK_N ? hi - j0 : MIXED_BLOCK_N;
+        const float* x = sample_rows(m, j0, len, 0, features, scratch);
+        // Rows of x are features apart either way: scratch is decoded at full width
+        for (size_t c = 0; c < m->classes; c++) {
+            const float* wc = m->w32 + c * features;
+            float* sc = m->scores + c * n + j0;
+            for (size_t j = 0; j < len; j++) sc[j] = dot_fn(wc, x + j * features, features) + m->b32[c];
+        }
+    }
+    free(scratch);
+}
+
+// dW(C, K) = dscores * X, skipping samples with no margin violations. Each thread owns a
+// range of whole MIXED_LANES-wide column chunks, so no two threads write the same dW entry
+// and every entry is summed over the samples in order, as in a single-threaded pass.
+static void dw_worker(size_t tid, size_t n_threads, void* arg) {
+    MixedJob* job = (MixedJob*)arg;
+    MixedLinear* m = job->m;
+    size_t n = m->n, features = m->features, classes = m->classes;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, (features + MIXED_LANES - 1) / MIXED_LANES, &lo, &hi);
+    size_t k0 = lo * MIXED_LANES, k1 = hi * MIXED_LANES < features ? hi * MIXED_LANES : features;
+    if (k1 <= k0) return;
+    size_t width = k1 - k0;
+
+    float* scratch = NULL;
+    if (m->bf16) {
+        scratch = (float*)malloc(width * sizeof(float));
+        if (!scratch) {
+            __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+
+    for (size_t c = 0; c < classes; c++) memset(m->dw + c * features + k0, 0, width * sizeof(float));
+    for (size_t j = 0; j < n; j++) {
+        const float* x = NULL;
+        for (size_t c = 0; c < classes; c++) {
+            float d = m->dscores[c * n + j];
+            if (d == 0.0f) continue;
+            if (!x) x = sample_rows(m, j, 1, k0, width, scratch);
+            axpy_fn(d, x, m->dw + c * features + k0, width);
+        }
+    }
+    free(scratch);
+}
+
+// One full-batch step, same math as linearmodel_forward/svm_loss/linearmodel_backward.
+// Returns the loss before the update, accumulated in double, or -1 with the weights
+// untouched when a worker cannot allocate its scratch.
+double mixed_linear_step(MixedLinear* m, MDArray* weights, MDArray* biases, const size_t* labels, double lr) {
+    size_t classes = m->classes, features = m->features, n = m->n;
+    if (weights->ndim != 2 || weights->shape[0] != classes || weights->shape[1] != features ||
+        biases->total_size != classes) {
+        printf("mixed_linear_step: weights do not match the images\n");
+        return -1.0;
+    }
+    double* w = (double*)weights->data;
+    double* b = (double*)biases->data;
+    for (size_t i = 0; i < classes * features; i++) m->w32[i] = (float)w[i];
+    for (size_t c = 0; c < classes; c++) m->b32[c] = (float)b[c];
+
+    size_t n_threads = (double)n * features * classes < MIXED_PARALLEL_MIN_FLOPS ? 1 : parallel_threads();
+    MixedJob job = {m, 0};
+    parallel_run(n_threads, forward_worker, &job);
+    if (job.failed) {
+        printf("mixed_linear_step: out of memory\n");
+        return -1.0;
+    }
+
+    // Hinge loss and dscores in one pass
+    double loss = 0.0;
+    float inv_n = 1.0f / (float)n;
+    for (size_t j = 0; j < n; j++) {
+        size_t yi = labels[j];
+        float s_yi = m->scores[yi * n + j];
+        size_t count = 0;
+        for (size_t c = 0; c < classes; c++) {
+            float margin = m->scores[c * n + j] - s_yi + 1.0f;
+            float d = 0.0f;
+            if (c != yi && margin > 0.0f) {
+                loss += margin;
+                d = inv_n;
+                count++;
+            }
+            m->dscores[c * n + j] = d;
+        }
+        m->dscores[yi * n + j] = -(float)count * inv_n;
+    }
+
+    parallel_run(n_threads, dw_worker, &job);
+    if (job.failed) {
+        printf("mixed_linear_step: out of memory\n");
+        return -1.0;
+    }
+
+    // Master update in float64
+    for (size_t c = 0; c < classes; c++) {
+        double db = 0.0;
+        for (size_t j = 0; j < n; j++) db += m->dscores[c * n + j];
+        b[c] -= lr * db;
+    }
+    for (size_t i = 0; i < classes * features; i++) w[i] -= lr * (double)m->dw[i];
+
+    return loss / (double)n;
+}
@@ -0,0 +1,33 @@
+// mixed.h
+#ifndef MIXED_H
+#define MIXED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "mdarray.h"
+
+// Mixed-precision linear SVM step: images, scores and gradients are float32 (images may be
+// stored as bfloat16), the float64 weights and biases stay the master copy for the update
+typedef struct {
+    size_t n;
+    size_t features;
+    size_t classes;
+    bool bf16;
+    float* x32;                   // (n, features) when !bf16
+    uint16_t* x16;                // (n, features) when bf16
+    float* w32;                   // (classes, features), refreshed from the master every step
+    float* b32;
+    float* scores;                // (classes, n)
+    float* dscores;               // (classes, n)
+    float* dw;                    // (classes, features)
+} MixedLinear;
+
+MixedLinear* mixed_linear_new(MDArray* images, size_t classes, bool bf16);
+void mixed_linear_free(MixedLinear* m);
+double mixed_linear_step(MixedLinear* m, MDArray* weights, MDArray* biases, const size_t* labels, double lr);
+uint16_t mixed_to_bf16(float v);
+float mixed_from_bf16(uint16_t v);
+const char* mixed_kernel_name(void);
+
+#endif // MIXED_H
@@ -0,0 +1,166 @@
+// mlp.h
+#ifndef MLP_H
+#define MLP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "mdarray.h"
+#include "linear.h"
+
+// Multi-layer perceptron: ReLU hidden layers followed by a linear 10-way output layer.
+// Activations are stored feature-major (features, N) like LinearModel's scores.
+typedef struct {
+    MDArray* images;
+    MDArray* labels;
+    MDArray* x_t;          // (784, N) inputs, transposed once
+
+    size_t n_layers;
+    size_t* sizes;         // n_layers + 1 widths, sizes[0] = 784, sizes[n_layers] = 10
+    MDArray** weights;     // (sizes[l + 1], sizes[l])
+    MDArray** biases;      // (sizes[l + 1], 1)
+    MDArray** acts;        // Layer outputs, ReLU applied on hidden layers
+    MDArray** dz;          // Gradients at each layer's pre-activation
+    MDArray** dw;
+    MDArray** db;
+} MLP;
+
+void mlp_free(MLP* model);
+
+// Returns NULL, with everything allocated so far freed, when any allocation fails
+MLP* mlp_new(MDArray* images, MDArray* labels, size_t n_hidden, size_t* hidden) {
+    MLP* model = (MLP*)calloc(1, sizeof(MLP));
+    if (!model) return NULL;
+
+    model->images = images;
+    model->labels = labels;
+
+    size_t n = images->shape[0];
+    size_t shape_flat[] = {n, 784};
+    MDArray* imgs_flat = mdarray_resize(images, 2, shape_flat);
+    model->x_t = imgs_flat ? mdarray_transpose_2d(imgs_flat) : NULL;
+    mdarray_free(imgs_flat);
+
+    model->n_layers = n_hidden + 1;
+    model->sizes = (size_t*)malloc((model->n_layers + 1) * sizeof(size_t));
+    model->weights = (MDArray**)calloc(model->n_layers, sizeof(MDArray*));
+    model->biases = (MDArray**)calloc(model->n_layers, sizeof(MDArray*));
+    model->acts = (MDArray**)calloc(model->n_layers, sizeof(MDArray*));
+    model->dz = (MDArray**)calloc(model->n_layers, sizeof(MDArray*));
+    model->dw = (MDArray**)calloc(model->n_layers, sizeof(MDArray*));
+    model->db = (MDArray**)calloc(model->n_layers, sizeof(MDArray*));
+    if (!model->x_t || !model->sizes || !model->weights || !model->biases || !model->acts ||
+        !model->dz || !model->dw || !model->db) {
+        printf("mlp_new: out of memory\n");
+        mlp_free(model);
+        return NULL;
+    }
+
+    model->sizes[0] = 784;
+    for (size_t l = 0; l < n_hidden; l++) model->sizes[l + 1] = hidden[l];
+    model->sizes[model->n_layers] = 10;
+
+    for (size_t l = 0; l < model->n_layers; l++) {
+        size_t out = model->sizes[l + 1], in = model->sizes[l];
+        size_t shape_w[] = {out, in};
+        size_t shape_b[] = {out, 1};
+        size_t shape_a[] = {out, n};
+
+        model->weights[l] = mdarray_create(2, shape_w, sizeof(double));
+        model->biases[l] = mdarray_create(2, shape_b, sizeof(double));
+        model->acts[l] = mdarray_create(2, shape_a, sizeof(double));
+        model->dz[l] = mdarray_create(2, shape_a, sizeof(double));
+        model->dw[l] = mdarray_create(2, shape_w, sizeof(double));
+        model->db[l] = mdarray_create(2, shape_b, sizeof(double));
+        if (!model->weights[l] || !model->biases[l] || !model->acts[l] ||
+            !model->dz[l] || !model->dw[l] || !model->db[l]) {
+            printf("mlp_new: out of memory for layer %zu (%zu x %zu)\n", l, out, in);
+            mlp_free(model);
+            return NULL;
+        }
+
+        // Raw pixels are 0..255, keep the first layer as small as LinearModel's weights
+        mdarray_randn(model->weights[l], l == 0 ? 0.01 : sqrt(2.0 / (double)in));
+        mdarray_zeros(model->biases[l]);
+    }
+
+    return model;
+}
+
+// Also frees a partly built model, every array that was not allocated is NULL
+void mlp_free(MLP* model) {
+    if (!model) return;
+    for (size_t l = 0; l < model->n_layers; l++) {
+        if (model->weights) mdarray_free(model->weights[l]);
+        if (model->biases) mdarray_free(model->biases[l]);
+        if (model->acts) mdarray_free(model->acts[l]);
+        if (model->dz) mdarray_free(model->dz[l]);
+        if (model->dw) mdarray_free(model->dw[l]);
+        if (model->db) mdarray_free(model->db[l]);
+    }
+    free(model->weights);
+    free(model->biases);
+    free(model->acts);
+    free(model->dz);
+    free(model->dw);
+    free(model->db);
+    free(model->sizes);
+    mdarray_free(model->x_t);
+    free(model);
+}
+
+// Returns the (10, N) scores, owned by the model and overwritten by the next call
+MDArray* mlp_forward(MLP* model) {
+    MDArray* input = model->x_t;
+    for (size_t l = 0; l < model->n_layers; l++) {
+        bool hidden = l + 1 < model->n_layers;
+        if (mdarray_dot_bias_relu(model->weights[l], input, model->biases[l], hidden, model->acts[l]) != 0) {
+            return NULL;
+        }
+        input = model->acts[l];
+    }
+    return input;
+}
+
+// Computes every gradient first, then applies W -= lr * dW, b -= lr * db. Returns -1, with
+// the weights untouched, when a gradient cannot be computed.
+int mlp_backward(MLP* model, MDArray* scores, size_t* labels, size_t batch_size, double lr) {
+    size_t last = model->n_layers - 1;
+
+    MDArray* dscores = svm_loss_backward(scores, labels, batch_size);
+    if (!dscores) return -1;
+    memcpy(model->dz[last]->data, dscores->data, dscores->total_size * sizeof(double));
+    mdarray_free(dscores);
+
+    // Output layer has no ReLU, its bias gradient is a plain row sum
+    const double* g = (const double*)model->dz[last]->data;
+    double* db = (double*)model->db[last]->data;
+    for (size_t i = 0; i < model->sizes[last + 1]; i++) {
+        double sum = 0.0;
+        for (size_t j = 0; j < batch_size; j++) sum += g[i * batch_size + j];
+        db[i] = sum;
+    }
+
+    for (size_t l = last + 1; l-- > 0;) {
+        MDArray* input = l == 0 ? model->x_t : model->acts[l - 1];
+        if (mdarray_dot_into(model->dz[l], false, input, true, model->dw[l], 0.0) != 0) return -1;
+        if (l > 0 && mdarray_dot_tn_relu_grad(model->weights[l], model->dz[l], model->acts[l - 1],
+                                              model->dz[l - 1], model->db[l - 1]) != 0) {
+            return -1;
+        }
+    }
+
+    for (size_t l = 0; l < model->n_layers; l++) {
+        double* w = (double*)model->weights[l]->data;
+        const double* dw = (const double*)model->dw[l]->data;
+        for (size_t k = 0; k < model->weights[l]->total_size; k++) w[k] -= lr * dw[k];
+
+        double* b = (double*)model->biases[l]->data;
+        const double* dbl = (const double*)model->db[l]->data;
+        for (size_t k = 0; k < model->biases[l]->total_size; k++) b[k] -= lr * dbl[k];
+    }
+    return 0;
+}
+
+#endif // MLP_H
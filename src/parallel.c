@@ -0,0 +1,179 @@
+#define _GNU_SOURCE
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef struct {
+    ParallelFn fn;
+    void* ctx;
+    size_t tid;
+    size_t n_threads;
+    int cpu;                      // CPU to pin to, -1 to leave the thread alone
+    bool started;                 // pthread_create succeeded, so it must be joined
+} ParallelTask;
+
+static int pin_workers = 0;
+static size_t budget = 0;         // 0: no cap beyond NNC_THREADS and the CPU count
+
+// When on, worker tid of every parallel region runs on the tid-th CPU of cpu_order(), so memory
+// first touched by a given tid stays next to the thread that uses it. Thread 0 is the caller
+// and is left alone.
+void parallel_set_affinity(bool pin) {
+    pin_workers = pin;
+}
+
+// Caps parallel_threads() for this process, e.g. one share of the cores per forked worker.
+// 0 removes the cap.
+void parallel_set_budget(size_t n_threads) {
+    budget = n_threads;
+}
+
+// NNC_THREADS overrides the number of online CPUs
+size_t parallel_threads(void) {
+    const char* env = getenv("NNC_THREADS");
+    size_t n = 1;
+    if (env && atoi(env) > 0) {
+        n = (size_t)atoi(env);
+    } else {
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        n = ncpu > 0 ? (size_t)ncpu : 1;
+    }
+    return budget > 0 && budget < n ? budget : n;
+}
+
+// Parses a sysfs CPU list such as "0-3,8" into cpus[0, max_cpus), returns the number set
+size_t parallel_parse_cpus(const char* list, bool* cpus, size_t max_cpus) {
+    size_t count = 0;
+    memset(cpus, 0, max_cpus * sizeof(bool));
+    const char* p = list;
+    while (*p) {
+        char* end;
+        unsigned long lo = strtoul(p, &end, 10);
+        if (end == p) break;
+        unsigned long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtoul(p + 1, &end, 10);
+            p = end;
+        }
+        for (unsigned long c = lo; c <= hi && c < max_cpus; c++) {
+            if (!cpus[c]) count++;
+            cpus[c] = true;
+        }
+        if (*p == ',') p++;
+        else break;
+    }
+    return count;
+}
+
+#define PARALLEL_MAX_NODES 64
+
+static bool node_cpus[PARALLEL_MAX_NODES][CPU_SETSIZE];
+static bool node_present[PARALLEL_MAX_NODES];
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+static void load_topology(void) {
+    for (size_t n = 0; n < PARALLEL_MAX_NODES; n++) {
+        char path[64], buf[1024];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%zu/cpulist", n);
+        FILE* f = fopen(path, "r");
+        if (!f) continue;
+        if (fgets(buf, sizeof(buf), f)) node_present[n] = parallel_parse_cpus(buf, node_cpus[n], CPU_SETSIZE) > 0;
+        fclose(f);
+    }
+}
+
+// The CPUs this process may run on, grouped node by node so consecutive tids, and with them
+// the consecutive page slices they first touch, share a node. Read per region because forked
+// workers narrow their own mask. Returns the number written to order.
+static size_t cpu_order(int* order) {
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_ZERO(&allowed);
+        long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long c = 0; c < (ncpu > 0 ? ncpu : 1) && c < CPU_SETSIZE; c++) CPU_SET(c, &allowed);
+    }
+    pthread_once(&topology_once, load_topology);
+
+    size_t count = 0;
+    for (size_t n = 0; n < PARALLEL_MAX_NODES; n++) {
+        if (!node_present[n]) continue;
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (node_cpus[n][c] && CPU_ISSET(c, &allowed)) {
+                order[count++] = c;
+                CPU_CLR(c, &allowed);
+            }
+        }
+    }
+    // No sysfs topology, or CPUs missing from every node list
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed)) order[count++] = c;
+    }
+    return count;
+}
+
+static void* task_main(void* arg) {
+    ParallelTask* task = (ParallelTask*)arg;
+    if (task->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(task->cpu, &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+    task->fn(task->tid, task->n_threads, task->ctx);
+    return NULL;
+}
+
+// Runs fn on n_threads threads, thread 0 being the caller, and joins them all. Slices run
+// one after another on the caller when their thread cannot be created, so fn must not wait
+// on other tids.
+void parallel_run(size_t n_threads, ParallelFn fn, void* ctx) {
+    if (n_threads <= 1) {
+        fn(0, 1, ctx);
+        return;
+    }
+
+    pthread_t* threads = (pthread_t*)malloc(n_threads * sizeof(pthread_t));
+    ParallelTask* tasks = (ParallelTask*)malloc(n_threads * sizeof(ParallelTask));
+    if (!threads || !tasks) {
+        free(threads);
+        free(tasks);
+        fn(0, 1, ctx);
+        return;
+    }
+
+    int* order = pin_workers ? (int*)malloc(CPU_SETSIZE * sizeof(int)) : NULL;
+    size_t n_cpus = order ? cpu_order(order) : 0;
+    for (size_t t = 0; t < n_threads; t++) {
+        tasks[t].fn = fn;
+        tasks[t].ctx = ctx;
+        tasks[t].tid = t;
+        tasks[t].n_threads = n_threads;
+        tasks[t].cpu = n_cpus > 0 ? order[t % n_cpus] : -1;
+    }
+    free(order);
+    for (size_t t = 1; t < n_threads; t++) {
+        tasks[t].started = pthread_create(&threads[t], NULL, task_main, &tasks[t]) == 0;
+    }
+    fn(0, n_threads, ctx);
+    // Slices whose thread could not be created still have to be computed, on this thread
+    for (size_t t = 1; t < n_threads; t++) {
+        if (!tasks[t].started) fn(t, n_threads, ctx);
+    }
+    for (size_t t = 1; t < n_threads; t++) {
+        if (tasks[t].started) pthread_join(threads[t], NULL);
+    }
+
+    free(threads);
+    free(tasks);
+}
+
+// Contiguous, balanced split of [0, n) for thread tid
+void parallel_range(size_t tid, size_t n_threads, size_t n, size_t* lo, size_t* hi) {
+    *lo = tid * n / n_threads;
+    *hi = (tid + 1) * n / n_threads;
+}
@@ -0,0 +1,18 @@
+// parallel.h
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Body of a parallel region, called once per thread id in [0, n_threads)
+typedef void (*ParallelFn)(size_t tid, size_t n_threads, void* ctx);
+
+size_t parallel_threads(void);
+void parallel_set_budget(size_t n_threads);
+void parallel_set_affinity(bool pin);
+void parallel_run(size_t n_threads, ParallelFn fn, void* ctx);
+void parallel_range(size_t tid, size_t n_threads, size_t n, size_t* lo, size_t* hi);
+size_t parallel_parse_cpus(const char* list, bool* cpus, size_t max_cpus);
+
+#endif // PARALLEL_H
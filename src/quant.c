@@ -0,0 +1,276 @@
+#include "quant.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUANT_X86 1
+#endif
+
+typedef void (*QuantGemmFn)(const int8_t* w, const uint8_t* x, int32_t* out,
+                            size_t rows, size_t cols, size_t n);
+
+static QuantGemmFn gemm_fn = NULL;
+static QuantKernel gemm_kind = QUANT_KERNEL_AUTO;
+
+// out(rows, n) = w(rows, cols) * x(n, cols)^T
+static void gemm_scalar(const int8_t* w, const uint8_t* x, int32_t* out,
+                        size_t rows, size_t cols, size_t n) {
+    for (size_t j = 0; j < n; j++) {
+        const uint8_t* xj = x + j * cols;
+        for (size_t r = 0; r < rows; r++) {
+            const int8_t* wr = w + r * cols;
+            int32_t sum = 0;
+            for (size_t k = 0; k < cols; k++) sum += (int32_t)wr[k] * (int32_t)xj[k];
+            out[r * n + j] = sum;
+        }
+    }
+}
+
+#ifdef QUANT_X86
+__attribute__((target("avx2")))
+static int32_t hsum_epi32(__m256i v) {
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+// maddubs would saturate on 255 * 127 pairs, so widen both sides to int16 and use madd
+__attribute__((target("avx2")))
+static void gemm_avx2(const int8_t* w, const uint8_t* x, int32_t* out,
+                      size_t rows, size_t cols, size_t n) {
+    for (size_t j = 0; j < n; j++) {
+        const uint8_t* xj = x + j * cols;
+        size_t r = 0;
+        // Four rows at a time so each widened input chunk is reused
+        for (; r + 4 <= rows; r += 4) {
+            const int8_t* w0 = w + r * cols;
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+            size_t k = 0;
+            for (; k + 16 <= cols; k += 16) {
+                __m256i xv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(xj + k)));
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(xv,
+                        _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(w0 + k)))));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(xv,
+                        _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(w0 + cols + k)))));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(xv,
+                        _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(w0 + 2 * cols + k)))));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(xv,
+                        _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(w0 + 3 * cols + k)))));
+            }
+            int32_t s[4] = {hsum_epi32(acc0), hsum_epi32(acc1), hsum_epi32(acc2), hsum_epi32(acc3)};
+            for (; k < cols; k++) {
+                for (size_t q = 0; q < 4; q++) s[q] += (int32_t)w0[q * cols + k] * (int32_t)xj[k];
+            }
+            for (size_t q = 0; q < 4; q++) out[(r + q) * n + j] = s[q];
+        }
+        for (; r < rows; r++) {
+            const int8_t* wr = w + r * cols;
+            __m256i acc = _mm256_setzero_si256();
+            size_t k = 0;
+            for (; k + 16 <= cols; k += 16) {
+                __m256i xv = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(xj + k)));
+                __m256i wv = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(wr + k)));
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(xv, wv));
+            }
+            int32_t sum = hsum_epi32(acc);
+            for (; k < cols; k++) sum += (int32_t)wr[k] * (int32_t)xj[k];
+            out[r * n + j] = sum;
+        }
+    }
+}
+
+// dpbusd multiplies u8 by s8 and sums groups of four straight into int32
+__attribute__((target("avx2,avxvnni")))
+static void gemm_vnni(const int8_t* w, const uint8_t* x, int32_t* out,
+                      size_t rows, size_t cols, size_t n) {
+    for (size_t j = 0; j < n; j++) {
+        const uint8_t* xj = x + j * cols;
+        size_t r = 0;
+        for (; r + 4 <= rows; r += 4) {
+            const int8_t* w0 = w + r * cols;
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = _mm256_setzero_si256();
+            __m256i acc2 = _mm256_setzero_si256(), acc3 = _mm256_setzero_si256();
+            size_t k = 0;
+            for (; k + 32 <= cols; k += 32) {
+                __m256i xv = _mm256_loadu_si256((const __m256i*)(xj + k));
+                acc0 = _mm256_dpbusd_avx_epi32(acc0, xv, _mm256_loadu_si256((const __m256i*)(w0 + k)));
+                acc1 = _mm256_dpbusd_avx_epi32(acc1, xv, _mm256_loadu_si256((const __m256i*)(w0 + cols + k)));
+                acc2 = _mm256_dpbusd_avx_epi32(acc2, xv, _mm256_loadu_si256((const __m256i*)(w0 + 2 * cols + k)));
+                acc3 = _mm256_dpbusd_avx_epi32(acc3, xv, _mm256_loadu_si256((const __m256i*)(w0 + 3 * cols + k)));
+            }
+            int32_t s[4] = {hsum_epi32(acc0), hsum_epi32(acc1), hsum_epi32(acc2), hsum_epi32(acc3)};
+            for (; k < cols; k++) {
+                for (size_t q = 0; q < 4; q++) s[q] += (int32_t)w0[q * cols + k] * (int32_t)xj[k];
+            }
+            for (size_t q = 0; q < 4; q++) out[(r + q) * n + j] = s[q];
+        }
+        for (; r < rows; r++) {
+            const int8_t* wr = w + r * cols;
+            __m256i acc = _mm256_setzero_si256();
+            size_t k = 0;
+            for (; k + 32 <= cols; k += 32) {
+                acc = _mm256_dpbusd_avx_epi32(acc, _mm256_loadu_si256((const __m256i*)(xj + k)),
+                                              _mm256_loadu_si256((const __m256i*)(wr + k)));
+            }
+            int32_t sum = hsum_epi32(acc);
+            for (; k < cols; k++) sum += (int32_t)wr[k] * (int32_t)xj[k];
+            out[r * n + j] = sum;
+        }
+    }
+}
+#endif
+
+// Returns 0 if the kernel is available on this CPU and now in use, -1 otherwise
+int quant_select_kernel(QuantKernel kernel) {
+    if (kernel == QUANT_KERNEL_AUTO) {
+        if (quant_select_kernel(QUANT_KERNEL_VNNI) == 0) return 0;
+        if (quant_select_kernel(QUANT_KERNEL_AVX2) == 0) return 0;
+        return quant_select_kernel(QUANT_KERNEL_SCALAR);
+    }
+
+    switch (kernel) {
+    case QUANT_KERNEL_SCALAR:
+        gemm_fn = gemm_scalar;
+        break;
+#ifdef QUANT_X86
+    case QUANT_KERNEL_AVX2:
+        if (!__builtin_cpu_supports("avx2")) return -1;
+        gemm_fn = gemm_avx2;
+        break;
+    case QUANT_KERNEL_VNNI:
+        if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("avxvnni")) return -1;
+        gemm_fn = gemm_vnni;
+        break;
+#endif
+    default:
+        return -1;
+    }
+    gemm_kind = kernel;
+    return 0;
+}
+
+const char* quant_kernel_name(void) {
+    if (!gemm_fn) quant_select_kernel(QUANT_KERNEL_AUTO);
+    switch (gemm_kind) {
+    case QUANT_KERNEL_VNNI: return "avx-vnni";
+    case QUANT_KERNEL_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
+
+void quant_gemm_u8s8(const int8_t* w, const uint8_t* x, int32_t* out, size_t rows, size_t cols, size_t n) {
+    if (!gemm_fn) quant_select_kernel(QUANT_KERNEL_AUTO);
+    gemm_fn(w, x, out, rows, cols, n);
+}
+
+// Quantizes a (rows, cols) double weight matrix with one symmetric scale per row
+QuantLinear* quant_linear_new(MDArray* weights, MDArray* biases) {
+    if (!weights || weights->ndim != 2 || !biases || biases->total_size != weights->shape[0]) {
+        printf("quant_linear_new expects (rows, cols) weights and rows biases\n");
+        return NULL;
+    }
+
+    QuantLinear* q = (QuantLinear*)malloc(sizeof(QuantLinear));
+    if (!q) return NULL;
+    q->rows = weights->shape[0];
+    q->cols = weights->shape[1];
+    q->weights = (int8_t*)malloc(q->rows * q->cols);
+    q->scales = (float*)malloc(q->rows * sizeof(float));
+    q->biases = (double*)malloc(q->rows * sizeof(double));
+    if (!q->weights || !q->scales || !q->biases) {
+        quant_linear_free(q);
+        return NULL;
+    }
+
+    for (size_t r = 0; r < q->rows; r++) {
+        double max_abs = 0.0;
+        for (size_t k = 0; k < q->cols; k++) {
+            size_t idx[] = {r, k};
+            double v = fabs(*(double*)mdarray_get_element(weights, idx));
+            if (v > max_abs) max_abs = v;
+        }
+        double scale = max_abs > 0.0 ? max_abs / 127.0 : 1.0;
+        q->scales[r] = (float)scale;
+
+        for (size_t k = 0; k < q->cols; k++) {
+            size_t idx[] = {r, k};
+            double v = nearbyint(*(double*)mdarray_get_element(weights, idx) / scale);
+            if (v > 127.0) v = 127.0;
+            if (v < -127.0) v = -127.0;
+            q->weights[r * q->cols + k] = (int8_t)v;
+        }
+
+        q->biases[r] = ((double*)biases->data)[r];
+    }
+
+    return q;
+}
+
+void quant_linear_free(QuantLinear* q) {
+    if (q) {
+        free(q->weights);
+        free(q->scales);
+        free(q->biases);
+        free(q);
+    }
+}
+
+// (N, ...) pixel tensor -> (N, features) uint8, a view when the pixels already are uint8
+MDArray* quant_pack_inputs(MDArray* images) {
+    if (!images || images->ndim < 2) return NULL;
+    if (images->shape[0] == 0) {
+        printf("quant_pack_inputs expects at least one image\n");
+        return NULL;
+    }
+
+    size_t n = images->shape[0];
+    size_t shape[] = {n, images->total_size / n};
+    if (images->itemsize == 1) return mdarray_resize(images, 2, shape);
+
+    MDArray* out = mdarray_create(2, shape, 1);
+    if (!out) return NULL;
+
+    const double* src = (const double*)images->data;
+    uint8_t* dst = (uint8_t*)out->data;
+    for (size_t i = 0; i < images->total_size; i++) {
+        double v = src[i];
+        dst[i] = v <= 0.0 ? 0 : v >= 255.0 ? 255 : (uint8_t)(v + 0.5);
+    }
+
+    return out;
+}
+
+// inputs (N, cols) uint8 -> scores (rows, N) double, same layout as linearmodel_forward
+MDArray* quant_linear_forward(QuantLinear* q, MDArray* inputs) {
+    if (!inputs || inputs->ndim != 2 || inputs->itemsize != 1 || inputs->shape[1] != q->cols) {
+        printf("quant_linear_forward expects (N, %zu) uint8 inputs\n", q->cols);
+        return NULL;
+    }
+
+    size_t n = inputs->shape[0];
+    int32_t* acc = (int32_t*)malloc(q->rows * n * sizeof(int32_t));
+    if (!acc) return NULL;
+    quant_gemm_u8s8(q->weights, (const uint8_t*)inputs->data, acc, q->rows, q->cols, n);
+
+    size_t shape[] = {q->rows, n};
+    MDArray* scores = mdarray_create(2, shape, sizeof(double));
+    if (!scores) {
+        free(acc);
+        return NULL;
+    }
+
+    double* out = (double*)scores->data;
+    for (size_t r = 0; r < q->rows; r++) {
+        double scale = q->scales[r];
+        double b = q->biases[r];
+        for (size_t j = 0; j < n; j++) out[r * n + j] = (double)acc[r * n + j] * scale + b;
+    }
+
+    free(acc);
+    return scores;
+}
@@ -0,0 +1,33 @@
+// quant.h
+#ifndef QUANT_H
+#define QUANT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mdarray.h"
+
+typedef enum {
+    QUANT_KERNEL_AUTO,            // Best kernel the CPU supports
+    QUANT_KERNEL_SCALAR,
+    QUANT_KERNEL_AVX2,            // Widen to int16 and madd, no saturation
+    QUANT_KERNEL_VNNI             // AVX-VNNI dpbusd, u8 x s8 straight into int32
+} QuantKernel;
+
+// Post-training int8 copy of a linear layer, weights are symmetric per row
+typedef struct {
+    int8_t* weights;              // (rows, cols) row-major
+    float* scales;                // Per-row dequantization scale
+    double* biases;               // (rows)
+    size_t rows;
+    size_t cols;
+} QuantLinear;
+
+QuantLinear* quant_linear_new(MDArray* weights, MDArray* biases);
+void quant_linear_free(QuantLinear* q);
+MDArray* quant_pack_inputs(MDArray* images);
+MDArray* quant_linear_forward(QuantLinear* q, MDArray* inputs);
+void quant_gemm_u8s8(const int8_t* w, const uint8_t* x, int32_t* out, size_t rows, size_t cols, size_t n);
+int quant_select_kernel(QuantKernel kernel);
+const char* quant_kernel_name(void);
+
+#endif // QUANT_H
@@ -0,0 +1,410 @@
+#include "server.h"
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+typedef struct {
+    int fd;
+    unsigned char buf[1 + SERVER_IMG_SIZE];
+    size_t filled;
+    unsigned char* out;           // Encoded replies the socket has not taken yet
+    size_t out_len;
+    size_t out_cap;
+    bool broken;                  // A send failed, closed at the end of the poll round
+} Client;
+
+typedef struct {
+    int fd;                       // -1 once the client went away
+    double arrival;
+    unsigned char pixels[SERVER_IMG_SIZE];
+} Pending;
+
+typedef struct {
+    ServerConfig* config;
+    ServerForwardFn forward;
+    void* ctx;
+
+    Client clients[SERVER_MAX_CLIENTS];
+    size_t n_clients;
+
+    Pending* pending;
+    size_t n_pending;
+
+    double latencies[SERVER_LAT_WINDOW];
+    size_t n_latencies;
+    size_t next_latency;
+    uint64_t requests;
+    uint64_t batches;
+    double start;
+} Server;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+void server_stop(void) {
+    stop_requested = 1;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile, p in [0, 1]
+double server_percentile(const double* samples, size_t n, double p) {
+    if (n == 0) return 0.0;
+
+    double* sorted = (double*)malloc(n * sizeof(double));
+    if (!sorted) return 0.0;
+    memcpy(sorted, samples, n * sizeof(double));
+    qsort(sorted, n, sizeof(double), cmp_double);
+
+    size_t rank = (size_t)ceil(p * (double)n);
+    if (rank == 0) rank = 1;
+    if (rank > n) rank = n;
+    double out = sorted[rank - 1];
+    free(sorted);
+    return out;
+}
+
+// Field-by-field copies, so struct padding never reaches the socket
+static unsigned char* put(unsigned char* out, const void* field, size_t len) {
+    memcpy(out, field, len);
+    return out + len;
+}
+
+static const unsigned char* get(const unsigned char* in, void* field, size_t len) {
+    memcpy(field, in, len);
+    return in + len;
+}
+
+void server_encode_reply(const ServerReply* reply, unsigned char* out) {
+    out = put(out, &reply->label, sizeof(reply->label));
+    put(out, reply->scores, sizeof(reply->scores));
+}
+
+void server_decode_reply(const unsigned char* in, ServerReply* reply) {
+    in = get(in, &reply->label, sizeof(reply->label));
+    get(in, reply->scores, sizeof(reply->scores));
+}
+
+void server_encode_stats(const ServerStats* stats, unsigned char* out) {
+    out = put(out, &stats->requests, sizeof(stats->requests));
+    out = put(out, &stats->batches, sizeof(stats->batches));
+    out = put(out, &stats->p50_us, sizeof(stats->p50_us));
+    out = put(out, &stats->p99_us, sizeof(stats->p99_us));
+    out = put(out, &stats->throughput, sizeof(stats->throughput));
+    put(out, &stats->mean_batch, sizeof(stats->mean_batch));
+}
+
+void server_decode_stats(const unsigned char* in, ServerStats* stats) {
+    in = get(in, &stats->requests, sizeof(stats->requests));
+    in = get(in, &stats->batches, sizeof(stats->batches));
+    in = get(in, &stats->p50_us, sizeof(stats->p50_us));
+    in = get(in, &stats->p99_us, sizeof(stats->p99_us));
+    in = get(in, &stats->throughput, sizeof(stats->throughput));
+    get(in, &stats->mean_batch, sizeof(stats->mean_batch));
+}
+
+// Sends as much of the queue as the socket takes without blocking; the rest waits for POLLOUT
+static void flush_client(Client* cl) {
+    size_t sent = 0;
+    while (sent < cl->out_len) {
+        ssize_t n = send(cl->fd, cl->out + sent, cl->out_len - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) cl->broken = true;
+            break;
+        }
+        sent += (size_t)n;
+    }
+    memmove(cl->out, cl->out + sent, cl->out_len - sent);
+    cl->out_len -= sent;
+}
+
+static Client* find_client(Server* s, int fd) {
+    for (size_t c = 0; c < s->n_clients; c++) {
+        if (s->clients[c].fd == fd) return &s->clients[c];
+    }
+    return NULL;
+}
+
+// Appends an encoded reply to the client's queue and sends what it can right away. A slow
+// reader never stalls the loop: it stops being polled for requests until its queue drains,
+// so the queue holds at most one batch of replies.
+static void queue_reply(Client* cl, const unsigned char* bytes, size_t len) {
+    if (cl->broken) return;
+    if (cl->out_len + len > cl->out_cap) {
+        size_t cap = cl->out_cap ? 2 * cl->out_cap : 4 * SERVER_REPLY_BYTES;
+        while (cap < cl->out_len + len) cap *= 2;
+        unsigned char* out = (unsigned char*)realloc(cl->out, cap);
+        if (!out) {
+            cl->broken = true;
+            return;
+        }
+        cl->out = out;
+        cl->out_cap = cap;
+    }
+    memcpy(cl->out + cl->out_len, bytes, len);
+    cl->out_len += len;
+    flush_client(cl);
+}
+
+static void fill_stats(Server* s, ServerStats* stats) {
+    stats->requests = s->requests;
+    stats->batches = s->batches;
+    stats->p50_us = server_percentile(s->latencies, s->n_latencies, 0.50);
+    stats->p99_us = server_percentile(s->latencies, s->n_latencies, 0.99);
+    double elapsed = now_sec() - s->start;
+    stats->throughput = elapsed > 0.0 ? (double)s->requests / elapsed : 0.0;
+    stats->mean_batch = s->batches ? (double)s->requests / (double)s->batches : 0.0;
+}
+
+// Runs a single forward pass over every queued request and answers them
+static void flush_batch(Server* s) {
+    size_t b = s->n_pending;
+    if (b == 0) return;
+
+    size_t shape[] = {b, 28, 28};
+    MDArray* imgs = mdarray_create(3, shape, sizeof(double));
+    if (!imgs) return;
+
+    double* px = (double*)imgs->data;
+    for (size_t i = 0; i < b; i++) {
+        for (size_t k = 0; k < SERVER_IMG_SIZE; k++) {
+            px[i * SERVER_IMG_SIZE + k] = (double)s->pending[i].pixels[k];
+        }
+    }
+
+    MDArray* scores = s->forward(s->ctx, imgs);
+    mdarray_free(imgs);
+    if (!scores) {
+        printf("Forward pass failed for batch of %zu\n", b);
+        s->n_pending = 0;
+        return;
+    }
+
+    double done = now_sec();
+    for (size_t i = 0; i < b; i++) {
+        ServerReply reply;
+        reply.label = 0;
+        for (size_t c = 0; c < SERVER_NUM_CLASSES; c++) {
+            size_t idx[] = {c, i};
+            reply.scores[c] = *(double*)mdarray_get_element(scores, idx);
+            if (reply.scores[c] > reply.scores[reply.label]) reply.label = (uint32_t)c;
+        }
+
+        Client* cl = s->pending[i].fd >= 0 ? find_client(s, s->pending[i].fd) : NULL;
+        if (cl) {
+            unsigned char bytes[SERVER_REPLY_BYTES];
+            server_encode_reply(&reply, bytes);
+            queue_reply(cl, bytes, sizeof(bytes));
+        }
+
+        s->latencies[s->next_latency] = (done - s->pending[i].arrival) * 1e6;
+        s->next_latency = (s->next_latency + 1) % SERVER_LAT_WINDOW;
+        if (s->n_latencies < SERVER_LAT_WINDOW) s->n_latencies++;
+        s->requests++;
+    }
+    s->batches++;
+    s->n_pending = 0;
+
+    mdarray_free(scores);
+}
+
+static void close_client(Server* s, size_t c) {
+    int fd = s->clients[c].fd;
+    for (size_t i = 0; i < s->n_pending; i++) {
+        if (s->pending[i].fd == fd) s->pending[i].fd = -1;
+    }
+    close(fd);
+    free(s->clients[c].out);
+    s->clients[c] = s->clients[s->n_clients - 1];
+    s->n_clients--;
+}
+
+// Reads what is available of the current frame, returns -1 if the client is gone
+static int read_client(Server* s, Client* cl) {
+    size_t frame = 1;
+    if (cl->filled > 0 && cl->buf[0] == SERVER_OP_INFER) frame += SERVER_IMG_SIZE;
+
+    ssize_t n = read(cl->fd, cl->buf + cl->filled, frame - cl->filled);
+    if (n <= 0) return -1;
+    cl->filled += (size_t)n;
+
+    if (cl->filled == 1) {
+        if (cl->buf[0] == SERVER_OP_STATS) {
+            ServerStats stats;
+            unsigned char bytes[SERVER_STATS_BYTES];
+            fill_stats(s, &stats);
+            server_encode_stats(&stats, bytes);
+            cl->filled = 0;
+            queue_reply(cl, bytes, sizeof(bytes));
+            return cl->broken ? -1 : 0;
+        }
+        if (cl->buf[0] != SERVER_OP_INFER) {
+            printf("Unknown opcode %d\n", cl->buf[0]);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (cl->filled == 1 + SERVER_IMG_SIZE) {
+        Pending* p = &s->pending[s->n_pending++];
+        p->fd = cl->fd;
+        p->arrival = now_sec();
+        memcpy(p->pixels, cl->buf + 1, SERVER_IMG_SIZE);
+        cl->filled = 0;
+        if (s->n_pending == s->config->max_batch) flush_batch(s);
+    }
+    return 0;
+}
+
+static int listen_unix(const char* path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("Socket path too long: %s\n", path);
+        close(fd);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        perror("bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Serves requests until server_stop() or SIGINT/SIGTERM. Returns 0 on clean shutdown.
+int server_run(ServerConfig* config, ServerForwardFn forward, void* ctx) {
+    if (config->max_batch == 0) config->max_batch = 1;
+
+    Server* s = (Server*)calloc(1, sizeof(Server));
+    if (!s) return -1;
+    s->config = config;
+    s->forward = forward;
+    s->ctx = ctx;
+    s->pending = (Pending*)malloc(config->max_batch * sizeof(Pending));
+    if (!s->pending) {
+        free(s);
+        return -1;
+    }
+
+    int lfd = listen_unix(config->socket_path);
+    if (lfd < 0) {
+        free(s->pending);
+        free(s);
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Serving on %s (max batch %zu, max delay %.2f ms)\n",
+           config->socket_path, config->max_batch, config->max_delay_ms);
+
+    stop_requested = 0;
+    s->start = now_sec();
+    struct pollfd fds[1 + SERVER_MAX_CLIENTS];
+
+    while (!stop_requested) {
+        // Sleep until the oldest queued request hits its deadline
+        int timeout = 100;
+        if (s->n_pending > 0) {
+            double wait_ms = (s->pending[0].arrival - now_sec()) * 1e3 + config->max_delay_ms;
+            timeout = wait_ms <= 0.0 ? 0 : (int)ceil(wait_ms);
+            if (timeout > 100) timeout = 100;
+        }
+
+        fds[0].fd = lfd;
+        fds[0].events = POLLIN;
+        // Clients with replies still queued are only polled for writability
+        for (size_t c = 0; c < s->n_clients; c++) {
+            fds[1 + c].fd = s->clients[c].fd;
+            fds[1 + c].events = s->clients[c].out_len > 0 ? POLLOUT : POLLIN;
+        }
+        size_t nfds = 1 + s->n_clients;
+
+        int rc = poll(fds, nfds, timeout);
+        if (rc < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // Walk clients backwards so close_client's swap-remove is safe
+        for (size_t c = nfds - 1; c >= 1; c--) {
+            Client* cl = &s->clients[c - 1];
+            if (fds[c].revents & POLLOUT) flush_client(cl);
+            if (!(fds[c].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            if (read_client(s, cl) < 0) close_client(s, c - 1);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int cfd = accept(lfd, NULL, NULL);
+            if (cfd >= 0) {
+                if (s->n_clients == SERVER_MAX_CLIENTS) {
+                    close(cfd);
+                } else {
+                    memset(&s->clients[s->n_clients], 0, sizeof(Client));
+                    s->clients[s->n_clients].fd = cfd;
+                    s->n_clients++;
+                }
+            }
+        }
+
+        if (s->n_pending > 0 &&
+            (now_sec() - s->pending[0].arrival) * 1e3 >= config->max_delay_ms) {
+            flush_batch(s);
+        }
+        for (size_t c = s->n_clients; c > 0; c--) {
+            if (s->clients[c - 1].broken) close_client(s, c - 1);
+        }
+    }
+
+    // Last batch and whatever the sockets take right now, nobody waits on shutdown
+    flush_batch(s);
+    for (size_t c = 0; c < s->n_clients; c++) flush_client(&s->clients[c]);
+
+    ServerStats stats;
+    fill_stats(s, &stats);
+    printf("Served %llu requests in %llu batches (mean batch %.1f)\n",
+           (unsigned long long)stats.requests, (unsigned long long)stats.batches, stats.mean_batch);
+    printf("Latency p50 %.1f us, p99 %.1f us, throughput %.1f req/s\n",
+           stats.p50_us, stats.p99_us, stats.throughput);
+
+    while (s->n_clients > 0) close_client(s, s->n_clients - 1);
+    close(lfd);
+    unlink(config->socket_path);
+    free(s->pending);
+    free(s);
+    return 0;
+}
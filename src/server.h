@@ -0,0 +1,53 @@
+// server.h
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mdarray.h"
+
+#define SERVER_IMG_SIZE    784
+#define SERVER_NUM_CLASSES 10
+#define SERVER_MAX_CLIENTS 256
+#define SERVER_LAT_WINDOW  4096   // Latency samples kept for percentiles
+
+// Every client frame starts with one opcode byte
+#define SERVER_OP_INFER 'I'       // Followed by 784 uint8 pixels, replies ServerReply
+#define SERVER_OP_STATS 'S'       // No payload, replies ServerStats
+
+// Replies are serialized field by field in declaration order, host byte order, no padding
+#define SERVER_REPLY_BYTES (4 + 8 * SERVER_NUM_CLASSES)
+#define SERVER_STATS_BYTES (2 * 8 + 4 * 8)
+
+// Runs the model on a (B, 28, 28) batch and returns (10, B) scores
+typedef MDArray* (*ServerForwardFn)(void* ctx, MDArray* images);
+
+typedef struct {
+    const char* socket_path;
+    size_t max_batch;             // Flush as soon as this many requests are queued
+    double max_delay_ms;          // Flush once the oldest request waited this long
+} ServerConfig;
+
+typedef struct {
+    uint32_t label;               // Argmax of scores
+    double scores[SERVER_NUM_CLASSES];
+} ServerReply;
+
+typedef struct {
+    uint64_t requests;            // Requests answered
+    uint64_t batches;             // Forward passes run
+    double p50_us;                // Median request latency in microseconds
+    double p99_us;
+    double throughput;            // Requests per second since start
+    double mean_batch;            // Average batch size
+} ServerStats;
+
+int server_run(ServerConfig* config, ServerForwardFn forward, void* ctx);
+void server_stop(void);
+double server_percentile(const double* samples, size_t n, double p);
+void server_encode_reply(const ServerReply* reply, unsigned char* out);
+void server_decode_reply(const unsigned char* in, ServerReply* reply);
+void server_encode_stats(const ServerStats* stats, unsigned char* out);
+void server_decode_stats(const unsigned char* in, ServerStats* stats);
+
+#endif // SERVER_H
@@ -0,0 +1,173 @@
+#include "softmax.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOFTMAX_X86 1
+#endif
+
+// Below this many scores the pass stays on the calling thread
+#define SOFTMAX_PARALLEL_MIN (1u << 15)
+
+typedef struct {
+    const double* s;              // (classes, n) scores, one sample per column
+    double* ds;                   // Same layout, NULL for loss only
+    const size_t* labels;
+    size_t classes;
+    size_t n;
+    double* partial;              // Per-thread loss sums
+} SoftmaxJob;
+
+// Loss sum over samples [lo, hi), writing their gradients when ds is set
+typedef double (*SoftmaxFn)(SoftmaxJob* job, size_t lo, size_t hi);
+
+static SoftmaxFn kernel_fn = NULL;
+static const char* kernel_name = "scalar";
+
+static double softmax_scalar(SoftmaxJob* job, size_t lo, size_t hi) {
+    size_t n = job->n, classes = job->classes;
+    double inv_n = 1.0 / (double)n, total = 0.0;
+    for (size_t i = lo; i < hi; i++) {
+        const double* s = job->s + i;
+        double m = s[0];
+        for (size_t c = 1; c < classes; c++) m = s[c * n] > m ? s[c * n] : m;
+
+        double e[SOFTMAX_MAX_CLASSES], sum = 0.0;
+        for (size_t c = 0; c < classes; c++) {
+            e[c] = exp(s[c * n] - m);
+            sum += e[c];
+        }
+        size_t y = job->labels[i];
+        total += log(sum) - (s[y * n] - m);
+
+        if (job->ds) {
+            double scale = inv_n / sum;
+            for (size_t c = 0; c < classes; c++) job->ds[c * n + i] = e[c] * scale;
+            job->ds[y * n + i] -= inv_n;
+        }
+    }
+    return total;
+}
+
+#ifdef SOFTMAX_X86
+// e^x for x <= 0: x = k ln2 + r with |r| <= ln2 / 2, e^r from a degree-7 polynomial (relative
+// error about 5e-9), 2^k built directly in the exponent bits. Inputs below -708 flush to ~0.
+__attribute__((target("avx2,fma")))
+static inline __m256d exp_avx2(__m256d x) {
+    x = _mm256_max_pd(x, _mm256_set1_pd(-708.0));
+    __m256d k = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(k, _mm256_set1_pd(6.93145751953125e-1), x);
+    r = _mm256_fnmadd_pd(k, _mm256_set1_pd(1.42860682030941723212e-6), r);
+
+    __m256d p = _mm256_set1_pd(1.0 / 5040.0);
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 720.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 120.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 24.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 6.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(0.5));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+
+    __m256i ki = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(k));
+    __m256i bits = _mm256_slli_epi64(_mm256_add_epi64(ki, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(bits));
+}
+
+// Four samples per step, one per lane. Scores are read once and each exponential stays in a
+// register until its normalised gradient is stored.
+__attribute__((target("avx2,fma")))
+static double softmax_avx2(SoftmaxJob* job, size_t lo, size_t hi) {
+    size_t n = job->n, classes = job->classes;
+    double inv_n = 1.0 / (double)n, total = 0.0;
+    size_t i = lo;
+    for (; i + 4 <= hi; i += 4) {
+        const double* s = job->s + i;
+        __m256d m = _mm256_loadu_pd(s);
+        for (size_t c = 1; c < classes; c++) m = _mm256_max_pd(m, _mm256_loadu_pd(s + c * n));
+
+        __m256d e[SOFTMAX_MAX_CLASSES];
+        __m256d sum = _mm256_setzero_pd();
+        for (size_t c = 0; c < classes; c++) {
+            e[c] = exp_avx2(_mm256_sub_pd(_mm256_loadu_pd(s + c * n), m));
+            sum = _mm256_add_pd(sum, e[c]);
+        }
+
+        double sums[4], maxes[4];
+        _mm256_storeu_pd(sums, sum);
+        _mm256_storeu_pd(maxes, m);
+        for (size_t j = 0; j < 4; j++) {
+            size_t y = job->labels[i + j];
+            total += log(sums[j]) - (s[y * n + j] - maxes[j]);
+        }
+
+        if (job->ds) {
+            __m256d scale = _mm256_div_pd(_mm256_set1_pd(inv_n), sum);
+            for (size_t c = 0; c < classes; c++) _mm256_storeu_pd(job->ds + c * n + i, _mm256_mul_pd(e[c], scale));
+            for (size_t j = 0; j < 4; j++) job->ds[job->labels[i + j] * n + i + j] -= inv_n;
+        }
+    }
+    return total + softmax_scalar(job, i, hi);
+}
+#endif
+
+// Returns 0 if the requested kernel is usable and now selected
+int softmax_select_kernel(bool simd) {
+    if (!simd) {
+        kernel_fn = softmax_scalar;
+        kernel_name = "scalar";
+        return 0;
+    }
+#ifdef SOFTMAX_X86
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernel_fn = softmax_avx2;
+        kernel_name = "avx2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char* softmax_kernel_name(void) {
+    if (!kernel_fn && softmax_select_kernel(true) != 0) softmax_select_kernel(false);
+    return kernel_name;
+}
+
+static void softmax_worker(size_t tid, size_t n_threads, void* arg) {
+    SoftmaxJob* job = (SoftmaxJob*)arg;
+    size_t lo, hi;
+    parallel_range(tid, n_threads, job->n, &lo, &hi);
+    job->partial[tid] = kernel_fn(job, lo, hi);
+}
+
+// Mean softmax cross-entropy of (classes, n) scores, max-shifted so large scores cannot
+// overflow. With dscores set, its gradient (softmax - onehot) / n is written in the same pass.
+double softmax_xent(MDArray* scores, const size_t* labels, size_t n, MDArray* dscores) {
+    if (scores->ndim != 2 || scores->shape[1] != n || scores->shape[0] == 0 ||
+        scores->shape[0] > SOFTMAX_MAX_CLASSES || (dscores && dscores->total_size != scores->total_size)) {
+        printf("softmax_xent: expected (classes <= %d, %zu) scores and a matching gradient\n",
+               SOFTMAX_MAX_CLASSES, n);
+        return -1.0;
+    }
+    if (n == 0) return 0.0;
+    softmax_kernel_name();
+
+    SoftmaxJob job = {(const double*)scores->data, dscores ? (double*)dscores->data : NULL, labels,
+                      scores->shape[0], n, NULL};
+    size_t n_threads = scores->total_size < SOFTMAX_PARALLEL_MIN ? 1 : parallel_threads();
+    if (n_threads > n) n_threads = n;
+    job.partial = (double*)calloc(n_threads, sizeof(double));
+    if (!job.partial) {
+        printf("softmax_xent: out of memory\n");
+        return -1.0;
+    }
+    parallel_run(n_threads, softmax_worker, &job);
+
+    double total = 0.0;
+    for (size_t t = 0; t < n_threads; t++) total += job.partial[t];
+    free(job.partial);
+    return total / (double)n;
+}
@@ -0,0 +1,15 @@
+// softmax.h
+#ifndef SOFTMAX_H
+#define SOFTMAX_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "mdarray.h"
+
+#define SOFTMAX_MAX_CLASSES 16
+
+double softmax_xent(MDArray* scores, const size_t* labels, size_t n, MDArray* dscores);
+int softmax_select_kernel(bool simd);
+const char* softmax_kernel_name(void);
+
+#endif // SOFTMAX_H
@@ -0,0 +1,14 @@
+// timing.h
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <time.h>
+
+// Monotonic wall clock in seconds, for throughput and latency reports
+static inline double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#endif // TIMING_H
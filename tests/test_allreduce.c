@@ -0,0 +1,102 @@
+#include "unity.h"
+#include "allreduce.h"
+#include <math.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define RANKS 3
+#define COUNT 1001  // Not a multiple of RANKS so chunks are uneven
+
+static double value(size_t rank, size_t i) {
+    return (double)(rank + 1) * 1000.0 + (double)i;
+}
+
+static double expected(size_t i) {
+    double sum = 0.0;
+    for (size_t r = 0; r < RANKS; r++) sum += value(r, i);
+    return sum;
+}
+
+// Forks RANKS - 1 children, runs body on every rank and returns how many ranks failed
+static int run_ranks(int (*body)(AllreduceGroup*, size_t)) {
+    AllreduceGroup* g = allreduce_group_new(RANKS, COUNT);
+    pid_t pids[RANKS];
+    for (size_t r = 1; r < RANKS; r++) {
+        pids[r] = fork();
+        if (pids[r] == 0) _exit(body(g, r));
+    }
+
+    int failures = body(g, 0);
+    for (size_t r = 1; r < RANKS; r++) {
+        int status;
+        waitpid(pids[r], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failures++;
+    }
+    allreduce_group_free(g);
+    return failures;
+}
+
+static int sum_body(AllreduceGroup* g, size_t rank) {
+    double data[COUNT];
+    for (size_t i = 0; i < COUNT; i++) data[i] = value(rank, i);
+
+    // Twice, to make sure the slots can be reused
+    for (int round = 0; round < 2; round++) {
+        allreduce_sum(g, rank, data, 0, COUNT);
+        for (size_t i = 0; i < COUNT; i++) {
+            double want = round == 0 ? expected(i) : RANKS * expected(i);
+            if (fabs(data[i] - want) > 1e-9) return 1;
+        }
+    }
+    return 0;
+}
+
+static int stream_body(AllreduceGroup* g, size_t rank) {
+    double data[COUNT];
+    AllreduceStream* s = allreduce_stream_start(g, rank, data, 8);
+
+    // Buckets posted one at a time while the next one is still being filled
+    size_t bounds[] = {0, 100, 400, 401, COUNT};
+    for (size_t b = 0; b + 1 < 5; b++) {
+        for (size_t i = bounds[b]; i < bounds[b + 1]; i++) data[i] = value(rank, i);
+        allreduce_stream_post(s, bounds[b], bounds[b + 1] - bounds[b]);
+    }
+    allreduce_stream_wait(s);
+    allreduce_stream_stop(s);
+
+    for (size_t i = 0; i < COUNT; i++) {
+        if (fabs(data[i] - expected(i)) > 1e-9) return 1;
+    }
+    return 0;
+}
+
+// Rank 1 cannot go on in the second round, every rank must see it and none may hang
+static int check_body(AllreduceGroup* g, size_t rank) {
+    if (allreduce_check(g, true) != 0) return 1;
+    if (allreduce_check(g, rank != 1) != -1) return 1;
+    return 0;
+}
+
+void test_allreduce_sum_across_processes(void) {
+    TEST_ASSERT_EQUAL(0, run_ranks(sum_body));
+}
+
+void test_allreduce_stream_buckets(void) {
+    TEST_ASSERT_EQUAL(0, run_ranks(stream_body));
+}
+
+void test_allreduce_check_aborts_every_rank(void) {
+    TEST_ASSERT_EQUAL(0, run_ranks(check_body));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_allreduce_sum_across_processes);
+    RUN_TEST(test_allreduce_stream_buckets);
+    RUN_TEST(test_allreduce_check_aborts_every_rank);
+    return UNITY_END();
+}
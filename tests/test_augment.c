@@ -0,0 +1,150 @@
+#include "unity.h"
+#include "augment.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define N 37
+#define BATCH 8
+
+static void make_images(uint8_t* images, size_t* labels) {
+    uint64_t x = 42;
+    for (size_t i = 0; i < N; i++) {
+        for (size_t k = 0; k < AUGMENT_PIXELS; k++) {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+            images[i * AUGMENT_PIXELS + k] = (uint8_t)(x >> 56);
+        }
+        labels[i] = i % 10;
+    }
+}
+
+void test_identity_config_reproduces_input(void) {
+    uint8_t* images = (uint8_t*)malloc(N * AUGMENT_PIXELS);
+    size_t labels[N];
+    double dst[AUGMENT_PIXELS];
+    make_images(images, labels);
+
+    AugmentConfig none = {0.0, 0.0, 0.0, 0.0, 1};
+    uint64_t rng = 7;
+    augment_image(images, dst, &none, &rng);
+    for (size_t k = 0; k < AUGMENT_PIXELS; k++) TEST_ASSERT_TRUE(fabs(dst[k] - (double)images[k]) <= 1e-3);
+    free(images);
+}
+
+void test_shift_moves_pixels(void) {
+    uint8_t src[AUGMENT_PIXELS] = {0};
+    double dst[AUGMENT_PIXELS];
+    src[10 * AUGMENT_SIDE + 10] = 200;
+
+    // Shifts are drawn in [-1, 1) pixels; a whole-pixel shift lands the dot on one pixel
+    AugmentConfig shift = {1.0, 0.0, 0.0, 0.0, 1};
+    uint64_t rng = 3;
+    augment_image(src, dst, &shift, &rng);
+
+    double total = 0.0, cx = 0.0, cy = 0.0;
+    for (size_t y = 0; y < AUGMENT_SIDE; y++) {
+        for (size_t x = 0; x < AUGMENT_SIDE; x++) {
+            double v = dst[y * AUGMENT_SIDE + x];
+            total += v;
+            cx += v * (double)x;
+            cy += v * (double)y;
+        }
+    }
+    TEST_ASSERT_TRUE(fabs(total - 200.0) <= 1e-2);
+    TEST_ASSERT_TRUE(fabs(cx / total - 10.0) <= 1.0 && fabs(cy / total - 10.0) <= 1.0);
+    TEST_ASSERT_TRUE(fabs(cx / total - 10.0) > 1e-3 || fabs(cy / total - 10.0) > 1e-3);
+}
+
+void test_simd_matches_scalar(void) {
+    uint8_t* images = (uint8_t*)malloc(N * AUGMENT_PIXELS);
+    size_t labels[N];
+    make_images(images, labels);
+    double a[AUGMENT_PIXELS], b[AUGMENT_PIXELS];
+    AugmentConfig cfg = {2.0, 0.3, 0.1, 1.5, 1};
+
+    if (augment_select_kernel(true) != 0) {
+        free(images);
+        return;  // Not supported on this CPU
+    }
+    for (size_t i = 0; i < N; i++) {
+        uint64_t r1 = i + 1, r2 = i + 1;
+        augment_select_kernel(true);
+        augment_image(images + i * AUGMENT_PIXELS, a, &cfg, &r1);
+        augment_select_kernel(false);
+        augment_image(images + i * AUGMENT_PIXELS, b, &cfg, &r2);
+        for (size_t k = 0; k < AUGMENT_PIXELS; k++) TEST_ASSERT_TRUE(fabs(a[k] - b[k]) <= 1e-3);
+    }
+    augment_select_kernel(true);
+    free(images);
+}
+
+// Copies of the first n_batches batches of a pipeline with n_workers workers
+static void run_stream(const uint8_t* images, const size_t* labels, size_t n_workers, size_t n_batches,
+                       double* out, size_t* out_labels) {
+    AugmentConfig cfg = {2.0, 0.2, 0.1, 1.0, 5};
+    AugmentPipeline* p = augment_start(images, labels, N, BATCH, n_workers, &cfg);
+    TEST_ASSERT_NOT_NULL(p);
+    for (size_t b = 0; b < n_batches; b++) {
+        AugmentSlot* slot = augment_next(p);
+        TEST_ASSERT_EQUAL(b, slot->seq);
+        memcpy(out + b * BATCH * AUGMENT_PIXELS, slot->images->data, BATCH * AUGMENT_PIXELS * sizeof(double));
+        memcpy(out_labels + b * BATCH, slot->labels, BATCH * sizeof(size_t));
+        augment_release(p, slot);
+    }
+    augment_stop(p);
+}
+
+void test_stream_independent_of_worker_count(void) {
+    uint8_t* images = (uint8_t*)malloc(N * AUGMENT_PIXELS);
+    size_t labels[N];
+    make_images(images, labels);
+
+    size_t n_batches = 12;
+    double* one = (double*)malloc(n_batches * BATCH * AUGMENT_PIXELS * sizeof(double));
+    double* three = (double*)malloc(n_batches * BATCH * AUGMENT_PIXELS * sizeof(double));
+    size_t l1[12 * BATCH], l3[12 * BATCH];
+    run_stream(images, labels, 1, n_batches, one, l1);
+    run_stream(images, labels, 3, n_batches, three, l3);
+
+    TEST_ASSERT_EQUAL_MEMORY(one, three, n_batches * BATCH * AUGMENT_PIXELS * sizeof(double));
+    TEST_ASSERT_EQUAL_MEMORY(l1, l3, sizeof(l1));
+
+    free(one);
+    free(three);
+    free(images);
+}
+
+void test_every_sample_once_per_epoch(void) {
+    uint8_t* images = (uint8_t*)malloc(N * AUGMENT_PIXELS);
+    size_t labels[N];
+    make_images(images, labels);
+    // Label i identifies sample i for this test
+    for (size_t i = 0; i < N; i++) labels[i] = i;
+
+    // N * BATCH samples are exactly BATCH epochs
+    double* out = (double*)malloc(N * BATCH * AUGMENT_PIXELS * sizeof(double));
+    size_t seen[N * BATCH];
+    run_stream(images, labels, 2, N, out, seen);
+
+    for (size_t e = 0; e < BATCH; e++) {
+        int count[N] = {0};
+        for (size_t q = e * N; q < (e + 1) * N; q++) count[seen[q]]++;
+        for (size_t i = 0; i < N; i++) TEST_ASSERT_EQUAL(1, count[i]);
+    }
+
+    free(out);
+    free(images);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_identity_config_reproduces_input);
+    RUN_TEST(test_shift_moves_pixels);
+    RUN_TEST(test_simd_matches_scalar);
+    RUN_TEST(test_stream_independent_of_worker_count);
+    RUN_TEST(test_every_sample_once_per_epoch);
+    return UNITY_END();
+}
@@ -0,0 +1,144 @@
+#include "unity.h"
+#include "mdarray.h"
+#include "linear.h"
+#include "autograd.h"
+#include <math.h>
+#include <string.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define FLOAT_EPSILON 0.0001f
+static int float_eq(double a, double b) {
+    return fabs(a - b) < FLOAT_EPSILON;
+}
+
+static MDArray* matrix(size_t rows, size_t cols, double scale) {
+    size_t shape[] = {rows, cols};
+    MDArray* arr = mdarray_create(2, shape, sizeof(double));
+    mdarray_randn(arr, scale);
+    return arr;
+}
+
+void test_autograd_linear_matches_hand_written(void) {
+    // W(3, 4) * X(4, 5) + b(3, 1), SVM loss
+    srand(7);
+    MDArray* w = matrix(3, 4, 1.0);
+    MDArray* x = matrix(4, 5, 1.0);
+    MDArray* b = matrix(3, 1, 1.0);
+    size_t labels[] = {0, 1, 2, 1, 0};
+
+    AGTape* t = ag_tape_new();
+    int xi = ag_input(t, x);
+    int wi = ag_param(t, w);
+    int bi = ag_param(t, b);
+    int scores = ag_add_bias(t, ag_matmul(t, wi, xi), bi);
+    ag_svm_loss(t, scores, labels);
+    TEST_ASSERT_EQUAL(0, ag_plan(t));
+
+    double loss = ag_forward(t);
+    TEST_ASSERT_TRUE(float_eq(svm_loss(ag_value(t, scores), labels, 5), loss));
+
+    // Reference: dW = dscores * X^T, db = row sums of dscores. Taken before backward,
+    // which may reuse the scores buffer for gradients.
+    MDArray* dscores = svm_loss_backward(ag_value(t, scores), labels, 5);
+    ag_backward(t);
+    MDArray* x_T = mdarray_transpose_2d(x);
+    MDArray* dw = mdarray_dot(dscores, x_T);
+    for (size_t i = 0; i < 3; i++) {
+        double db = 0.0;
+        for (size_t j = 0; j < 5; j++) db += ((double*)dscores->data)[i * 5 + j];
+        TEST_ASSERT_TRUE(float_eq(db, ((double*)ag_grad(t, bi)->data)[i]));
+        for (size_t k = 0; k < 4; k++) {
+            TEST_ASSERT_TRUE(float_eq(((double*)dw->data)[i * 4 + k], ((double*)ag_grad(t, wi)->data)[i * 4 + k]));
+        }
+    }
+    TEST_ASSERT_NULL(ag_grad(t, xi));
+
+    // The SGD step moves the external parameter in place
+    double w0 = ((double*)w->data)[0];
+    double g0 = ((double*)ag_grad(t, wi)->data)[0];
+    ag_sgd_step(t, 0.5);
+    TEST_ASSERT_TRUE(float_eq(w0 - 0.5 * g0, ((double*)w->data)[0]));
+
+    mdarray_free(dw);
+    mdarray_free(x_T);
+    mdarray_free(dscores);
+    ag_tape_free(t);
+    mdarray_free(w);
+    mdarray_free(x);
+    mdarray_free(b);
+}
+
+void test_autograd_mlp_finite_differences(void) {
+    srand(11);
+    MDArray* x = matrix(4, 5, 1.0);
+    MDArray* w1 = matrix(6, 4, 1.0);
+    MDArray* b1 = matrix(6, 1, 0.1);
+    MDArray* w2 = matrix(3, 6, 1.0);
+    MDArray* b2 = matrix(3, 1, 0.1);
+    size_t labels[] = {2, 0, 1, 1, 2};
+
+    AGTape* t = ag_tape_new();
+    int xi = ag_input(t, x);
+    int w1i = ag_param(t, w1), b1i = ag_param(t, b1);
+    int w2i = ag_param(t, w2), b2i = ag_param(t, b2);
+    int h = ag_relu(t, ag_add_bias(t, ag_matmul(t, w1i, xi), b1i));
+    ag_svm_loss(t, ag_add_bias(t, ag_matmul(t, w2i, h), b2i), labels);
+    TEST_ASSERT_EQUAL(0, ag_plan(t));
+
+    // Liveness lets values and gradients share memory
+    TEST_ASSERT_TRUE(t->workspace_size < t->naive_size);
+
+    ag_forward(t);
+    ag_backward(t);
+
+    // Gradients share the workspace with forward values, so keep them before replaying
+    MDArray* params[] = {w1, b1, w2, b2};
+    int ids[] = {w1i, b1i, w2i, b2i};
+    double grads[4][24];
+    for (size_t p = 0; p < 4; p++) {
+        memcpy(grads[p], ag_grad(t, ids[p])->data, params[p]->total_size * sizeof(double));
+    }
+    double eps = 1e-6;
+    for (size_t p = 0; p < 4; p++) {
+        for (size_t k = 0; k < params[p]->total_size; k += 3) {
+            double* v = &((double*)params[p]->data)[k];
+            double orig = *v;
+            *v = orig + eps;
+            double up = ag_forward(t);
+            *v = orig - eps;
+            double down = ag_forward(t);
+            *v = orig;
+            double numeric = (up - down) / (2 * eps);
+            TEST_ASSERT_TRUE(fabs(numeric - grads[p][k]) < 1e-4);
+        }
+    }
+
+    ag_tape_free(t);
+    mdarray_free(x);
+    mdarray_free(w1);
+    mdarray_free(b1);
+    mdarray_free(w2);
+    mdarray_free(b2);
+}
+
+void test_autograd_shape_mismatch(void) {
+    MDArray* a = matrix(2, 3, 1.0);
+    MDArray* b = matrix(2, 3, 1.0);
+
+    AGTape* t = ag_tape_new();
+    TEST_ASSERT_EQUAL(-1, ag_matmul(t, ag_input(t, a), ag_param(t, b)));
+    ag_tape_free(t);
+
+    mdarray_free(a);
+    mdarray_free(b);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_autograd_linear_matches_hand_written);
+    RUN_TEST(test_autograd_mlp_finite_differences);
+    RUN_TEST(test_autograd_shape_mismatch);
+    return UNITY_END();
+}
@@ -0,0 +1,225 @@
+#include "unity.h"
+#include "conv.h"
+#include "mdarray.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define N 3
+#define C 2
+#define H 7
+#define W 6
+#define F 3
+
+static void fill(MDArray* arr, unsigned seed) {
+    double* x = (double*)arr->data;
+    for (size_t i = 0; i < arr->total_size; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (double)(seed >> 16) / 65536.0 - 0.5;
+    }
+}
+
+static double at(const double* x, size_t n, size_t c, long iy, long ix) {
+    if (iy < 0 || ix < 0 || iy >= H || ix >= W) return 0.0;
+    return x[((n * C + c) * H + (size_t)iy) * W + (size_t)ix];
+}
+
+// Textbook loops: out[n][f][oy][ox] = b[f] + sum w[f][c][ky][kx] * x[n][c][oy*s+ky-pad][ox*s+kx-pad],
+// and the gradients of sum(dout * out)
+static void reference(MDArray* x, MDArray* w, MDArray* b, size_t k, size_t stride, size_t pad,
+                      const double* dout, double* out, double* dw, double* db, double* dx) {
+    const double* xv = (const double*)x->data;
+    const double* wv = (const double*)w->data;
+    size_t oh = (H + 2 * pad - k) / stride + 1, ow = (W + 2 * pad - k) / stride + 1;
+    memset(dw, 0, F * C * k * k * sizeof(double));
+    memset(db, 0, F * sizeof(double));
+    memset(dx, 0, N * C * H * W * sizeof(double));
+    for (size_t n = 0; n < N; n++) {
+        for (size_t f = 0; f < F; f++) {
+            for (size_t oy = 0; oy < oh; oy++) {
+                for (size_t ox = 0; ox < ow; ox++) {
+                    size_t o = ((n * F + f) * oh + oy) * ow + ox;
+                    double sum = ((double*)b->data)[f];
+                    for (size_t c = 0; c < C; c++) {
+                        for (size_t ky = 0; ky < k; ky++) {
+                            for (size_t kx = 0; kx < k; kx++) {
+                                long iy = (long)(oy * stride + ky) - (long)pad, ix = (long)(ox * stride + kx) - (long)pad;
+                                size_t t = ((f * C + c) * k + ky) * k + kx;
+                                sum += wv[t] * at(xv, n, c, iy, ix);
+                                dw[t] += dout[o] * at(xv, n, c, iy, ix);
+                                if (iy >= 0 && ix >= 0 && iy < H && ix < W) {
+                                    dx[((n * C + c) * H + (size_t)iy) * W + (size_t)ix] += dout[o] * wv[t];
+                                }
+                            }
+                        }
+                    }
+                    out[o] = sum;
+                    db[f] += dout[o];
+                }
+            }
+        }
+    }
+}
+
+static void check_algo(ConvAlgo algo, size_t k, size_t stride, size_t pad) {
+    size_t shape_x[] = {N, C, H, W}, shape_w[] = {F, C, k, k}, shape_b[] = {F, 1};
+    MDArray* x = mdarray_create(4, shape_x, sizeof(double));
+    MDArray* w = mdarray_create(4, shape_w, sizeof(double));
+    MDArray* b = mdarray_create(2, shape_b, sizeof(double));
+    MDArray* dw = mdarray_create(4, shape_w, sizeof(double));
+    MDArray* db = mdarray_create(2, shape_b, sizeof(double));
+    MDArray* dx = mdarray_create(4, shape_x, sizeof(double));
+    fill(x, 1);
+    fill(w, 2);
+    fill(b, 3);
+
+    conv_set_algo(algo);
+    ConvConfig config = {stride, pad, false};
+    MDArray* out = conv2d_forward(x, w, b, &config);
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL((H + 2 * pad - k) / stride + 1, out->shape[2]);
+    TEST_ASSERT_EQUAL((W + 2 * pad - k) / stride + 1, out->shape[3]);
+
+    MDArray* dout = mdarray_create(4, out->shape, sizeof(double));
+    fill(dout, 4);
+    TEST_ASSERT_EQUAL(0, conv2d_backward(x, w, out, dout, &config, dx, dw, db));
+
+    double* ref_out = (double*)malloc(out->total_size * sizeof(double));
+    double* ref_dw = (double*)malloc(w->total_size * sizeof(double));
+    double ref_db[F];
+    double* ref_dx = (double*)malloc(x->total_size * sizeof(double));
+    reference(x, w, b, k, stride, pad, (const double*)dout->data, ref_out, ref_dw, ref_db, ref_dx);
+
+    for (size_t i = 0; i < out->total_size; i++) TEST_ASSERT_TRUE(fabs(((double*)out->data)[i] - ref_out[i]) < 1e-10);
+    for (size_t i = 0; i < w->total_size; i++) TEST_ASSERT_TRUE(fabs(((double*)dw->data)[i] - ref_dw[i]) < 1e-10);
+    for (size_t i = 0; i < F; i++) TEST_ASSERT_TRUE(fabs(((double*)db->data)[i] - ref_db[i]) < 1e-10);
+    for (size_t i = 0; i < x->total_size; i++) TEST_ASSERT_TRUE(fabs(((double*)dx->data)[i] - ref_dx[i]) < 1e-10);
+
+    free(ref_out);
+    free(ref_dw);
+    free(ref_dx);
+    mdarray_free(out);
+    mdarray_free(dout);
+    mdarray_free(x);
+    mdarray_free(w);
+    mdarray_free(b);
+    mdarray_free(dw);
+    mdarray_free(db);
+    mdarray_free(dx);
+    conv_set_algo(CONV_ALGO_AUTO);
+}
+
+void test_conv2d_direct_3x3(void) {
+    check_algo(CONV_ALGO_DIRECT, 3, 1, 1);
+    check_algo(CONV_ALGO_DIRECT, 3, 1, 0);
+    check_algo(CONV_ALGO_DIRECT, 3, 1, 2);
+}
+
+void test_conv2d_im2col(void) {
+    check_algo(CONV_ALGO_IM2COL, 3, 1, 1);
+    check_algo(CONV_ALGO_IM2COL, 5, 2, 2);
+    check_algo(CONV_ALGO_IM2COL, 2, 1, 0);
+}
+
+void test_conv2d_auto_falls_back_to_im2col(void) {
+    // Direct only handles 3x3 stride 1, AUTO and even DIRECT must still be right here
+    check_algo(CONV_ALGO_AUTO, 5, 1, 2);
+    check_algo(CONV_ALGO_DIRECT, 3, 2, 1);
+}
+
+void test_conv2d_relu_masks_gradient(void) {
+    size_t shape_x[] = {2, 5, 5}, shape_w[] = {2, 1, 3, 3}, shape_b[] = {2};
+    MDArray* x = mdarray_create(3, shape_x, sizeof(double));
+    MDArray* w = mdarray_create(4, shape_w, sizeof(double));
+    MDArray* b = mdarray_create(1, shape_b, sizeof(double));
+    MDArray* dw = mdarray_create(4, shape_w, sizeof(double));
+    MDArray* db = mdarray_create(1, shape_b, sizeof(double));
+    fill(x, 5);
+    fill(w, 6);
+    mdarray_zeros(b);
+
+    ConvConfig config = {1, 1, true};
+    MDArray* out = conv2d_forward(x, w, b, &config);
+    MDArray* dout = mdarray_create(4, out->shape, sizeof(double));
+    mdarray_ones(dout);
+    TEST_ASSERT_EQUAL(0, conv2d_backward(x, w, out, dout, &config, NULL, dw, db));
+
+    double active[2] = {0};
+    size_t plane = out->shape[2] * out->shape[3];
+    for (size_t i = 0; i < out->total_size; i++) {
+        double v = ((double*)out->data)[i];
+        TEST_ASSERT_TRUE(v >= 0.0);
+        if (v > 0.0) active[(i / plane) % 2] += 1.0;
+    }
+    // With dout all ones, db counts the outputs the ReLU let through
+    TEST_ASSERT_TRUE(((double*)db->data)[0] == active[0]);
+    TEST_ASSERT_TRUE(((double*)db->data)[1] == active[1]);
+
+    mdarray_free(out);
+    mdarray_free(dout);
+    mdarray_free(x);
+    mdarray_free(w);
+    mdarray_free(b);
+    mdarray_free(dw);
+    mdarray_free(db);
+}
+
+void test_conv2d_rejects_mismatched_shapes(void) {
+    size_t shape_x[] = {2, 2, 5, 5}, shape_w[] = {2, 1, 3, 3}, shape_b[] = {2};
+    MDArray* x = mdarray_create(4, shape_x, sizeof(double));
+    MDArray* w = mdarray_create(4, shape_w, sizeof(double));
+    MDArray* b = mdarray_create(1, shape_b, sizeof(double));
+    ConvConfig config = {1, 0, false};
+    TEST_ASSERT_NULL(conv2d_forward(x, w, b, &config));
+    mdarray_free(x);
+    mdarray_free(w);
+    mdarray_free(b);
+}
+
+void test_maxpool2d(void) {
+    size_t shape[] = {1, 1, 4, 4};
+    MDArray* x = mdarray_create(4, shape, sizeof(double));
+    double v[16] = {1, 2, 0, 0,
+                    3, 4, 0, 9,
+                    -1, -2, 5, 5,
+                    -3, -4, 5, 6};
+    memcpy(x->data, v, sizeof(v));
+
+    size_t argmax[4];
+    MDArray* out = maxpool2d_forward(x, 2, 2, argmax);
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL(2, out->shape[2]);
+    double want[4] = {4, 9, -1, 6};
+    for (size_t i = 0; i < 4; i++) TEST_ASSERT_TRUE(((double*)out->data)[i] == want[i]);
+    TEST_ASSERT_EQUAL(5, argmax[0]);
+    TEST_ASSERT_EQUAL(7, argmax[1]);
+
+    MDArray* dout = mdarray_create(4, out->shape, sizeof(double));
+    MDArray* dx = mdarray_create(4, shape, sizeof(double));
+    mdarray_ones(dout);
+    TEST_ASSERT_EQUAL(0, maxpool2d_backward(dout, argmax, dx));
+    double sum = 0.0;
+    for (size_t i = 0; i < 16; i++) sum += ((double*)dx->data)[i];
+    TEST_ASSERT_TRUE(sum == 4.0);
+    TEST_ASSERT_TRUE(((double*)dx->data)[15] == 1.0);
+    TEST_ASSERT_TRUE(((double*)dx->data)[0] == 0.0);
+
+    mdarray_free(x);
+    mdarray_free(out);
+    mdarray_free(dout);
+    mdarray_free(dx);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_conv2d_direct_3x3);
+    RUN_TEST(test_conv2d_im2col);
+    RUN_TEST(test_conv2d_auto_falls_back_to_im2col);
+    RUN_TEST(test_conv2d_relu_masks_gradient);
+    RUN_TEST(test_conv2d_rejects_mismatched_shapes);
+    RUN_TEST(test_maxpool2d);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+#include "unity.h"
+#include "mdarray.h"
+#include "dataset_cache.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <utime.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define FLOAT_EPSILON 0.0001f
+static int float_eq(double a, double b) {
+    return fabs(a - b) < FLOAT_EPSILON;
+}
+
+#define IDX_PATH   "/tmp/nnc_test_images.idx3-ubyte"
+#define CACHE_PATH "/tmp/nnc_test_images.nncache"
+
+// Writes a (2, 3, 4) IDX image file whose pixels are their flat index plus offset
+static void write_idx(unsigned char offset) {
+    unsigned char header[16] = {0, 0, 8, 3, 0, 0, 0, 2, 0, 0, 0, 3, 0, 0, 0, 4};
+    FILE* f = fopen(IDX_PATH, "wb");
+    fwrite(header, 1, sizeof(header), f);
+    for (unsigned char i = 0; i < 24; i++) {
+        unsigned char px = i + offset;
+        fwrite(&px, 1, 1, f);
+    }
+    fclose(f);
+}
+
+void test_dataset_cache_double_roundtrip(void) {
+    write_idx(0);
+    unlink(CACHE_PATH);
+
+    DatasetCache* cache = dataset_cache_load(IDX_PATH, CACHE_PATH, sizeof(double));
+    TEST_ASSERT_NOT_NULL(cache);
+    TEST_ASSERT_EQUAL(3, cache->images->ndim);
+    TEST_ASSERT_EQUAL(2, cache->images->shape[0]);
+    TEST_ASSERT_EQUAL(3, cache->images->shape[1]);
+    TEST_ASSERT_EQUAL(4, cache->images->shape[2]);
+    TEST_ASSERT_EQUAL(sizeof(double), cache->images->itemsize);
+    TEST_ASSERT_FALSE(cache->images->owns_data);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)cache->images->data % DATASET_CACHE_ALIGN);
+
+    size_t idx[] = {1, 2, 3};
+    TEST_ASSERT_TRUE(float_eq(23.0, *(double*)mdarray_get_element(cache->images, idx)));
+    dataset_cache_close(cache);
+
+    // Second open maps the existing file without rebuilding
+    cache = dataset_cache_open(IDX_PATH, CACHE_PATH);
+    TEST_ASSERT_NOT_NULL(cache);
+    size_t idx0[] = {0, 1, 0};
+    TEST_ASSERT_TRUE(float_eq(4.0, *(double*)mdarray_get_element(cache->images, idx0)));
+    dataset_cache_close(cache);
+}
+
+void test_dataset_cache_uint8(void) {
+    write_idx(0);
+    unlink(CACHE_PATH);
+
+    DatasetCache* cache = dataset_cache_load(IDX_PATH, CACHE_PATH, 1);
+    TEST_ASSERT_NOT_NULL(cache);
+    TEST_ASSERT_EQUAL(1, cache->images->itemsize);
+    TEST_ASSERT_TRUE(float_eq(1.0, cache->scale));
+
+    size_t idx[] = {1, 0, 1};
+    TEST_ASSERT_EQUAL(13, *(unsigned char*)mdarray_get_element(cache->images, idx));
+    dataset_cache_close(cache);
+}
+
+void test_dataset_cache_decode_applies_scale(void) {
+    write_idx(0);
+    unlink(CACHE_PATH);
+
+    DatasetCache* cache = dataset_cache_load(IDX_PATH, CACHE_PATH, 1);
+    TEST_ASSERT_NOT_NULL(cache);
+    cache->scale = 0.5;
+    MDArray* images = dataset_cache_decode(cache);
+    dataset_cache_close(cache);
+
+    TEST_ASSERT_NOT_NULL(images);
+    TEST_ASSERT_EQUAL(sizeof(double), images->itemsize);
+    size_t idx[] = {1, 0, 1};
+    TEST_ASSERT_TRUE(float_eq(6.5, *(double*)mdarray_get_element(images, idx)));
+    mdarray_free(images);
+}
+
+void test_dataset_cache_detects_stale_source(void) {
+    write_idx(0);
+    unlink(CACHE_PATH);
+    TEST_ASSERT_EQUAL(0, dataset_cache_build(IDX_PATH, CACHE_PATH, sizeof(double)));
+
+    // Same size, different content and mtime
+    sleep(1);
+    write_idx(100);
+    TEST_ASSERT_NULL(dataset_cache_open(IDX_PATH, CACHE_PATH));
+
+    DatasetCache* cache = dataset_cache_load(IDX_PATH, CACHE_PATH, sizeof(double));
+    TEST_ASSERT_NOT_NULL(cache);
+    size_t idx[] = {0, 0, 0};
+    TEST_ASSERT_TRUE(float_eq(100.0, *(double*)mdarray_get_element(cache->images, idx)));
+    dataset_cache_close(cache);
+
+    unlink(CACHE_PATH);
+    unlink(IDX_PATH);
+}
+
+static int64_t cached_mtime(void) {
+    DatasetCacheHeader header;
+    FILE* f = fopen(CACHE_PATH, "rb");
+    size_t got = fread(&header, sizeof(header), 1, f);
+    fclose(f);
+    return got == 1 ? header.source_mtime : -1;
+}
+
+// A touch without a content change costs one rehash, then the header remembers the new mtime
+void test_dataset_cache_refreshes_touched_mtime(void) {
+    write_idx(0);
+    unlink(CACHE_PATH);
+    TEST_ASSERT_EQUAL(0, dataset_cache_build(IDX_PATH, CACHE_PATH, 1));
+
+    struct utimbuf times = {1000000, 1000000};
+    TEST_ASSERT_EQUAL(0, utime(IDX_PATH, &times));
+    TEST_ASSERT_TRUE(cached_mtime() != 1000000);
+
+    DatasetCache* cache = dataset_cache_open(IDX_PATH, CACHE_PATH);
+    TEST_ASSERT_NOT_NULL(cache);
+    TEST_ASSERT_TRUE(cached_mtime() == 1000000);
+    dataset_cache_close(cache);
+
+    unlink(CACHE_PATH);
+    unlink(IDX_PATH);
+}
+
+void test_dataset_cache_rejects_bad_idx(void) {
+    unlink(CACHE_PATH);
+
+    // Label file magic
+    unsigned char labels[16] = {0, 0, 8, 1, 0, 0, 0, 2};
+    FILE* f = fopen(IDX_PATH, "wb");
+    fwrite(labels, 1, sizeof(labels), f);
+    fclose(f);
+    TEST_ASSERT_EQUAL(-1, dataset_cache_build(IDX_PATH, CACHE_PATH, 1));
+
+    // Dimensions whose product wraps around 64 bits
+    unsigned char huge[16] = {0, 0, 8, 3, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 2};
+    f = fopen(IDX_PATH, "wb");
+    fwrite(huge, 1, sizeof(huge), f);
+    fclose(f);
+    TEST_ASSERT_EQUAL(-1, dataset_cache_build(IDX_PATH, CACHE_PATH, 1));
+    TEST_ASSERT_TRUE(access(CACHE_PATH, F_OK) != 0);
+
+    unlink(IDX_PATH);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_dataset_cache_double_roundtrip);
+    RUN_TEST(test_dataset_cache_uint8);
+    RUN_TEST(test_dataset_cache_decode_applies_scale);
+    RUN_TEST(test_dataset_cache_detects_stale_source);
+    RUN_TEST(test_dataset_cache_refreshes_touched_mtime);
+    RUN_TEST(test_dataset_cache_rejects_bad_idx);
+    return UNITY_END();
+}
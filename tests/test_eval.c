@@ -0,0 +1,133 @@
+#include "unity.h"
+#include "eval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define N 1000                    // Several EVAL_BATCH chunks, uneven across threads
+#define FEATURES 16
+
+static const char* images_path = "/tmp/nnc_test_eval_images.idx3";
+static const char* labels_path = "/tmp/nnc_test_eval_labels.idx1";
+
+static void write_be32(FILE* f, unsigned v) {
+    unsigned char b[4] = {(unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v};
+    fwrite(b, 1, 4, f);
+}
+
+// Sample j lights up pixel (j % 10), label is (j % 10) except every 7th which is mislabeled.
+// A non-zero bad_label replaces the last label.
+static void write_set_labeled(unsigned char bad_label) {
+    FILE* fi = fopen(images_path, "wb");
+    FILE* fl = fopen(labels_path, "wb");
+    write_be32(fi, 2051);
+    write_be32(fi, N);
+    write_be32(fi, 4);
+    write_be32(fi, 4);
+    write_be32(fl, 2049);
+    write_be32(fl, N);
+    for (size_t j = 0; j < N; j++) {
+        unsigned char px[FEATURES] = {0};
+        px[j % 10] = 200;
+        fwrite(px, 1, FEATURES, fi);
+        unsigned char label = (unsigned char)(j % 7 == 0 ? (j + 1) % 10 : j % 10);
+        if (bad_label && j == N - 1) label = bad_label;
+        fwrite(&label, 1, 1, fl);
+    }
+    fclose(fi);
+    fclose(fl);
+}
+
+static void write_set(void) {
+    write_set_labeled(0);
+}
+
+// Identity-like weights: class c scores pixel c
+static void make_model(MDArray** w, MDArray** b) {
+    size_t shape_w[] = {10, FEATURES}, shape_b[] = {10, 1};
+    *w = mdarray_create(2, shape_w, sizeof(double));
+    *b = mdarray_create(2, shape_b, sizeof(double));
+    mdarray_zeros(*w);
+    mdarray_zeros(*b);
+    for (size_t c = 0; c < 10; c++) ((double*)(*w)->data)[c * FEATURES + c] = 1.0;
+}
+
+void test_eval_run_accuracy_and_confusion(void) {
+    write_set();
+    EvalSet* set = eval_set_open(images_path, labels_path);
+    TEST_ASSERT_NOT_NULL(set);
+    TEST_ASSERT_EQUAL(N, set->n);
+    TEST_ASSERT_EQUAL(FEATURES, set->features);
+
+    MDArray *w, *b;
+    make_model(&w, &b);
+    size_t wrong = 0;
+    for (size_t j = 0; j < N; j++) wrong += j % 7 == 0;
+
+    for (size_t threads = 1; threads <= 3; threads++) {
+        EvalResult r;
+        TEST_ASSERT_EQUAL(0, eval_run(set, w, b, threads, &r));
+        TEST_ASSERT_EQUAL(N, r.n);
+        TEST_ASSERT_EQUAL(N - wrong, r.correct);
+
+        size_t total = 0;
+        for (size_t i = 0; i < EVAL_CLASSES; i++) {
+            for (size_t p = 0; p < EVAL_CLASSES; p++) total += r.confusion[i][p];
+        }
+        TEST_ASSERT_EQUAL(N, total);
+        // Sample 0 shows a 0 but is labeled 1
+        TEST_ASSERT_TRUE(r.confusion[1][0] > 0);
+    }
+
+    mdarray_free(w);
+    mdarray_free(b);
+    eval_set_close(set);
+    unlink(images_path);
+    unlink(labels_path);
+}
+
+void test_eval_predict_fused_argmax(void) {
+    MDArray *w, *b;
+    make_model(&w, &b);
+    size_t shape[] = {3, 4, 4};
+    MDArray* x = mdarray_create(3, shape, sizeof(double));
+    mdarray_zeros(x);
+    double* xd = (double*)x->data;
+    xd[0 * FEATURES + 7] = 3.0;
+    xd[1 * FEATURES + 2] = 1.0;
+    xd[2 * FEATURES + 9] = 5.0;
+    xd[2 * FEATURES + 4] = 6.0;
+
+    size_t pred[3];
+    TEST_ASSERT_EQUAL(0, eval_predict(w, b, x, pred));
+    TEST_ASSERT_EQUAL(7, pred[0]);
+    TEST_ASSERT_EQUAL(2, pred[1]);
+    TEST_ASSERT_EQUAL(4, pred[2]);
+
+    mdarray_free(x);
+    mdarray_free(w);
+    mdarray_free(b);
+}
+
+void test_eval_set_open_missing(void) {
+    TEST_ASSERT_NULL(eval_set_open("/tmp/nnc_missing_images", "/tmp/nnc_missing_labels"));
+}
+
+void test_eval_set_open_rejects_bad_label(void) {
+    write_set_labeled(EVAL_CLASSES);
+    TEST_ASSERT_NULL(eval_set_open(images_path, labels_path));
+    write_set_labeled(255);
+    TEST_ASSERT_NULL(eval_set_open(images_path, labels_path));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_eval_run_accuracy_and_confusion);
+    RUN_TEST(test_eval_predict_fused_argmax);
+    RUN_TEST(test_eval_set_open_missing);
+    RUN_TEST(test_eval_set_open_rejects_bad_label);
+    return UNITY_END();
+}
@@ -0,0 +1,193 @@
+#include "unity.h"
+#include "gemm.h"
+#include "gemm_tune.h"
+#include "mdarray.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void fill(double* x, size_t len, unsigned seed) {
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        x[i] = (double)(seed >> 16) / 65536.0 - 0.5;
+    }
+}
+
+// Uneven sizes so every block edge is exercised, large enough for the threaded path
+static void check_backend(GemmBackend backend, bool trans_a, bool trans_b) {
+    size_t m = 13, n = 301, k = 517;
+    double* a = (double*)malloc(m * k * sizeof(double));
+    double* b = (double*)malloc(k * n * sizeof(double));
+    double* ref = (double*)malloc(m * n * sizeof(double));
+    double* c = (double*)malloc(m * n * sizeof(double));
+    fill(a, m * k, 3);
+    fill(b, k * n, 4);
+    fill(ref, m * n, 5);
+    for (size_t i = 0; i < m * n; i++) c[i] = ref[i];
+
+    gemm_dgemm_with(GEMM_BACKEND_REFERENCE, trans_a, trans_b, m, n, k, 0.5, a, b, 2.0, ref);
+    gemm_dgemm_with(backend, trans_a, trans_b, m, n, k, 0.5, a, b, 2.0, c);
+    for (size_t i = 0; i < m * n; i++) TEST_ASSERT_TRUE(fabs(c[i] - ref[i]) < 1e-10);
+
+    free(a);
+    free(b);
+    free(ref);
+    free(c);
+}
+
+void test_gemm_backends_match_reference(void) {
+    for (size_t be = 0; be < GEMM_BACKEND_COUNT; be++) {
+        if (!gemm_backend_available((GemmBackend)be)) continue;
+        check_backend((GemmBackend)be, false, false);
+        check_backend((GemmBackend)be, true, false);
+        check_backend((GemmBackend)be, false, true);
+        check_backend((GemmBackend)be, true, true);
+    }
+}
+
+void test_gemm_backend_names(void) {
+    GemmBackend be;
+    TEST_ASSERT_EQUAL(0, gemm_backend_from_name("blocked", &be));
+    TEST_ASSERT_EQUAL(GEMM_BACKEND_BLOCKED, be);
+    TEST_ASSERT_EQUAL(-1, gemm_backend_from_name("gpu", &be));
+    TEST_ASSERT_TRUE(gemm_backend_available(GEMM_BACKEND_REFERENCE));
+    TEST_ASSERT_EQUAL(-1, gemm_set_backend(GEMM_BACKEND_COUNT));
+}
+
+void test_gemm_mdarray_dot_uses_selected_backend(void) {
+    size_t sa[] = {3, 4}, sb[] = {4, 2};
+    MDArray* a = mdarray_create(2, sa, sizeof(double));
+    MDArray* b = mdarray_create(2, sb, sizeof(double));
+    for (size_t i = 0; i < 12; i++) ((double*)a->data)[i] = (double)i;
+    for (size_t i = 0; i < 8; i++) ((double*)b->data)[i] = (double)(i % 3);
+
+    for (size_t be = 0; be < GEMM_BACKEND_COUNT; be++) {
+        if (gemm_set_backend((GemmBackend)be) != 0) continue;
+        TEST_ASSERT_EQUAL(be, gemm_get_backend());
+        MDArray* c = mdarray_dot(a, b);
+        // Row 1 is (4, 5, 6, 7), column 0 of b is (0, 2, 1, 0)
+        TEST_ASSERT_TRUE(((double*)c->data)[2] == 16.0);
+        mdarray_free(c);
+    }
+
+    mdarray_free(a);
+    mdarray_free(b);
+}
+
+void test_gemm_batched(void) {
+    double a[2 * 4] = {1, 2, 3, 4, 5, 6, 7, 8};     // Two 2x2
+    double b[2 * 4] = {1, 0, 0, 1, 0, 1, 1, 0};     // Identity, swap
+    double c[2 * 4] = {0};
+    gemm_dgemm_batched(2, false, false, 2, 2, 2, 1.0, a, 4, b, 4, 0.0, c, 4);
+    double want[8] = {1, 2, 3, 4, 6, 5, 8, 7};
+    for (size_t i = 0; i < 8; i++) TEST_ASSERT_TRUE(c[i] == want[i]);
+}
+
+void test_gemm_params_match_reference(void) {
+    size_t m = 7, n = 301, k = 133;
+    double* a = (double*)malloc(m * k * sizeof(double));
+    double* b = (double*)malloc(k * n * sizeof(double));
+    double* ref = (double*)malloc(m * n * sizeof(double));
+    double* c = (double*)malloc(m * n * sizeof(double));
+    fill(a, m * k, 6);
+    fill(b, k * n, 7);
+    gemm_dgemm_with(GEMM_BACKEND_REFERENCE, false, true, m, n, k, 1.0, a, b, 0.0, ref);
+
+    size_t unrolls[] = {1, 2, 4};
+    GemmParams params = {48, 20, 1, 3};
+    for (size_t u = 0; u < 3; u++) {
+        params.unroll = unrolls[u];
+        gemm_dgemm_blocked_params(&params, false, true, m, n, k, 1.0, a, b, 0.0, c);
+        for (size_t i = 0; i < m * n; i++) TEST_ASSERT_TRUE(fabs(c[i] - ref[i]) < 1e-10);
+    }
+    // A profile from a bigger host: capped at parallel_threads(), still correct
+    params.n_threads = 64;
+    gemm_dgemm_blocked_params(&params, false, true, m, n, k, 1.0, a, b, 0.0, c);
+    for (size_t i = 0; i < m * n; i++) TEST_ASSERT_TRUE(fabs(c[i] - ref[i]) < 1e-10);
+
+    free(a);
+    free(b);
+    free(ref);
+    free(c);
+}
+
+void test_gemm_params_lookup(void) {
+    gemm_clear_params();
+    GemmParams p, tuned = {128, 32, 4, 2};
+    gemm_params_for(false, false, 10, 2000, 784, &p);
+    TEST_ASSERT_EQUAL(GEMM_BLOCK_N, p.block_n);
+
+    TEST_ASSERT_EQUAL(0, gemm_set_params(false, false, 10, 2000, 784, &tuned));
+    TEST_ASSERT_EQUAL(0, gemm_set_params(false, false, 10, 2000, 784, &tuned));
+    TEST_ASSERT_EQUAL(1, gemm_params_count());
+    gemm_params_for(false, false, 10, 1900, 784, &p);
+    TEST_ASSERT_EQUAL(128, p.block_n);
+    TEST_ASSERT_EQUAL(4, p.unroll);
+    // Far from every tuned shape
+    gemm_params_for(false, false, 512, 512, 512, &p);
+    TEST_ASSERT_EQUAL(GEMM_BLOCK_N, p.block_n);
+    // Same shape, other orientation
+    gemm_params_for(false, true, 10, 2000, 784, &p);
+    TEST_ASSERT_EQUAL(GEMM_BLOCK_N, p.block_n);
+    TEST_ASSERT_EQUAL(0, gemm_set_params(false, true, 10, 2000, 784, &tuned));
+    TEST_ASSERT_EQUAL(2, gemm_params_count());
+
+    GemmParams bad = {128, 32, 3, 0};
+    TEST_ASSERT_EQUAL(-1, gemm_set_params(false, false, 1, 1, 1, &bad));
+    gemm_clear_params();
+}
+
+void test_gemm_profile_round_trip(void) {
+    const char* path = "test_gemm.profile";
+    gemm_clear_params();
+    GemmParams a = {512, 128, 2, 1}, b = {64, 16, 1, 0};
+    gemm_set_params(false, false, 10, 2000, 784, &a);
+    gemm_set_params(false, true, 10, 784, 2000, &b);
+    TEST_ASSERT_EQUAL(0, gemm_save_profile(path));
+
+    gemm_clear_params();
+    TEST_ASSERT_EQUAL(2, gemm_load_profile(path));
+    GemmParams p;
+    gemm_params_for(false, true, 10, 784, 2000, &p);
+    TEST_ASSERT_EQUAL(64, p.block_n);
+    TEST_ASSERT_EQUAL(16, p.block_k);
+    TEST_ASSERT_EQUAL(0, p.n_threads);
+    gemm_params_for(false, false, 10, 2000, 784, &p);
+    TEST_ASSERT_EQUAL(2, p.unroll);
+
+    remove(path);
+    TEST_ASSERT_EQUAL(-1, gemm_load_profile(path));
+    gemm_clear_params();
+}
+
+void test_gemm_tune_registers_winner(void) {
+    gemm_clear_params();
+    GemmTuneResult r;
+    TEST_ASSERT_EQUAL(0, gemm_tune_shape(false, false, 8, 200, 96, 1, &r));
+    TEST_ASSERT_TRUE(r.candidates > 1);
+    TEST_ASSERT_TRUE(r.gflops >= r.default_gflops);
+    TEST_ASSERT_EQUAL(1, gemm_params_count());
+
+    GemmParams p;
+    gemm_params_for(false, false, 8, 200, 96, &p);
+    TEST_ASSERT_EQUAL(r.params.block_n, p.block_n);
+    TEST_ASSERT_EQUAL(r.params.block_k, p.block_k);
+    TEST_ASSERT_EQUAL(r.params.unroll, p.unroll);
+    gemm_clear_params();
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_gemm_backends_match_reference);
+    RUN_TEST(test_gemm_backend_names);
+    RUN_TEST(test_gemm_mdarray_dot_uses_selected_backend);
+    RUN_TEST(test_gemm_batched);
+    RUN_TEST(test_gemm_params_match_reference);
+    RUN_TEST(test_gemm_params_lookup);
+    RUN_TEST(test_gemm_profile_round_trip);
+    RUN_TEST(test_gemm_tune_registers_winner);
+    return UNITY_END();
+}
@@ -0,0 +1,129 @@
+#include "unity.h"
+#include "hogwild.h"
+#include "parallel.h"
+#include <stdlib.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define N 400
+#define FEATURES 64
+#define CLASSES 4
+
+static void mark_tid(size_t tid, size_t n_threads, void* ctx) {
+    int* seen = (int*)ctx;
+    __atomic_fetch_add(&seen[tid], 1, __ATOMIC_RELAXED);
+    (void)n_threads;
+}
+
+void test_parallel_run_covers_every_thread(void) {
+    int seen[5] = {0};
+    parallel_run(5, mark_tid, seen);
+    for (size_t t = 0; t < 5; t++) TEST_ASSERT_EQUAL(1, seen[t]);
+}
+
+void test_parallel_range_partitions(void) {
+    size_t next = 0;
+    for (size_t t = 0; t < 3; t++) {
+        size_t lo, hi;
+        parallel_range(t, 3, 10, &lo, &hi);
+        TEST_ASSERT_EQUAL(next, lo);
+        next = hi;
+    }
+    TEST_ASSERT_EQUAL(10, next);
+}
+
+void test_parallel_budget_caps_threads(void) {
+    size_t all = parallel_threads();
+    parallel_set_budget(1);
+    TEST_ASSERT_EQUAL(1, parallel_threads());
+    parallel_set_budget(all + 8);
+    TEST_ASSERT_EQUAL(all, parallel_threads());
+    parallel_set_budget(0);
+    TEST_ASSERT_EQUAL(all, parallel_threads());
+}
+
+// Sparse, separable data: class c lights up its own block of pixels plus a little noise
+static void make_data(MDArray** images, size_t* labels) {
+    size_t shape[] = {N, FEATURES};
+    *images = mdarray_create(2, shape, sizeof(double));
+    double* x = (double*)(*images)->data;
+    uint64_t rng = 42;
+    for (size_t i = 0; i < N; i++) {
+        labels[i] = i % CLASSES;
+        for (size_t k = 0; k < FEATURES; k++) {
+            rng = rng * 6364136223846793005ull + 1442695040888963407ull;
+            int block = k / (FEATURES / CLASSES) == labels[i];
+            x[i * FEATURES + k] = block && (rng >> 61) != 0 ? 1.0 : ((rng >> 58) == 0 ? 0.5 : 0.0);
+        }
+    }
+}
+
+static double train(size_t n_threads, int epochs, double* initial) {
+    MDArray* images;
+    size_t labels[N];
+    make_data(&images, labels);
+
+    size_t shape_w[] = {CLASSES, FEATURES};
+    size_t shape_b[] = {CLASSES, 1};
+    MDArray* w = mdarray_create(2, shape_w, sizeof(double));
+    MDArray* b = mdarray_create(2, shape_b, sizeof(double));
+    double* wd = (double*)w->data;
+    for (size_t k = 0; k < w->total_size; k++) wd[k] = (double)((k * 7919) % 13) / 13.0 - 0.5;
+    mdarray_zeros(b);
+
+    *initial = hogwild_svm_loss(w, b, images, labels, n_threads);
+    HogwildConfig config = {n_threads, 10, 0.05, 1};
+    HogwildStats stats;
+    for (int e = 0; e < epochs; e++) {
+        TEST_ASSERT_EQUAL(0, hogwild_epoch(w, b, images, labels, &config, &stats));
+        TEST_ASSERT_EQUAL(N / 10, stats.updates);
+    }
+    double loss = hogwild_svm_loss(w, b, images, labels, n_threads);
+
+    mdarray_free(images);
+    mdarray_free(w);
+    mdarray_free(b);
+    return loss;
+}
+
+void test_hogwild_loss_decreases(void) {
+    double initial;
+    double loss = train(4, 5, &initial);
+    TEST_ASSERT_TRUE(initial > 0.5);
+    TEST_ASSERT_TRUE(loss < 0.25 * initial);
+}
+
+void test_hogwild_single_thread_matches_loss_threads(void) {
+    // Same weights, the evaluation split must not change the result
+    double initial_1, initial_4;
+    train(1, 0, &initial_1);
+    train(4, 0, &initial_4);
+    TEST_ASSERT_TRUE(initial_1 - initial_4 < 1e-9 && initial_4 - initial_1 < 1e-9);
+}
+
+void test_hogwild_rejects_mismatched_shapes(void) {
+    size_t shape_w[] = {CLASSES, FEATURES + 1};
+    size_t shape_b[] = {CLASSES, 1};
+    size_t shape_x[] = {4, FEATURES};
+    MDArray* w = mdarray_create(2, shape_w, sizeof(double));
+    MDArray* b = mdarray_create(2, shape_b, sizeof(double));
+    MDArray* x = mdarray_create(2, shape_x, sizeof(double));
+    size_t labels[4] = {0};
+    HogwildConfig config = {2, 2, 0.1, 1};
+    TEST_ASSERT_EQUAL(-1, hogwild_epoch(w, b, x, labels, &config, NULL));
+    mdarray_free(w);
+    mdarray_free(b);
+    mdarray_free(x);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_parallel_run_covers_every_thread);
+    RUN_TEST(test_parallel_range_partitions);
+    RUN_TEST(test_parallel_budget_caps_threads);
+    RUN_TEST(test_hogwild_loss_decreases);
+    RUN_TEST(test_hogwild_single_thread_matches_loss_threads);
+    RUN_TEST(test_hogwild_rejects_mismatched_shapes);
+    return UNITY_END();
+}
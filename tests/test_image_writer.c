@@ -0,0 +1,111 @@
+#include "unity.h"
+#include "image_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static MDArray* make_images(size_t n, size_t itemsize) {
+    size_t shape[] = {n, 28, 28};
+    MDArray* imgs = mdarray_create(3, shape, itemsize);
+    for (size_t k = 0; k < imgs->total_size; k++) {
+        if (itemsize == 1) ((unsigned char*)imgs->data)[k] = (unsigned char)(k % 256);
+        else ((double*)imgs->data)[k] = (double)(k % 256);
+    }
+    return imgs;
+}
+
+static int is_jpeg(const char* path) {
+    unsigned char magic[2] = {0};
+    FILE* f = fopen(path, "rb");
+    if (!f) return 0;
+    size_t got = fread(magic, 1, 2, f);
+    fclose(f);
+    return got == 2 && magic[0] == 0xFF && magic[1] == 0xD8;
+}
+
+void test_image_writer_encodes_grid(void) {
+    const char* path = "/tmp/nnc_test_grid.jpeg";
+    unlink(path);
+    MDArray* imgs = make_images(10, sizeof(double));
+
+    ImageWriter* w = image_writer_start(2);
+    TEST_ASSERT_NOT_NULL(w);
+    TEST_ASSERT_EQUAL(0, image_writer_submit(w, imgs, 0, 10, 4, 90, path));
+    // Pixels were copied, the tensor can go away before the worker runs
+    mdarray_free(imgs);
+
+    image_writer_stop(w);
+    TEST_ASSERT_TRUE(is_jpeg(path));
+    unlink(path);
+}
+
+void test_image_writer_accepts_uint8_and_drops_when_full(void) {
+    MDArray* imgs = make_images(4, 1);
+    ImageWriter* w = image_writer_start(1);
+
+    // A one-slot ring under a burst: every submit returns at once, accepted or dropped
+    size_t submitted = 8, accepted = 0;
+    char path[64];
+    for (size_t i = 0; i < submitted; i++) {
+        snprintf(path, sizeof(path), "/tmp/nnc_test_drop_%zu.jpeg", i);
+        accepted += image_writer_submit(w, imgs, i % 4, 1, 1, 75, path) == 0;
+    }
+    TEST_ASSERT_TRUE(accepted >= 1);
+
+    pthread_mutex_lock(&w->lock);
+    size_t dropped = w->dropped;
+    pthread_mutex_unlock(&w->lock);
+    TEST_ASSERT_EQUAL(submitted, accepted + dropped);
+    image_writer_stop(w);
+
+    for (size_t i = 0; i < submitted; i++) {
+        snprintf(path, sizeof(path), "/tmp/nnc_test_drop_%zu.jpeg", i);
+        unlink(path);
+    }
+    mdarray_free(imgs);
+}
+
+// libjpeg errors must fail the job, not exit() the process from the writer thread
+void test_image_writer_reports_libjpeg_errors(void) {
+    const char* path = "/tmp/nnc_test_too_wide.jpeg";
+    size_t count = 2400;                      // 2400 * 28 columns is past JPEG_MAX_DIMENSION
+    MDArray* imgs = make_images(count, 1);
+    unsigned char* canvas = (unsigned char*)calloc(count * 28 * 28, 1);
+    TEST_ASSERT_EQUAL(-1, image_writer_encode(canvas, count * 28, 28, 90, path));
+    TEST_ASSERT_TRUE(access(path, F_OK) != 0);
+    free(canvas);
+
+    ImageWriter* w = image_writer_start(1);
+    TEST_ASSERT_EQUAL(0, image_writer_submit(w, imgs, 0, count, count, 90, path));
+    size_t failed = 0;
+    for (int spin = 0; spin < 1000 && failed == 0; spin++) {
+        pthread_mutex_lock(&w->lock);
+        failed = w->failed;
+        pthread_mutex_unlock(&w->lock);
+        if (failed == 0) usleep(1000);
+    }
+    TEST_ASSERT_EQUAL(1, failed);
+    image_writer_stop(w);
+    mdarray_free(imgs);
+}
+
+void test_image_writer_rejects_bad_input(void) {
+    size_t shape[] = {4, 784};
+    MDArray* flat = mdarray_create(2, shape, sizeof(double));
+    ImageWriter* w = image_writer_start(1);
+    TEST_ASSERT_EQUAL(-1, image_writer_submit(w, flat, 0, 1, 1, 90, "/tmp/nnc_test_bad.jpeg"));
+    image_writer_stop(w);
+    mdarray_free(flat);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_image_writer_encodes_grid);
+    RUN_TEST(test_image_writer_accepts_uint8_and_drops_when_full);
+    RUN_TEST(test_image_writer_reports_libjpeg_errors);
+    RUN_TEST(test_image_writer_rejects_bad_input);
+    return UNITY_END();
+}
@@ -1,6 +1,7 @@
 #include "unity.h"
 #include "mdarray.h"
 #include "linear.h"
+#include "parallel.h"
 #include <math.h>
 
 void setUp(void) {}
@@ -404,6 +405,245 @@ void test_svm_loss_backward_batch(void) {
     mdarray_free(dscores);
 }
 
+static MDArray* random_matrix(size_t rows, size_t cols) {
+    size_t shape[] = {rows, cols};
+    MDArray* arr = mdarray_create(2, shape, sizeof(double));
+    mdarray_randn(arr, 1.0);
+    return arr;
+}
+
+void test_svm_loss_grad_matches_separate_passes(void) {
+    size_t shape[] = {3, 4};
+    MDArray* scores = mdarray_create(2, shape, sizeof(double));
+    MDArray* dscores = mdarray_create(2, shape, sizeof(double));
+    double vals[12] = {2.0, 4.0, 0.5, 1.0,
+                       5.0, 1.0, 0.5, 3.0,
+                       3.0, 2.0, 0.5, -1.0};
+    for (size_t i = 0; i < 12; i++) ((double*)scores->data)[i] = vals[i];
+    mdarray_fill(dscores, 7.0);  // Every entry must be overwritten
+
+    size_t labels[] = {0, 2, 1, 1};
+    double loss = svm_loss_grad(scores, labels, 4, dscores);
+    MDArray* ref = svm_loss_backward(scores, labels, 4);
+
+    TEST_ASSERT_TRUE(loss == svm_loss(scores, labels, 4));
+    for (size_t i = 0; i < 12; i++) TEST_ASSERT_TRUE(((double*)dscores->data)[i] == ((double*)ref->data)[i]);
+
+    mdarray_free(scores);
+    mdarray_free(dscores);
+    mdarray_free(ref);
+}
+
+void test_mdarray_dot_bias_relu_matches_unfused(void) {
+    // Width above one tile so the column blocking is exercised
+    srand(3);
+    size_t n = MDARRAY_TILE + 9;
+    MDArray* w = random_matrix(5, 7);
+    MDArray* x = random_matrix(7, n);
+    MDArray* b = random_matrix(5, 1);
+    MDArray* ref = mdarray_dot(w, x);
+
+    size_t shape[] = {5, n};
+    MDArray* out = mdarray_create(2, shape, sizeof(double));
+    TEST_ASSERT_EQUAL(0, mdarray_dot_bias_relu(w, x, b, true, out));
+
+    for (size_t i = 0; i < 5; i++) {
+        for (size_t j = 0; j < n; j++) {
+            double v = ((double*)ref->data)[i * n + j] + ((double*)b->data)[i];
+            TEST_ASSERT_TRUE(float_eq(v > 0.0 ? v : 0.0, ((double*)out->data)[i * n + j]));
+        }
+    }
+
+    mdarray_free(out);
+    mdarray_free(ref);
+    mdarray_free(w);
+    mdarray_free(x);
+    mdarray_free(b);
+}
+
+// Large enough to be split across threads, which must not change a single bit
+void test_mdarray_fused_dot_threads_match_serial(void) {
+    srand(11);
+    size_t h = 16, k = 64, n = 1100;
+    MDArray* w = random_matrix(h, k);
+    MDArray* x = random_matrix(k, n);
+    MDArray* b = random_matrix(h, 1);
+    MDArray* dz = random_matrix(h, n);
+    size_t shape_a[] = {h, n}, shape_g[] = {k, n}, shape_b[] = {k, 1};
+    MDArray* act[2];
+    MDArray* grad[2];
+    MDArray* db[2];
+
+    const char* threads[] = {"1", "4"};
+    for (int t = 0; t < 2; t++) {
+        setenv("NNC_THREADS", threads[t], 1);
+        act[t] = mdarray_create(2, shape_a, sizeof(double));
+        grad[t] = mdarray_create(2, shape_g, sizeof(double));
+        db[t] = mdarray_create(2, shape_b, sizeof(double));
+        TEST_ASSERT_EQUAL(0, mdarray_dot_bias_relu(w, x, b, true, act[t]));
+        TEST_ASSERT_EQUAL(0, mdarray_dot_tn_relu_grad(w, dz, x, grad[t], db[t]));
+    }
+    unsetenv("NNC_THREADS");
+
+    TEST_ASSERT_EQUAL_MEMORY(act[0]->data, act[1]->data, h * n * sizeof(double));
+    TEST_ASSERT_EQUAL_MEMORY(grad[0]->data, grad[1]->data, k * n * sizeof(double));
+    TEST_ASSERT_EQUAL_MEMORY(db[0]->data, db[1]->data, k * sizeof(double));
+
+    for (int t = 0; t < 2; t++) {
+        mdarray_free(act[t]);
+        mdarray_free(grad[t]);
+        mdarray_free(db[t]);
+    }
+    mdarray_free(w);
+    mdarray_free(x);
+    mdarray_free(b);
+    mdarray_free(dz);
+}
+
+void test_mdarray_dot_tn_relu_grad(void) {
+    srand(5);
+    size_t n = MDARRAY_TILE + 3;
+    MDArray* w = random_matrix(4, 6);
+    MDArray* dz = random_matrix(4, n);
+    MDArray* act = random_matrix(6, n);
+    size_t shape[] = {6, n}, shape_b[] = {6, 1};
+    MDArray* out = mdarray_create(2, shape, sizeof(double));
+    MDArray* db = mdarray_create(2, shape_b, sizeof(double));
+    TEST_ASSERT_EQUAL(0, mdarray_dot_tn_relu_grad(w, dz, act, out, db));
+
+    MDArray* w_T = mdarray_transpose_2d(w);
+    MDArray* ref = mdarray_dot(w_T, dz);
+    for (size_t i = 0; i < 6; i++) {
+        double sum = 0.0;
+        for (size_t j = 0; j < n; j++) {
+            double v = ((double*)act->data)[i * n + j] > 0.0 ? ((double*)ref->data)[i * n + j] : 0.0;
+            TEST_ASSERT_TRUE(float_eq(v, ((double*)out->data)[i * n + j]));
+            sum += v;
+        }
+        TEST_ASSERT_TRUE(float_eq(sum, ((double*)db->data)[i]));
+    }
+
+    mdarray_free(ref);
+    mdarray_free(w_T);
+    mdarray_free(db);
+    mdarray_free(out);
+    mdarray_free(act);
+    mdarray_free(dz);
+    mdarray_free(w);
+}
+
+void test_mdarray_view_outlives_parent(void) {
+    size_t shape[] = {2, 3, 4};
+    MDArray* arr = mdarray_create(3, shape, sizeof(double));
+    for (size_t i = 0; i < arr->total_size; i++) ((double*)arr->data)[i] = (double)i;
+
+    MDArray* slice = mdarray_get(arr, 1);
+    size_t flat_shape[] = {2, 12};
+    MDArray* flat = mdarray_resize(arr, 2, flat_shape);
+    TEST_ASSERT_FALSE(flat->owns_data);
+    TEST_ASSERT_EQUAL(3, mdstorage_refcount(arr->storage));
+
+    // The parent goes first, the views keep the buffer alive
+    mdarray_free(arr);
+    TEST_ASSERT_EQUAL(2, mdstorage_refcount(slice->storage));
+    size_t idx[] = {2, 3};
+    TEST_ASSERT_TRUE(float_eq(23.0, *(double*)mdarray_get_element(slice, idx)));
+    size_t fidx[] = {1, 11};
+    TEST_ASSERT_TRUE(float_eq(23.0, *(double*)mdarray_get_element(flat, fidx)));
+
+    mdarray_free(flat);
+    TEST_ASSERT_EQUAL(1, mdstorage_refcount(slice->storage));
+    mdarray_free(slice);
+}
+
+void test_mdarray_copy_offsets_in_elements(void) {
+    size_t shape[] = {2, 3, 4};
+    MDArray* arr = mdarray_create(3, shape, sizeof(double));
+    for (size_t i = 0; i < arr->total_size; i++) ((double*)arr->data)[i] = (double)i;
+
+    // arr[1][2] is the row starting at element 20
+    size_t start[] = {1, 2};
+    MDArray* row = mdarray_copy(arr, 2, start);
+    TEST_ASSERT_NOT_NULL(row);
+    TEST_ASSERT_EQUAL(1, row->ndim);
+    TEST_ASSERT_EQUAL(4, row->shape[0]);
+    size_t i0[] = {0};
+    TEST_ASSERT_TRUE(float_eq(20.0, *(double*)mdarray_get_element(row, i0)));
+
+    size_t bad[] = {2, 0};
+    TEST_ASSERT_NULL(mdarray_copy(arr, 2, bad));
+    size_t wrong[] = {5, 5};
+    TEST_ASSERT_NULL(mdarray_resize(arr, 2, wrong));
+
+    mdarray_free(arr);
+    mdarray_free(row);
+}
+
+static void churn_views(size_t tid, size_t n_threads, void* ctx) {
+    MDArray* arr = (MDArray*)ctx;
+    (void)n_threads;
+    for (size_t i = 0; i < 10000; i++) {
+        MDArray* view = mdarray_get(arr, (tid + i) % arr->shape[0]);
+        mdarray_free(view);
+    }
+}
+
+void test_mdarray_refcount_is_thread_safe(void) {
+    size_t shape[] = {8, 16};
+    MDArray* arr = mdarray_create(2, shape, sizeof(double));
+    parallel_run(4, churn_views, arr);
+    TEST_ASSERT_EQUAL(1, mdstorage_refcount(arr->storage));
+    mdarray_free(arr);
+}
+
+void test_mdarray_from_data_borrows(void) {
+    double buf[6] = {0};
+    size_t shape[] = {2, 3};
+    MDArray* arr = mdarray_from_data(2, shape, sizeof(double), buf);
+    TEST_ASSERT_NULL(arr->storage);
+    MDArray* row = mdarray_get(arr, 1);
+    TEST_ASSERT_TRUE(row->data == (void*)&buf[3]);
+    mdarray_free(row);
+    mdarray_free(arr);
+}
+
+// The fill is split across threads, the values must not be
+void test_mdarray_randn_independent_of_threads(void) {
+    size_t shape[] = {70001};
+    MDArray* a = mdarray_create(1, shape, sizeof(double));
+    MDArray* b = mdarray_create(1, shape, sizeof(double));
+    setenv("NNC_THREADS", "1", 1);
+    srand(13);
+    mdarray_randn(a, 2.0);
+    setenv("NNC_THREADS", "4", 1);
+    srand(13);
+    mdarray_randn(b, 2.0);
+    unsetenv("NNC_THREADS");
+    TEST_ASSERT_EQUAL_MEMORY(a->data, b->data, a->total_size * sizeof(double));
+
+    double sum = 0.0, sq = 0.0;
+    const double* d = (const double*)a->data;
+    for (size_t i = 0; i < a->total_size; i++) {
+        sum += d[i];
+        sq += d[i] * d[i];
+    }
+    double mean = sum / (double)a->total_size;
+    TEST_ASSERT_TRUE(fabs(mean) < 0.05);
+    TEST_ASSERT_TRUE(fabs(sqrt(sq / (double)a->total_size - mean * mean) - 2.0) < 0.05);
+    mdarray_free(a);
+    mdarray_free(b);
+}
+
+void test_linearmodel_add_bias_reports_mismatch(void) {
+    size_t shape_s[] = {10, 3}, shape_b[] = {4, 1};
+    MDArray* scores = mdarray_create(2, shape_s, sizeof(double));
+    LinearModel model = {NULL, NULL, NULL, mdarray_create(2, shape_b, sizeof(double))};
+    mdarray_zeros(scores);
+    TEST_ASSERT_EQUAL(-1, linearmodel_add_bias(&model, scores));
+    mdarray_free(model.biases);
+    mdarray_free(scores);
+}
+
 int main(void) {
     UNITY_BEGIN();
     RUN_TEST(test_mdarray_creation_and_access);
@@ -420,5 +660,15 @@ int main(void) {
     RUN_TEST(test_svm_loss_backward_shape_and_values);
     RUN_TEST(test_svm_loss_backward_no_violation);
     RUN_TEST(test_svm_loss_backward_batch);
+    RUN_TEST(test_svm_loss_grad_matches_separate_passes);
+    RUN_TEST(test_mdarray_dot_bias_relu_matches_unfused);
+    RUN_TEST(test_mdarray_dot_tn_relu_grad);
+    RUN_TEST(test_mdarray_fused_dot_threads_match_serial);
+    RUN_TEST(test_mdarray_view_outlives_parent);
+    RUN_TEST(test_mdarray_copy_offsets_in_elements);
+    RUN_TEST(test_mdarray_refcount_is_thread_safe);
+    RUN_TEST(test_mdarray_from_data_borrows);
+    RUN_TEST(test_mdarray_randn_independent_of_threads);
+    RUN_TEST(test_linearmodel_add_bias_reports_mismatch);
     return UNITY_END();
 }
\ No newline at end of file
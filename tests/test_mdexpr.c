@@ -0,0 +1,130 @@
+#include "unity.h"
+#include "mdarray.h"
+#include "mdexpr.h"
+#include <math.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define FLOAT_EPSILON 0.0001f
+static int float_eq(double a, double b) {
+    return fabs(a - b) < FLOAT_EPSILON;
+}
+
+static MDArray* filled(size_t rows, size_t cols, double start) {
+    size_t shape[] = {rows, cols};
+    MDArray* arr = mdarray_create(2, shape, sizeof(double));
+    for (size_t i = 0; i < arr->total_size; i++) ((double*)arr->data)[i] = start + (double)i;
+    return arr;
+}
+
+void test_mdexpr_broadcast_add(void) {
+    // (2, 3) + (2, 1) + (1, 3)
+    MDArray* a = filled(2, 3, 0.0);     // [[0,1,2],[3,4,5]]
+    MDArray* col = filled(2, 1, 10.0);  // [[10],[11]]
+    MDArray* row = filled(1, 3, 100.0); // [[100,101,102]]
+
+    MDExprGraph* g = mdexpr_graph_new();
+    MDExpr* e = mdexpr_add(g, mdexpr_add(g, mdexpr_leaf(g, a), mdexpr_leaf(g, col)), mdexpr_leaf(g, row));
+    MDArray* out = mdexpr_eval(g, e);
+    TEST_ASSERT_NOT_NULL(out);
+    TEST_ASSERT_EQUAL(2, out->shape[0]);
+    TEST_ASSERT_EQUAL(3, out->shape[1]);
+
+    size_t i00[] = {0, 0}, i12[] = {1, 2};
+    TEST_ASSERT_TRUE(float_eq(110.0, *(double*)mdarray_get_element(out, i00)));
+    TEST_ASSERT_TRUE(float_eq(5.0 + 11.0 + 102.0, *(double*)mdarray_get_element(out, i12)));
+
+    mdarray_free(out);
+    mdexpr_graph_free(g);
+    mdarray_free(a);
+    mdarray_free(col);
+    mdarray_free(row);
+}
+
+void test_mdexpr_fused_chain_matches_eager(void) {
+    // clamp((s + b) * 2 - s, 0, 600) over a width larger than one tile, with s shared in the DAG
+    size_t rows = 3, cols = MDEXPR_TILE * 2 + 5;
+    MDArray* s = filled(rows, cols, -300.0);
+    MDArray* b = filled(rows, 1, 1.0);
+
+    MDExprGraph* g = mdexpr_graph_new();
+    MDExpr* sl = mdexpr_leaf(g, s);
+    MDExpr* e = mdexpr_sub(g, mdexpr_mul(g, mdexpr_add(g, sl, mdexpr_leaf(g, b)), mdexpr_scalar(g, 2.0)), sl);
+    e = mdexpr_min(g, mdexpr_max(g, e, mdexpr_scalar(g, 0.0)), mdexpr_scalar(g, 600.0));
+    MDArray* out = mdexpr_eval(g, e);
+    TEST_ASSERT_NOT_NULL(out);
+
+    for (size_t r = 0; r < rows; r++) {
+        for (size_t c = 0; c < cols; c++) {
+            double sv = ((double*)s->data)[r * cols + c];
+            double expect = (sv + ((double*)b->data)[r]) * 2.0 - sv;
+            expect = expect < 0.0 ? 0.0 : expect > 600.0 ? 600.0 : expect;
+            TEST_ASSERT_TRUE(float_eq(expect, ((double*)out->data)[r * cols + c]));
+        }
+    }
+
+    mdarray_free(out);
+    mdexpr_graph_free(g);
+    mdarray_free(s);
+    mdarray_free(b);
+}
+
+void test_mdexpr_eval_in_place(void) {
+    MDArray* s = filled(2, 4, 0.0);
+    MDArray* b = filled(2, 1, 1.0);
+
+    MDExprGraph* g = mdexpr_graph_new();
+    TEST_ASSERT_EQUAL(0, mdexpr_eval_into(g, mdexpr_add(g, mdexpr_leaf(g, s), mdexpr_leaf(g, b)), s));
+    mdexpr_graph_free(g);
+
+    size_t i03[] = {0, 3}, i10[] = {1, 0};
+    TEST_ASSERT_TRUE(float_eq(4.0, *(double*)mdarray_get_element(s, i03)));
+    TEST_ASSERT_TRUE(float_eq(6.0, *(double*)mdarray_get_element(s, i10)));
+
+    mdarray_free(s);
+    mdarray_free(b);
+}
+
+void test_mdexpr_gt_mask(void) {
+    // (x - row + 1 > 0) * 0.5, the hinge mask svm_loss_backward builds
+    MDArray* x = filled(2, 3, -2.0);    // [[-2,-1,0],[1,2,3]]
+    MDArray* row = filled(1, 3, 0.0);   // [[0,1,2]]
+
+    MDExprGraph* g = mdexpr_graph_new();
+    MDExpr* margin = mdexpr_add(g, mdexpr_sub(g, mdexpr_leaf(g, x), mdexpr_leaf(g, row)), mdexpr_scalar(g, 1.0));
+    MDArray* out = mdexpr_eval(g, mdexpr_mul(g, mdexpr_gt(g, margin, mdexpr_scalar(g, 0.0)), mdexpr_scalar(g, 0.5)));
+    TEST_ASSERT_NOT_NULL(out);
+
+    double expect[] = {0.0, 0.0, 0.0, 0.5, 0.5, 0.5};
+    for (size_t i = 0; i < 6; i++) TEST_ASSERT_TRUE(((double*)out->data)[i] == expect[i]);
+
+    mdarray_free(out);
+    mdexpr_graph_free(g);
+    mdarray_free(x);
+    mdarray_free(row);
+}
+
+void test_mdexpr_shape_mismatch_returns_null(void) {
+    MDArray* a = filled(2, 3, 0.0);
+    MDArray* b = filled(3, 2, 0.0);
+
+    MDExprGraph* g = mdexpr_graph_new();
+    MDExpr* e = mdexpr_add(g, mdexpr_leaf(g, a), mdexpr_leaf(g, b));
+    TEST_ASSERT_NULL(e);
+    TEST_ASSERT_NULL(mdexpr_eval(g, mdexpr_mul(g, e, mdexpr_scalar(g, 2.0))));
+    mdexpr_graph_free(g);
+
+    mdarray_free(a);
+    mdarray_free(b);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mdexpr_broadcast_add);
+    RUN_TEST(test_mdexpr_fused_chain_matches_eager);
+    RUN_TEST(test_mdexpr_eval_in_place);
+    RUN_TEST(test_mdexpr_gt_mask);
+    RUN_TEST(test_mdexpr_shape_mismatch_returns_null);
+    return UNITY_END();
+}
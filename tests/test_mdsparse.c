@@ -0,0 +1,147 @@
+#include "unity.h"
+#include "mdsparse.h"
+#include <math.h>
+#include <stdlib.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define N 7
+#define K 12
+#define C 3
+
+// Roughly 70% zeros, like MNIST
+static MDArray* make_dense(void) {
+    size_t shape[] = {N, 3, 4};
+    MDArray* x = mdarray_create(3, shape, sizeof(double));
+    double* d = (double*)x->data;
+    for (size_t k = 0; k < x->total_size; k++) d[k] = (k * 37) % 10 < 3 ? (double)(k % 5 + 1) : 0.0;
+    return x;
+}
+
+static MDArray* make_matrix(size_t rows, size_t cols, double scale) {
+    size_t shape[] = {rows, cols};
+    MDArray* m = mdarray_create(2, shape, sizeof(double));
+    double* d = (double*)m->data;
+    for (size_t k = 0; k < m->total_size; k++) d[k] = scale * ((double)((k * 13) % 7) - 3.0);
+    return m;
+}
+
+void test_mdsparse_from_dense_roundtrip(void) {
+    MDArray* x = make_dense();
+    MDSparse* sp = mdsparse_from_dense(x);
+    TEST_ASSERT_NOT_NULL(sp);
+    TEST_ASSERT_EQUAL(N, sp->rows);
+    TEST_ASSERT_EQUAL(K, sp->cols);
+
+    const double* d = (const double*)x->data;
+    size_t nnz = 0;
+    for (size_t k = 0; k < x->total_size; k++) nnz += d[k] != 0.0;
+    TEST_ASSERT_EQUAL(nnz, sp->nnz);
+
+    double rebuilt[N * K] = {0};
+    for (size_t i = 0; i < N; i++) {
+        for (size_t p = sp->ptr[i]; p < sp->ptr[i + 1]; p++) rebuilt[i * K + sp->idx[p]] = sp->values[p];
+    }
+    TEST_ASSERT_EQUAL_MEMORY(d, rebuilt, sizeof(rebuilt));
+
+    mdsparse_free(sp);
+    mdarray_free(x);
+}
+
+void test_mdsparse_from_uint8(void) {
+    size_t shape[] = {2, 4};
+    MDArray* x = mdarray_create(2, shape, 1);
+    unsigned char pixels[] = {0, 255, 0, 3, 0, 0, 0, 9};
+    for (size_t k = 0; k < 8; k++) ((unsigned char*)x->data)[k] = pixels[k];
+
+    MDSparse* sp = mdsparse_from_dense(x);
+    TEST_ASSERT_EQUAL(3, sp->nnz);
+    TEST_ASSERT_EQUAL(2, sp->ptr[1]);
+    TEST_ASSERT_EQUAL(3, sp->idx[2]);
+    TEST_ASSERT_TRUE(sp->values[0] == 255.0 && sp->values[2] == 9.0);
+
+    mdsparse_free(sp);
+    mdarray_free(x);
+}
+
+void test_mdsparse_dot_wxt_matches_dense(void) {
+    MDArray* x = make_dense();
+    MDSparse* sp = mdsparse_from_dense(x);
+    MDArray* w = make_matrix(C, K, 0.5);
+    size_t shape[] = {C, N};
+    MDArray* out = mdarray_create(2, shape, sizeof(double));
+
+    TEST_ASSERT_EQUAL(0, mdsparse_dot_wxt(w, sp, out));
+    const double* xd = (const double*)x->data;
+    const double* wd = (const double*)w->data;
+    const double* o = (const double*)out->data;
+    for (size_t c = 0; c < C; c++) {
+        for (size_t j = 0; j < N; j++) {
+            double want = 0.0;
+            for (size_t k = 0; k < K; k++) want += wd[c * K + k] * xd[j * K + k];
+            TEST_ASSERT_TRUE(fabs(o[c * N + j] - want) < 1e-12);
+        }
+    }
+
+    mdarray_free(out);
+    mdarray_free(w);
+    mdsparse_free(sp);
+    mdarray_free(x);
+}
+
+void test_mdsparse_dot_dx_csr_and_csc(void) {
+    MDArray* x = make_dense();
+    MDSparse* csr = mdsparse_from_dense(x);
+    MDSparse* csc = mdsparse_to_csc(csr);
+    TEST_ASSERT_NOT_NULL(csc);
+    TEST_ASSERT_EQUAL(csr->nnz, csc->nnz);
+
+    MDArray* d = make_matrix(C, N, 0.25);
+    size_t shape[] = {C, K};
+    MDArray* a = mdarray_create(2, shape, sizeof(double));
+    MDArray* b = mdarray_create(2, shape, sizeof(double));
+    TEST_ASSERT_EQUAL(0, mdsparse_dot_dx(d, csr, a));
+    TEST_ASSERT_EQUAL(0, mdsparse_dot_dx(d, csc, b));
+
+    const double* xd = (const double*)x->data;
+    const double* dd = (const double*)d->data;
+    for (size_t c = 0; c < C; c++) {
+        for (size_t k = 0; k < K; k++) {
+            double want = 0.0;
+            for (size_t j = 0; j < N; j++) want += dd[c * N + j] * xd[j * K + k];
+            TEST_ASSERT_TRUE(fabs(((double*)a->data)[c * K + k] - want) < 1e-12);
+            TEST_ASSERT_TRUE(fabs(((double*)b->data)[c * K + k] - want) < 1e-12);
+        }
+    }
+
+    mdarray_free(a);
+    mdarray_free(b);
+    mdarray_free(d);
+    mdsparse_free(csr);
+    mdsparse_free(csc);
+    mdarray_free(x);
+}
+
+void test_mdsparse_rejects_bad_shapes(void) {
+    MDArray* x = make_dense();
+    MDSparse* sp = mdsparse_from_dense(x);
+    MDArray* w = make_matrix(C, K + 1, 1.0);
+    size_t shape[] = {C, N};
+    MDArray* out = mdarray_create(2, shape, sizeof(double));
+    TEST_ASSERT_EQUAL(-1, mdsparse_dot_wxt(w, sp, out));
+    mdarray_free(out);
+    mdarray_free(w);
+    mdsparse_free(sp);
+    mdarray_free(x);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mdsparse_from_dense_roundtrip);
+    RUN_TEST(test_mdsparse_from_uint8);
+    RUN_TEST(test_mdsparse_dot_wxt_matches_dense);
+    RUN_TEST(test_mdsparse_dot_dx_csr_and_csc);
+    RUN_TEST(test_mdsparse_rejects_bad_shapes);
+    return UNITY_END();
+}
@@ -0,0 +1,88 @@
+#include "unity.h"
+#include "memory.h"
+#include "mdarray.h"
+#include "parallel.h"
+#include <stdint.h>
+
+void setUp(void) {}
+void tearDown(void) {
+    mdmem_configure(MDMEM_DEFAULT, 0);
+}
+
+void test_mdmem_parse_nodes(void) {
+    unsigned long mask;
+    TEST_ASSERT_EQUAL(1, mdmem_parse_nodes("0\n", &mask));
+    TEST_ASSERT_EQUAL(1, mask);
+    TEST_ASSERT_EQUAL(4, mdmem_parse_nodes("0-2,5", &mask));
+    TEST_ASSERT_EQUAL(0x27, mask);
+    TEST_ASSERT_EQUAL(0, mdmem_parse_nodes("", &mask));
+    TEST_ASSERT_TRUE(mdmem_numa_nodes() >= 1);
+}
+
+void test_mdmem_policy_names(void) {
+    MDMemPolicy p;
+    TEST_ASSERT_EQUAL(0, mdmem_policy_from_name("interleave", &p));
+    TEST_ASSERT_EQUAL(MDMEM_INTERLEAVE, p);
+    TEST_ASSERT_EQUAL(-1, mdmem_policy_from_name("remote", &p));
+    TEST_ASSERT_EQUAL(-1, mdmem_configure((MDMemPolicy)42, 0));
+}
+
+// Every policy must hand back usable, zero-initialised tensors
+void test_mdmem_policies_allocate_tensors(void) {
+    MDMemPolicy policies[] = {MDMEM_DEFAULT, MDMEM_LOCAL, MDMEM_INTERLEAVE, MDMEM_PARTITIONED};
+    size_t shape[] = {300, 784};
+    for (size_t i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL(0, mdmem_configure(policies[i], 0));
+        MDArray* arr = mdarray_create(2, shape, sizeof(double));
+        TEST_ASSERT_NOT_NULL(arr);
+        TEST_ASSERT_EQUAL(policies[i] != MDMEM_DEFAULT, arr->storage->mapped);
+
+        mdarray_fill(arr, 2.5);
+        const double* d = (const double*)arr->data;
+        for (size_t k = 0; k < arr->total_size; k++) TEST_ASSERT_TRUE(d[k] == 2.5);
+        mdarray_free(arr);
+
+        // Bias-sized tensors are not worth a mapping under any policy
+        size_t bias[] = {10};
+        MDArray* b = mdarray_create(1, bias, sizeof(double));
+        TEST_ASSERT_FALSE(b->storage->mapped);
+        mdarray_free(b);
+    }
+}
+
+void test_parallel_parse_cpus(void) {
+    bool cpus[16];
+    TEST_ASSERT_EQUAL(5, parallel_parse_cpus("0-2,8,10\n", cpus, 16));
+    TEST_ASSERT_TRUE(cpus[2]);
+    TEST_ASSERT_TRUE(cpus[10]);
+    TEST_ASSERT_FALSE(cpus[3]);
+    TEST_ASSERT_EQUAL(2, parallel_parse_cpus("14-20", cpus, 16));
+    TEST_ASSERT_EQUAL(0, parallel_parse_cpus("", cpus, 16));
+}
+
+void test_mdmem_hugepage_alignment(void) {
+    TEST_ASSERT_EQUAL(0, mdmem_configure(MDMEM_DEFAULT, 1u << 20));
+    size_t big[] = {3u << 20};
+    MDArray* arr = mdarray_create(1, big, 1);
+    TEST_ASSERT_TRUE(arr->storage->mapped);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)arr->data % MDMEM_HUGEPAGE_SIZE);
+    ((char*)arr->data)[arr->total_size - 1] = 1;
+
+    // Below the threshold stays on malloc
+    size_t small[] = {1024};
+    MDArray* s = mdarray_create(1, small, 1);
+    TEST_ASSERT_FALSE(s->storage->mapped);
+
+    mdarray_free(arr);
+    mdarray_free(s);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mdmem_parse_nodes);
+    RUN_TEST(test_mdmem_policy_names);
+    RUN_TEST(test_mdmem_policies_allocate_tensors);
+    RUN_TEST(test_mdmem_hugepage_alignment);
+    RUN_TEST(test_parallel_parse_cpus);
+    return UNITY_END();
+}
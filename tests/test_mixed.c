@@ -0,0 +1,153 @@
+#include "unity.h"
+#include "mixed.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define N 6
+#define K 20
+#define C 3
+
+void test_bf16_pixels_are_exact(void) {
+    for (int p = 0; p < 256; p++) {
+        TEST_ASSERT_TRUE(mixed_from_bf16(mixed_to_bf16((float)p)) == (float)p);
+    }
+}
+
+void test_bf16_rounds_to_nearest_even(void) {
+    // 257 sits halfway between 256 and 258, ties go to the even mantissa
+    TEST_ASSERT_TRUE(mixed_from_bf16(mixed_to_bf16(257.0f)) == 256.0f);
+    TEST_ASSERT_TRUE(mixed_from_bf16(mixed_to_bf16(259.0f)) == 260.0f);
+    TEST_ASSERT_TRUE(isnan(mixed_from_bf16(mixed_to_bf16(NAN))));
+}
+
+// One float64 step written out longhand, the mixed step should agree to float32 precision
+static double reference_step(double* w, double* b, const double* x, const size_t* labels, double lr) {
+    double scores[C][N], ds[C][N] = {{0}};
+    double loss = 0.0;
+    for (size_t c = 0; c < C; c++) {
+        for (size_t j = 0; j < N; j++) {
+            scores[c][j] = b[c];
+            for (size_t k = 0; k < K; k++) scores[c][j] += w[c * K + k] * x[j * K + k];
+        }
+    }
+    for (size_t j = 0; j < N; j++) {
+        size_t count = 0;
+        for (size_t c = 0; c < C; c++) {
+            double margin = scores[c][j] - scores[labels[j]][j] + 1.0;
+            if (c != labels[j] && margin > 0.0) {
+                loss += margin;
+                ds[c][j] = 1.0 / N;
+                count++;
+            }
+        }
+        ds[labels[j]][j] = -(double)count / N;
+    }
+    for (size_t c = 0; c < C; c++) {
+        for (size_t j = 0; j < N; j++) b[c] -= lr * ds[c][j];
+        for (size_t k = 0; k < K; k++) {
+            double g = 0.0;
+            for (size_t j = 0; j < N; j++) g += ds[c][j] * x[j * K + k];
+            w[c * K + k] -= lr * g;
+        }
+    }
+    return loss / N;
+}
+
+static void check_step(bool bf16) {
+    size_t shape_x[] = {N, K}, shape_w[] = {C, K}, shape_b[] = {C, 1};
+    MDArray* x = mdarray_create(2, shape_x, sizeof(double));
+    MDArray* w = mdarray_create(2, shape_w, sizeof(double));
+    MDArray* b = mdarray_create(2, shape_b, sizeof(double));
+    double* xd = (double*)x->data;
+    double* wd = (double*)w->data;
+    for (size_t i = 0; i < N * K; i++) xd[i] = (double)((i * 53) % 256) * ((i % 3) != 0);
+    for (size_t i = 0; i < C * K; i++) wd[i] = 0.001 * ((double)((i * 7) % 11) - 5.0);
+    mdarray_zeros(b);
+    size_t labels[N] = {0, 1, 2, 0, 1, 2};
+
+    double w_ref[C * K], b_ref[C] = {0};
+    for (size_t i = 0; i < C * K; i++) w_ref[i] = wd[i];
+
+    MixedLinear* m = mixed_linear_new(x, C, bf16);
+    TEST_ASSERT_NOT_NULL(m);
+    for (int step = 0; step < 3; step++) {
+        double want = reference_step(w_ref, b_ref, xd, labels, 1e-3);
+        double got = mixed_linear_step(m, w, b, labels, 1e-3);
+        TEST_ASSERT_TRUE(fabs(got - want) <= 1e-4 * (1.0 + fabs(want)));
+    }
+    for (size_t i = 0; i < C * K; i++) TEST_ASSERT_TRUE(fabs(wd[i] - w_ref[i]) < 1e-6);
+    for (size_t c = 0; c < C; c++) TEST_ASSERT_TRUE(fabs(((double*)b->data)[c] - b_ref[c]) < 1e-6);
+
+    mixed_linear_free(m);
+    mdarray_free(x);
+    mdarray_free(w);
+    mdarray_free(b);
+}
+
+void test_mixed_step_matches_float64(void) {
+    check_step(false);
+}
+
+void test_mixed_step_bf16_images(void) {
+    check_step(true);
+}
+
+// Big enough to be split across threads; K is not a multiple of the vector width
+static void check_threads_match_serial(bool bf16) {
+    size_t n = 600, k = 250, classes = 10;
+    size_t shape_x[] = {n, k}, shape_w[] = {classes, k}, shape_b[] = {classes, 1};
+    MDArray* x = mdarray_create(2, shape_x, sizeof(double));
+    double* xd = (double*)x->data;
+    for (size_t i = 0; i < n * k; i++) xd[i] = (double)((i * 53) % 256) * ((i % 3) != 0);
+    size_t* labels = (size_t*)malloc(n * sizeof(size_t));
+    for (size_t j = 0; j < n; j++) labels[j] = j % classes;
+
+    MDArray* w[2];
+    MDArray* b[2];
+    double loss[2];
+    const char* threads[] = {"1", "4"};
+    MixedLinear* m = mixed_linear_new(x, classes, bf16);
+    TEST_ASSERT_NOT_NULL(m);
+    for (int t = 0; t < 2; t++) {
+        setenv("NNC_THREADS", threads[t], 1);
+        w[t] = mdarray_create(2, shape_w, sizeof(double));
+        b[t] = mdarray_create(2, shape_b, sizeof(double));
+        double* wd = (double*)w[t]->data;
+        for (size_t i = 0; i < classes * k; i++) wd[i] = 0.001 * ((double)((i * 7) % 11) - 5.0);
+        mdarray_zeros(b[t]);
+        loss[t] = mixed_linear_step(m, w[t], b[t], labels, 1e-3);
+    }
+    unsetenv("NNC_THREADS");
+
+    TEST_ASSERT_TRUE(loss[0] >= 0.0);
+    TEST_ASSERT_TRUE(loss[0] == loss[1]);
+    TEST_ASSERT_EQUAL_MEMORY(w[0]->data, w[1]->data, classes * k * sizeof(double));
+    TEST_ASSERT_EQUAL_MEMORY(b[0]->data, b[1]->data, classes * sizeof(double));
+
+    for (int t = 0; t < 2; t++) {
+        mdarray_free(w[t]);
+        mdarray_free(b[t]);
+    }
+    mixed_linear_free(m);
+    free(labels);
+    mdarray_free(x);
+}
+
+void test_mixed_step_threads_match_serial(void) {
+    check_threads_match_serial(false);
+    check_threads_match_serial(true);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_bf16_pixels_are_exact);
+    RUN_TEST(test_bf16_rounds_to_nearest_even);
+    RUN_TEST(test_mixed_step_matches_float64);
+    RUN_TEST(test_mixed_step_bf16_images);
+    RUN_TEST(test_mixed_step_threads_match_serial);
+    return UNITY_END();
+}
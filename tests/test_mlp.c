@@ -0,0 +1,71 @@
+#include "unity.h"
+#include "mdarray.h"
+#include "mlp.h"
+#include "autograd.h"
+#include <math.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define N 6
+
+static MDArray* make_images(void) {
+    size_t shape[] = {N, 28, 28};
+    MDArray* imgs = mdarray_create(3, shape, sizeof(double));
+    for (size_t i = 0; i < imgs->total_size; i++) ((double*)imgs->data)[i] = (double)((i * 31) % 256);
+    return imgs;
+}
+
+static int close_arrays(MDArray* a, MDArray* b) {
+    for (size_t i = 0; i < a->total_size; i++) {
+        double x = ((double*)a->data)[i], y = ((double*)b->data)[i];
+        if (fabs(x - y) > 1e-6 * (1.0 + fabs(y))) return 0;
+    }
+    return 1;
+}
+
+void test_mlp_gradients_match_autograd(void) {
+    srand(9);
+    MDArray* imgs = make_images();
+    size_t hidden[] = {16, 12};
+    size_t labels[] = {0, 3, 9, 1, 3, 7};
+    MLP* mlp = mlp_new(imgs, NULL, 2, hidden);
+    TEST_ASSERT_NOT_NULL(mlp);
+    TEST_ASSERT_EQUAL(3, mlp->n_layers);
+
+    // Same network recorded on the tape, sharing the MLP's parameters
+    AGTape* t = ag_tape_new();
+    int h = ag_input(t, mlp->x_t);
+    int w[3], b[3];
+    for (size_t l = 0; l < 3; l++) {
+        w[l] = ag_param(t, mlp->weights[l]);
+        b[l] = ag_param(t, mlp->biases[l]);
+        h = ag_add_bias(t, ag_matmul(t, w[l], h), b[l]);
+        if (l < 2) h = ag_relu(t, h);
+    }
+    int scores_id = h;
+    ag_svm_loss(t, scores_id, labels);
+    TEST_ASSERT_EQUAL(0, ag_plan(t));
+    double loss = ag_forward(t);
+
+    MDArray* scores = mlp_forward(mlp);
+    TEST_ASSERT_TRUE(close_arrays(scores, ag_value(t, scores_id)));
+    TEST_ASSERT_TRUE(fabs(loss - svm_loss(scores, labels, N)) < 1e-9);
+
+    ag_backward(t);
+    TEST_ASSERT_EQUAL(0, mlp_backward(mlp, scores, labels, N, 0.0));
+    for (size_t l = 0; l < 3; l++) {
+        TEST_ASSERT_TRUE(close_arrays(mlp->dw[l], ag_grad(t, w[l])));
+        TEST_ASSERT_TRUE(close_arrays(mlp->db[l], ag_grad(t, b[l])));
+    }
+
+    ag_tape_free(t);
+    mlp_free(mlp);
+    mdarray_free(imgs);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mlp_gradients_match_autograd);
+    return UNITY_END();
+}
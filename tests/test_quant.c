@@ -0,0 +1,128 @@
+#include "unity.h"
+#include "mdarray.h"
+#include "quant.h"
+#include <math.h>
+#include <stdlib.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define ROWS 10
+#define COLS 784
+#define N    7
+
+static MDArray* make_weights(void) {
+    size_t shape[] = {ROWS, COLS};
+    MDArray* w = mdarray_create(2, shape, sizeof(double));
+    srand(42);
+    mdarray_randn(w, 0.01);
+    return w;
+}
+
+static MDArray* make_biases(void) {
+    size_t shape[] = {ROWS, 1};
+    MDArray* b = mdarray_create(2, shape, sizeof(double));
+    for (size_t i = 0; i < ROWS; i++) ((double*)b->data)[i] = 0.1 * (double)i;
+    return b;
+}
+
+static MDArray* make_images(void) {
+    size_t shape[] = {N, 28, 28};
+    MDArray* imgs = mdarray_create(3, shape, sizeof(double));
+    for (size_t i = 0; i < imgs->total_size; i++) {
+        ((double*)imgs->data)[i] = (double)((i * 37) % 256);
+    }
+    return imgs;
+}
+
+void test_quant_pack_inputs(void) {
+    MDArray* imgs = make_images();
+    MDArray* packed = quant_pack_inputs(imgs);
+    TEST_ASSERT_NOT_NULL(packed);
+    TEST_ASSERT_EQUAL(2, packed->ndim);
+    TEST_ASSERT_EQUAL(N, packed->shape[0]);
+    TEST_ASSERT_EQUAL(COLS, packed->shape[1]);
+    TEST_ASSERT_EQUAL(1, packed->itemsize);
+    for (size_t i = 0; i < imgs->total_size; i++) {
+        TEST_ASSERT_EQUAL((i * 37) % 256, ((unsigned char*)packed->data)[i]);
+    }
+    mdarray_free(packed);
+    mdarray_free(imgs);
+}
+
+void test_quant_pack_inputs_rejects_empty(void) {
+    size_t shape[] = {0, 28, 28};
+    MDArray* imgs = mdarray_from_data(3, shape, sizeof(double), NULL);
+    TEST_ASSERT_NOT_NULL(imgs);
+    TEST_ASSERT_NULL(quant_pack_inputs(imgs));
+    mdarray_free(imgs);
+}
+
+void test_quant_forward_matches_float(void) {
+    MDArray* w = make_weights();
+    MDArray* b = make_biases();
+    MDArray* imgs = make_images();
+
+    QuantLinear* q = quant_linear_new(w, b);
+    TEST_ASSERT_NOT_NULL(q);
+    MDArray* packed = quant_pack_inputs(imgs);
+    MDArray* scores = quant_linear_forward(q, packed);
+    TEST_ASSERT_NOT_NULL(scores);
+    TEST_ASSERT_EQUAL(ROWS, scores->shape[0]);
+    TEST_ASSERT_EQUAL(N, scores->shape[1]);
+
+    // Rounding error per weight is at most scale/2, so bound it by scale/2 * sum(x)
+    for (size_t r = 0; r < ROWS; r++) {
+        for (size_t j = 0; j < N; j++) {
+            double ref = ((double*)b->data)[r];
+            double xsum = 0.0;
+            for (size_t k = 0; k < COLS; k++) {
+                double x = ((double*)imgs->data)[j * COLS + k];
+                ref += ((double*)w->data)[r * COLS + k] * x;
+                xsum += x;
+            }
+            size_t idx[] = {r, j};
+            double got = *(double*)mdarray_get_element(scores, idx);
+            TEST_ASSERT_TRUE(fabs(got - ref) <= q->scales[r] * 0.5 * xsum + 1e-6);
+        }
+    }
+
+    mdarray_free(scores);
+    mdarray_free(packed);
+    quant_linear_free(q);
+    mdarray_free(imgs);
+    mdarray_free(b);
+    mdarray_free(w);
+}
+
+void test_quant_kernels_agree(void) {
+    int8_t* w = (int8_t*)malloc(ROWS * COLS);
+    uint8_t* x = (uint8_t*)malloc(N * COLS);
+    // Extreme values make sure nothing saturates on the way to int32
+    for (size_t i = 0; i < ROWS * COLS; i++) w[i] = (int8_t)((i % 3 == 0) ? -127 : 127 - (int)(i % 255));
+    for (size_t i = 0; i < N * COLS; i++) x[i] = (uint8_t)(255 - (i % 7));
+
+    int32_t ref[ROWS * N], got[ROWS * N];
+    TEST_ASSERT_EQUAL(0, quant_select_kernel(QUANT_KERNEL_SCALAR));
+    quant_gemm_u8s8(w, x, ref, ROWS, COLS, N);
+
+    QuantKernel kernels[] = {QUANT_KERNEL_AVX2, QUANT_KERNEL_VNNI};
+    for (size_t k = 0; k < 2; k++) {
+        if (quant_select_kernel(kernels[k]) != 0) continue;  // Not supported on this CPU
+        quant_gemm_u8s8(w, x, got, ROWS, COLS, N);
+        TEST_ASSERT_EQUAL_MEMORY(ref, got, sizeof(ref));
+    }
+
+    TEST_ASSERT_EQUAL(0, quant_select_kernel(QUANT_KERNEL_AUTO));
+    free(w);
+    free(x);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_quant_pack_inputs);
+    RUN_TEST(test_quant_pack_inputs_rejects_empty);
+    RUN_TEST(test_quant_forward_matches_float);
+    RUN_TEST(test_quant_kernels_agree);
+    return UNITY_END();
+}
@@ -0,0 +1,184 @@
+#include "unity.h"
+#include "mdarray.h"
+#include "server.h"
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define FLOAT_EPSILON 0.0001f
+static int float_eq(double a, double b) {
+    return fabs(a - b) < FLOAT_EPSILON;
+}
+
+#define SOCKET_PATH "/tmp/nnc_test_server.sock"
+
+// Scores one-hot on (first pixel % 10) so replies are easy to check
+static MDArray* fake_forward(void* ctx, MDArray* images) {
+    (void)ctx;
+    size_t b = images->shape[0];
+    size_t shape[] = {SERVER_NUM_CLASSES, b};
+    MDArray* scores = mdarray_create(2, shape, sizeof(double));
+    mdarray_zeros(scores);
+    for (size_t i = 0; i < b; i++) {
+        size_t px[] = {i, 0, 0};
+        size_t cls = (size_t)*(double*)mdarray_get_element(images, px) % SERVER_NUM_CLASSES;
+        size_t idx[] = {cls, i};
+        double one = 1.0;
+        mdarray_set_element(scores, idx, &one);
+    }
+    return scores;
+}
+
+static void* run_server(void* arg) {
+    ServerConfig* config = (ServerConfig*)arg;
+    server_run(config, fake_forward, NULL);
+    return NULL;
+}
+
+static int connect_server(void) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCKET_PATH);
+
+    // The server thread may not have bound the socket yet
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) return fd;
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+static int read_full(int fd, void* buf, size_t len) {
+    char* p = (char*)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+void test_server_percentile(void) {
+    double samples[] = {5.0, 1.0, 4.0, 2.0, 3.0, 10.0, 9.0, 8.0, 7.0, 6.0};
+    TEST_ASSERT_TRUE(float_eq(5.0, server_percentile(samples, 10, 0.50)));
+    TEST_ASSERT_TRUE(float_eq(10.0, server_percentile(samples, 10, 0.99)));
+    TEST_ASSERT_TRUE(float_eq(1.0, server_percentile(samples, 10, 0.0)));
+    TEST_ASSERT_TRUE(float_eq(0.0, server_percentile(samples, 0, 0.5)));
+}
+
+void test_server_batches_requests(void) {
+    ServerConfig config = {SOCKET_PATH, 2, 1.0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, run_server, &config);
+
+    int fd = connect_server();
+    TEST_ASSERT_TRUE(fd >= 0);
+
+    // Three requests with max batch 2: one full batch plus one flushed by the deadline
+    unsigned char frame[1 + SERVER_IMG_SIZE];
+    unsigned char first_pixels[] = {3, 7, 12};
+    for (size_t r = 0; r < 3; r++) {
+        memset(frame, 0, sizeof(frame));
+        frame[0] = SERVER_OP_INFER;
+        frame[1] = first_pixels[r];
+        TEST_ASSERT_EQUAL(sizeof(frame), write(fd, frame, sizeof(frame)));
+    }
+
+    for (size_t r = 0; r < 3; r++) {
+        unsigned char bytes[SERVER_REPLY_BYTES];
+        ServerReply reply;
+        TEST_ASSERT_EQUAL(0, read_full(fd, bytes, sizeof(bytes)));
+        server_decode_reply(bytes, &reply);
+        TEST_ASSERT_EQUAL(first_pixels[r] % 10, reply.label);
+        TEST_ASSERT_TRUE(float_eq(1.0, reply.scores[reply.label]));
+    }
+
+    unsigned char op = SERVER_OP_STATS;
+    TEST_ASSERT_EQUAL(1, write(fd, &op, 1));
+    unsigned char bytes[SERVER_STATS_BYTES];
+    ServerStats stats;
+    TEST_ASSERT_EQUAL(0, read_full(fd, bytes, sizeof(bytes)));
+    server_decode_stats(bytes, &stats);
+    TEST_ASSERT_EQUAL(3, stats.requests);
+    TEST_ASSERT_EQUAL(2, stats.batches);
+    TEST_ASSERT_TRUE(stats.p99_us >= stats.p50_us);
+
+    close(fd);
+    server_stop();
+    pthread_join(thread, NULL);
+    TEST_ASSERT_TRUE(access(SOCKET_PATH, F_OK) != 0);
+}
+
+void test_server_reply_encoding_has_no_padding(void) {
+    ServerReply reply = {7, {0}};
+    for (size_t c = 0; c < SERVER_NUM_CLASSES; c++) reply.scores[c] = (double)c * 0.5;
+    unsigned char bytes[SERVER_REPLY_BYTES];
+    server_encode_reply(&reply, bytes);
+
+    uint32_t label;
+    double last;
+    memcpy(&label, bytes, sizeof(label));
+    memcpy(&last, bytes + SERVER_REPLY_BYTES - sizeof(double), sizeof(double));
+    TEST_ASSERT_EQUAL(7, label);
+    TEST_ASSERT_TRUE(float_eq(4.5, last));
+
+    ServerReply back;
+    server_decode_reply(bytes, &back);
+    TEST_ASSERT_EQUAL(7, back.label);
+    TEST_ASSERT_EQUAL_MEMORY(reply.scores, back.scores, sizeof(reply.scores));
+}
+
+// A client that never reads must not stall replies to everybody else
+void test_server_slow_reader_does_not_block(void) {
+    ServerConfig config = {SOCKET_PATH, 1, 1.0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, run_server, &config);
+
+    int slow = connect_server();
+    int fast = connect_server();
+    TEST_ASSERT_TRUE(slow >= 0 && fast >= 0);
+    int small = 1;
+    setsockopt(slow, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+
+    // 1-byte stats requests asking for far more reply bytes than the socket buffers hold,
+    // never read. A blocking send would wedge the server on this client.
+    static unsigned char flood[16384];
+    memset(flood, SERVER_OP_STATS, sizeof(flood));
+    TEST_ASSERT_TRUE(send(slow, flood, sizeof(flood), MSG_DONTWAIT) > 0);
+    usleep(200000);
+
+    unsigned char frame[1 + SERVER_IMG_SIZE];
+    memset(frame, 0, sizeof(frame));
+    frame[0] = SERVER_OP_INFER;
+    frame[1] = 4;
+    TEST_ASSERT_EQUAL(sizeof(frame), write(fast, frame, sizeof(frame)));
+    unsigned char bytes[SERVER_REPLY_BYTES];
+    ServerReply reply;
+    TEST_ASSERT_EQUAL(0, read_full(fast, bytes, sizeof(bytes)));
+    server_decode_reply(bytes, &reply);
+    TEST_ASSERT_EQUAL(4, reply.label);
+
+    close(fast);
+    close(slow);
+    server_stop();
+    pthread_join(thread, NULL);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_server_percentile);
+    RUN_TEST(test_server_batches_requests);
+    RUN_TEST(test_server_reply_encoding_has_no_padding);
+    RUN_TEST(test_server_slow_reader_does_not_block);
+    return UNITY_END();
+}
@@ -0,0 +1,118 @@
+#include "unity.h"
+#include "softmax.h"
+#include "mdarray.h"
+#include <math.h>
+#include <stdlib.h>
+
+void setUp(void) {}
+void tearDown(void) {}
+
+#define CLASSES 10
+
+static MDArray* make_scores(size_t n, size_t* labels, double spread) {
+    size_t shape[] = {CLASSES, n};
+    MDArray* scores = mdarray_create(2, shape, sizeof(double));
+    double* s = (double*)scores->data;
+    unsigned seed = 9;
+    for (size_t i = 0; i < CLASSES * n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        s[i] = spread * ((double)(seed >> 16) / 65536.0 - 0.5);
+    }
+    for (size_t i = 0; i < n; i++) labels[i] = (i * 7) % CLASSES;
+    return scores;
+}
+
+// Textbook softmax with libm, no shift
+static double reference(MDArray* scores, const size_t* labels, size_t n, double* ds) {
+    const double* s = (const double*)scores->data;
+    double total = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        double sum = 0.0;
+        for (size_t c = 0; c < CLASSES; c++) sum += exp(s[c * n + i]);
+        total += -log(exp(s[labels[i] * n + i]) / sum);
+        for (size_t c = 0; c < CLASSES; c++) {
+            ds[c * n + i] = (exp(s[c * n + i]) / sum - (c == labels[i] ? 1.0 : 0.0)) / (double)n;
+        }
+    }
+    return total / (double)n;
+}
+
+// Against the selected kernel
+static void check_kernel(void) {
+    size_t n = 37;  // Not a multiple of the vector width
+    size_t labels[37];
+    MDArray* scores = make_scores(n, labels, 8.0);
+    MDArray* ds = mdarray_create(2, scores->shape, sizeof(double));
+    double* ref = (double*)malloc(CLASSES * n * sizeof(double));
+
+    double want = reference(scores, labels, n, ref);
+    double got = softmax_xent(scores, labels, n, ds);
+    TEST_ASSERT_TRUE(fabs(got - want) < 1e-7 * (1.0 + want));
+    for (size_t i = 0; i < CLASSES * n; i++) TEST_ASSERT_TRUE(fabs(((double*)ds->data)[i] - ref[i]) < 1e-9);
+
+    free(ref);
+    mdarray_free(scores);
+    mdarray_free(ds);
+}
+
+void test_softmax_matches_reference(void) {
+    TEST_ASSERT_EQUAL(0, softmax_select_kernel(false));
+    check_kernel();
+    if (softmax_select_kernel(true) == 0) check_kernel();  // Skipped without AVX2
+}
+
+void test_softmax_large_scores_stay_finite(void) {
+    size_t n = 8, labels[8];
+    MDArray* scores = make_scores(n, labels, 1.0);
+    double* s = (double*)scores->data;
+    // exp(1000) overflows without the max shift
+    for (size_t i = 0; i < n; i++) {
+        s[labels[i] * n + i] = 1000.0;
+        s[((labels[i] + 1) % CLASSES) * n + i] = -1000.0;
+    }
+    MDArray* ds = mdarray_create(2, scores->shape, sizeof(double));
+    double loss = softmax_xent(scores, labels, n, ds);
+    TEST_ASSERT_TRUE(isfinite(loss) && loss >= 0.0 && loss < 1e-6);
+    for (size_t i = 0; i < ds->total_size; i++) TEST_ASSERT_TRUE(isfinite(((double*)ds->data)[i]));
+
+    mdarray_free(scores);
+    mdarray_free(ds);
+}
+
+void test_softmax_gradient_columns_sum_to_zero(void) {
+    size_t n = 5000;  // Large enough to run threaded
+    size_t* labels = (size_t*)malloc(n * sizeof(size_t));
+    MDArray* scores = make_scores(n, labels, 20.0);
+    MDArray* ds = mdarray_create(2, scores->shape, sizeof(double));
+
+    double loss = softmax_xent(scores, labels, n, ds);
+    TEST_ASSERT_TRUE(loss > 0.0);
+    TEST_ASSERT_TRUE(fabs(softmax_xent(scores, labels, n, NULL) - loss) < 1e-12);
+    const double* d = (const double*)ds->data;
+    for (size_t i = 0; i < n; i++) {
+        double sum = 0.0;
+        for (size_t c = 0; c < CLASSES; c++) sum += d[c * n + i];
+        TEST_ASSERT_TRUE(fabs(sum) < 1e-12);
+        TEST_ASSERT_TRUE(d[labels[i] * n + i] <= 0.0);
+    }
+
+    free(labels);
+    mdarray_free(scores);
+    mdarray_free(ds);
+}
+
+void test_softmax_rejects_bad_shapes(void) {
+    size_t shape[] = {CLASSES, 4}, labels[4] = {0};
+    MDArray* scores = mdarray_create(2, shape, sizeof(double));
+    TEST_ASSERT_TRUE(softmax_xent(scores, labels, 3, NULL) == -1.0);
+    mdarray_free(scores);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+    RUN_TEST(test_softmax_matches_reference);
+    RUN_TEST(test_softmax_large_scores_stay_finite);
+    RUN_TEST(test_softmax_gradient_columns_sum_to_zero);
+    RUN_TEST(test_softmax_rejects_bad_shapes);
+    return UNITY_END();
+}